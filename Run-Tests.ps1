@@ -7,21 +7,31 @@ Get-ChildItem tests | ForEach-Object {
     }
 
     $PassArgs = (Get-Content "$BasePath/__pass__" | ForEach-Object { return $_.Trim(); } | Where-Object { $_ -ne "" } | ForEach-Object { return  "-p "+ $_; }) -join ' '
+    # Entry points to process, in order. Defaults to `main` if not listed.
+    $EntryArgs = ""
+    if (Test-Path "$BasePath/__entry__") {
+        $EntryArgs = (Get-Content "$BasePath/__entry__" | ForEach-Object { return $_.Trim(); } | Where-Object { $_ -ne "" } | ForEach-Object { return  "-e "+ $_; }) -join ' '
+    }
 
+    # Compile test input shaders first.
     Get-ChildItem $BasePath/*.comp | ForEach-Object {
-        # Compile test input shaders first.
         $InPath = $_;
         $OutPath = "$_.spv";
         if (-not (Test-Path $OutPath)) {
             & glslangValidator $InPath -o $OutPath -V
         }
+    }
 
+    # Modules without a GLSL source, e.g., those with multiple entry points,
+    # are tested as they are.
+    Get-ChildItem $BasePath/*.spv | ForEach-Object {
+        $OutPath = $_;
         Write-Host "testing " + $OutPath
-        $DbgPrintPath = $OutPath + ".log";
+        $DbgPrintPath = "$OutPath.log";
         if ($DryRun) {
-            Write-Host "./out/build/x64-Debug/bin/cspv.exe -i $OutPath --dbg-print-file $DbgPrintPath $PassArgs"
+            Write-Host "./out/build/x64-Debug/bin/cspv.exe -i $OutPath --dbg-print-file $DbgPrintPath $EntryArgs $PassArgs"
         } else {
-            Invoke-Expression "./out/build/x64-Debug/bin/cspv.exe -i $OutPath --dbg-print-file $DbgPrintPath $PassArgs"
+            Invoke-Expression "./out/build/x64-Debug/bin/cspv.exe -i $OutPath --dbg-print-file $DbgPrintPath $EntryArgs $PassArgs"
         }
     }
 }
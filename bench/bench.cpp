@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include "gft/log.hpp"
+#include "node/arena.hpp"
+#include "util/clock.hpp"
+#include "util/json.hpp"
+#include "bench.hpp"
+
+using namespace liong;
+
+bool BenchSuite::is_selected(const std::string& name) const {
+  if (cfg.filters.empty()) { return true; }
+  for (const auto& filter : cfg.filters) {
+    if (name.find(filter) != std::string::npos) { return true; }
+  }
+  return false;
+}
+
+void BenchSuite::run(
+  const std::string& name,
+  const char* unit,
+  uint64_t nitem,
+  const std::function<void()>& f,
+  const std::function<void()>& setup
+) {
+  if (!is_selected(name)) { return; }
+
+  // Find the number of iterations making up a sample. Benchmarks with setup
+  // can only run once per setup.
+  uint64_t niter = 1;
+  if (setup == nullptr) {
+    for (;;) {
+      uint64_t beg = get_wall_ns();
+      for (uint64_t i = 0; i < niter; ++i) { f(); }
+      uint64_t dt = get_wall_ns() - beg;
+      if (dt >= cfg.min_sample_ns || niter >= (1ull << 30)) { break; }
+      // Overshoot a bit so that the next try likely reaches the duration.
+      uint64_t scale = dt == 0 ? 10 : cfg.min_sample_ns * 5 / (dt * 4) + 1;
+      niter *= std::min<uint64_t>(std::max<uint64_t>(scale, 2), 10);
+    }
+  }
+
+  std::vector<double> samples;
+  samples.reserve(cfg.nsample);
+  uint64_t nbyte_alloc = 0;
+  for (uint32_t isample = 0; isample < cfg.nwarmup + cfg.nsample; ++isample) {
+    if (setup != nullptr) { setup(); }
+    uint64_t beg_nbyte_alloc = IrArena::nbyte_alloc_by_thread();
+    uint64_t beg = get_wall_ns();
+    for (uint64_t i = 0; i < niter; ++i) { f(); }
+    uint64_t dt = get_wall_ns() - beg;
+    if (isample >= cfg.nwarmup) {
+      samples.emplace_back((double)dt / niter);
+      nbyte_alloc += IrArena::nbyte_alloc_by_thread() - beg_nbyte_alloc;
+    }
+  }
+
+  BenchResult result {};
+  result.name = name;
+  result.unit = unit;
+  result.nitem = nitem;
+  result.nsample = (uint32_t)samples.size();
+  result.niter = niter;
+  if (!samples.empty()) {
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    result.min_ns = samples.front();
+    result.median_ns = n % 2 == 1 ?
+      samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) * 0.5;
+    double sum = 0.0;
+    for (double x : samples) { sum += x; }
+    result.mean_ns = sum / n;
+    double var = 0.0;
+    for (double x : samples) { var += (x - result.mean_ns) * (x - result.mean_ns); }
+    result.stddev_ns = n > 1 ? std::sqrt(var / (n - 1)) : 0.0;
+    result.nbyte_alloc = (double)nbyte_alloc / (n * niter);
+  }
+  log::info("bench '", name, "': ", result.median_ns * 1e-3, " us");
+  results.emplace_back(std::move(result));
+}
+
+// Scale a number with an SI prefix for display.
+static std::string format_si(double x) {
+  static const char* PREFIXES[] = { "", "K", "M", "G", "T" };
+  size_t i = 0;
+  while (std::abs(x) >= 1000.0 && i + 1 < sizeof(PREFIXES) / sizeof(PREFIXES[0])) {
+    x /= 1000.0;
+    ++i;
+  }
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.2f%s", x, PREFIXES[i]);
+  return buf;
+}
+
+std::string format_bench_results_table(const std::vector<BenchResult>& results) {
+  size_t name_width = 9;
+  for (const auto& result : results) {
+    name_width = std::max(name_width, result.name.size());
+  }
+
+  std::stringstream ss;
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "%-*s %12s %12s %8s %14s %10s\n",
+    (int)name_width, "benchmark", "median (us)", "min (us)", "+/- %",
+    "throughput", "ir bytes");
+  ss << buf;
+  for (const auto& result : results) {
+    double rel_stddev = result.mean_ns > 0.0 ?
+      result.stddev_ns / result.mean_ns * 100.0 : 0.0;
+    std::string throughput = format_si(result.throughput()) + " " +
+      result.unit + "/s";
+    std::string nbyte_alloc = format_si(result.nbyte_alloc) + "B";
+    std::snprintf(buf, sizeof(buf), "%-*s %12.3f %12.3f %8.2f %14s %10s\n",
+      (int)name_width, result.name.c_str(), result.median_ns * 1e-3,
+      result.min_ns * 1e-3, rel_stddev, throughput.c_str(),
+      nbyte_alloc.c_str());
+    ss << buf;
+  }
+  return ss.str();
+}
+
+std::string format_bench_results_json(const std::vector<BenchResult>& results) {
+  std::stringstream ss;
+  ss << "{\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& result = results[i];
+    char buf[512];
+    std::snprintf(buf, sizeof(buf),
+      "\"items\": %llu, \"samples\": %u, \"iterations\": %llu, "
+      "\"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+      "\"stddev_ns\": %.3f, \"items_per_sec\": %.3f, \"ir_bytes\": %.1f",
+      (unsigned long long)result.nitem, result.nsample,
+      (unsigned long long)result.niter, result.min_ns, result.median_ns,
+      result.mean_ns, result.stddev_ns, result.throughput(),
+      result.nbyte_alloc);
+    ss << (i == 0 ? "\n" : ",\n");
+    ss << "    {\"name\": \"" << escape_json(result.name) << "\", ";
+    ss << "\"unit\": \"" << escape_json(result.unit) << "\", " << buf << "}";
+  }
+  ss << "\n  ]\n}\n";
+  return ss.str();
+}
+
+// Find the string value of `key` in a single-line JSON object. Only the
+// escapes `format_bench_results_json` writes are handled.
+static bool find_json_str(
+  const std::string& line,
+  const char* key,
+  std::string& out
+) {
+  std::string pattern = std::string("\"") + key + "\": \"";
+  size_t i = line.find(pattern);
+  if (i == std::string::npos) { return false; }
+  out.clear();
+  for (i += pattern.size(); i < line.size() && line[i] != '"'; ++i) {
+    if (line[i] != '\\' || i + 1 >= line.size()) {
+      out += line[i];
+    } else if (line[i + 1] == 'u' && i + 5 < line.size()) {
+      out += (char)std::strtoul(line.substr(i + 2, 4).c_str(), nullptr, 16);
+      i += 5;
+    } else {
+      out += line[++i];
+    }
+  }
+  return true;
+}
+static bool find_json_num(const std::string& line, const char* key, double& out) {
+  std::string pattern = std::string("\"") + key + "\": ";
+  size_t i = line.find(pattern);
+  if (i == std::string::npos) { return false; }
+  out = std::strtod(line.c_str() + i + pattern.size(), nullptr);
+  return true;
+}
+
+std::vector<BenchResult> parse_bench_results_json(const std::string& json) {
+  std::vector<BenchResult> out;
+  std::istringstream ss(json);
+  std::string line;
+  while (std::getline(ss, line)) {
+    BenchResult result {};
+    if (!find_json_str(line, "name", result.name)) { continue; }
+    find_json_str(line, "unit", result.unit);
+    double x = 0.0;
+    if (find_json_num(line, "items", x)) { result.nitem = (uint64_t)x; }
+    if (find_json_num(line, "samples", x)) { result.nsample = (uint32_t)x; }
+    if (find_json_num(line, "iterations", x)) { result.niter = (uint64_t)x; }
+    find_json_num(line, "min_ns", result.min_ns);
+    find_json_num(line, "median_ns", result.median_ns);
+    find_json_num(line, "mean_ns", result.mean_ns);
+    find_json_num(line, "stddev_ns", result.stddev_ns);
+    find_json_num(line, "ir_bytes", result.nbyte_alloc);
+    out.emplace_back(std::move(result));
+  }
+  return out;
+}
+
+std::string compare_bench_results(
+  const std::vector<BenchResult>& baseline,
+  const std::vector<BenchResult>& results,
+  double max_regression,
+  size_t& nregress
+) {
+  std::map<std::string, const BenchResult*> name2baseline;
+  for (const auto& result : baseline) {
+    name2baseline[result.name] = &result;
+  }
+
+  size_t name_width = 9;
+  for (const auto& result : results) {
+    name_width = std::max(name_width, result.name.size());
+  }
+
+  std::stringstream ss;
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "%-*s %14s %14s %9s\n", (int)name_width,
+    "benchmark", "baseline (us)", "current (us)", "change");
+  ss << buf;
+
+  nregress = 0;
+  for (const auto& result : results) {
+    auto it = name2baseline.find(result.name);
+    if (it == name2baseline.end() || it->second->median_ns <= 0.0) {
+      std::snprintf(buf, sizeof(buf), "%-*s %14s %14.3f %9s\n",
+        (int)name_width, result.name.c_str(), "-", result.median_ns * 1e-3,
+        "new");
+      ss << buf;
+      continue;
+    }
+    // Units might have changed between the runs; compare by time per item if
+    // possible.
+    const BenchResult& base = *it->second;
+    double base_ns = base.median_ns;
+    double cur_ns = result.median_ns;
+    if (base.nitem != 0 && result.nitem != 0 && base.unit == result.unit) {
+      base_ns /= base.nitem;
+      cur_ns /= result.nitem;
+    }
+    double change = cur_ns / base_ns - 1.0;
+    bool is_regress = change > max_regression;
+    if (is_regress) { ++nregress; }
+    std::snprintf(buf, sizeof(buf), "%-*s %14.3f %14.3f %+8.1f%%%s\n",
+      (int)name_width, result.name.c_str(), base.median_ns * 1e-3,
+      result.median_ns * 1e-3, change * 100.0, is_regress ? " REGRESSED" : "");
+    ss << buf;
+  }
+  return ss.str();
+}
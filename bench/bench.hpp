@@ -0,0 +1,81 @@
+// Microbenchmark harness.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchConfig {
+  // Samples discarded before measurement.
+  uint32_t nwarmup = 1;
+  uint32_t nsample = 10;
+  // Minimal duration of a sample. A benchmark without setup is repeated
+  // within a sample until the duration is reached, so that very short
+  // benchmarks aren't dominated by the clock resolution.
+  uint64_t min_sample_ns = 1000000;
+  // Only benchmarks whose names contain any of the substrings are run. All
+  // benchmarks are run if it's empty.
+  std::vector<std::string> filters;
+};
+
+// Timings of a benchmark, per iteration.
+struct BenchResult {
+  std::string name;
+  // What the benchmark processes, e.g., `instr` or `node`.
+  std::string unit;
+  // Number of units processed in an iteration.
+  uint64_t nitem;
+  uint32_t nsample;
+  // Number of iterations in a sample.
+  uint64_t niter;
+  double min_ns;
+  double median_ns;
+  double mean_ns;
+  double stddev_ns;
+  // Bytes of IR nodes allocated by an iteration, on average.
+  double nbyte_alloc;
+
+  // Units processed per second at the median iteration time.
+  inline double throughput() const {
+    return median_ns > 0.0 ? nitem * 1e9 / median_ns : 0.0;
+  }
+};
+
+struct BenchSuite {
+  BenchConfig cfg;
+  std::vector<BenchResult> results;
+
+  inline BenchSuite(const BenchConfig& cfg) : cfg(cfg), results() {}
+
+  bool is_selected(const std::string& name) const;
+  // Measure `f`, which processes `nitem` units of `unit` in each call. If
+  // `setup` is given, it's called before every call of `f` out of the measured
+  // duration, e.g., to rebuild the IR a pass mutates in place. Nothing is run
+  // if the benchmark is filtered out.
+  void run(
+    const std::string& name,
+    const char* unit,
+    uint64_t nitem,
+    const std::function<void()>& f,
+    const std::function<void()>& setup = nullptr
+  );
+};
+
+// Human-readable table of `results`.
+std::string format_bench_results_table(const std::vector<BenchResult>& results);
+// JSON document of `results`, one result per line.
+std::string format_bench_results_json(const std::vector<BenchResult>& results);
+// Parse results written by `format_bench_results_json`.
+std::vector<BenchResult> parse_bench_results_json(const std::string& json);
+
+// Compare the median times of `results` to those of `baseline` of the same
+// names. Returns a human-readable report; `nregress` is set to the number of
+// benchmarks slower than the baseline by more than `max_regression`, e.g.,
+// `0.1` for 10%.
+std::string compare_bench_results(
+  const std::vector<BenchResult>& baseline,
+  const std::vector<BenchResult>& results,
+  double max_regression,
+  size_t& nregress
+);
@@ -0,0 +1,604 @@
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "gft/log.hpp"
+#include "gft/args.hpp"
+#include "gft/util.hpp"
+#include "spv/binary.hpp"
+#include "spv/abstr.hpp"
+#include "spv/instr.hpp"
+#include "spv/ast.hpp"
+#include "node/arena.hpp"
+#include "node/gen/expr-pool.hpp"
+#include "visitor/visitor.hpp"
+#include "visitor/util.hpp"
+#include "pass/pass.hpp"
+#include "util/arg-parsers.hpp"
+#include "util/fs.hpp"
+#include "util/log-cb.hpp"
+#include "bench.hpp"
+#include "synth-ir.hpp"
+#include "synth-spv.hpp"
+
+using namespace liong;
+
+static const char* APP_NAME = "cspv-bench";
+static const char* APP_DESC = "Microbenchmarks of cspv processing stages and "
+  "passes.";
+
+struct BenchAppConfig {
+  // Directories of `.spv` modules, or module paths; `tests` if none is given.
+  std::vector<std::string> corpus_paths = {};
+  std::vector<std::string> filters = {};
+  uint32_t nsample = 10;
+  uint32_t min_sample_us = 1000;
+  uint32_t synth_nstmt = 1024;
+  uint32_t synth_expr_depth = 16;
+  uint32_t synth_nvar = 8;
+  // Parameters of the synthetic SPIR-V module; `nvar` is shared with the
+  // synthetic IR.
+  SynthSpirvConfig synth_spv_cfg = {};
+  // Sweeps of synthetic SPIR-V parameters, e.g., `loop-depth=1,2,4,8`.
+  std::vector<std::string> synth_sweeps = {};
+  std::string synth_spv_dir = "";
+  std::string json_path = "";
+  std::string baseline_path = "";
+  uint32_t max_regression_percent = 10;
+  bool verbose = false;
+} CFG;
+
+void initialize(int argc, const char** argv) {
+  args::init_arg_parse(APP_NAME, APP_DESC);
+  args::reg_arg<args::SwitchParser>("-v", "--verbose", CFG.verbose,
+    "Produce extra amount of logs for debugging.");
+  args::reg_arg<StringListParser>("-c", "--corpus", CFG.corpus_paths,
+    "Directory searched recursively for `.spv` modules, or path to a module. "
+    "Can be given more than once. Defaults to `tests`.");
+  args::reg_arg<StringListParser>("-f", "--filter", CFG.filters,
+    "Only run benchmarks whose names contain the string. Can be given more "
+    "than once.");
+  args::reg_arg<CountParser>("-n", "--samples", CFG.nsample,
+    "Number of measured samples of each benchmark. Defaults to 10.");
+  args::reg_arg<CountParser>("", "--min-sample-us", CFG.min_sample_us,
+    "Minimal duration of a sample in microseconds; short benchmarks are "
+    "repeated within a sample. Defaults to 1000.");
+  args::reg_arg<CountParser>("", "--synth-nstmt", CFG.synth_nstmt,
+    "Number of statements in the synthetic IR. Defaults to 1024.");
+  args::reg_arg<CountParser>("", "--synth-expr-depth", CFG.synth_expr_depth,
+    "Number of binary operations in each expression of the synthetic IR. "
+    "Defaults to 16.");
+  args::reg_arg<CountParser>("", "--synth-nvar", CFG.synth_nvar,
+    "Number of function variables in the synthetic IR and SPIR-V. Defaults "
+    "to 8.");
+  args::reg_arg<CountParser>("", "--synth-nentry-point",
+    CFG.synth_spv_cfg.nentry_point,
+    "Number of entry points in the synthetic SPIR-V. Defaults to 1.");
+  args::reg_arg<CountParser>("", "--synth-nregion", CFG.synth_spv_cfg.nregion,
+    "Number of loop-nest regions in each synthetic SPIR-V entry point. "
+    "Defaults to 16.");
+  args::reg_arg<CountParser>("", "--synth-loop-depth",
+    CFG.synth_spv_cfg.loop_depth,
+    "Loop nesting depth of the synthetic SPIR-V. Defaults to 2.");
+  args::reg_arg<CountParser>("", "--synth-branch-fanout",
+    CFG.synth_spv_cfg.branch_fanout,
+    "Number of arms of the if-else-if chains in the synthetic SPIR-V. "
+    "Defaults to 2.");
+  args::reg_arg<CountParser>("", "--synth-spv-expr-depth",
+    CFG.synth_spv_cfg.expr_depth,
+    "Number of binary operations in each expression of the synthetic SPIR-V. "
+    "Defaults to 6.");
+  args::reg_arg<CountParser>("", "--synth-ac-depth", CFG.synth_spv_cfg.ac_depth,
+    "Number of indices of access chains in the synthetic SPIR-V. Defaults to "
+    "2.");
+  args::reg_arg<StringListParser>("", "--synth-sweep", CFG.synth_sweeps,
+    "Benchmark a synthetic SPIR-V module for each of the comma-separated "
+    "values of a parameter, e.g., `loop-depth=1,2,4,8`, with the others as "
+    "configured. Parameters are `entry-points`, `regions`, `loop-depth`, "
+    "`branch-fanout`, `vars`, `expr-depth` and `ac-depth`. Can be given more "
+    "than once.");
+  args::reg_arg<args::StringParser>("", "--synth-spv-dir", CFG.synth_spv_dir,
+    "Directory to save the synthetic SPIR-V modules in, e.g., to be fed to "
+    "cspv.");
+  args::reg_arg<args::StringParser>("", "--json", CFG.json_path,
+    "Path to save the results as JSON, e.g., as a baseline of later runs.");
+  args::reg_arg<args::StringParser>("", "--baseline", CFG.baseline_path,
+    "Path to results saved by `--json` to compare with. Exits with 1 if any "
+    "benchmark regressed.");
+  args::reg_arg<CountParser>("", "--max-regression", CFG.max_regression_percent,
+    "Slowdown in percent over the baseline regarded as a regression. "
+    "Defaults to 10.");
+  args::parse_args(argc, argv);
+  CFG.synth_spv_cfg.nvar = CFG.synth_nvar;
+
+  log::set_log_callback(log_cb);
+  log::LogLevel level = CFG.verbose ?
+    log::LogLevel::L_LOG_LEVEL_DEBUG : log::LogLevel::L_LOG_LEVEL_INFO;
+  log::set_log_filter_level(level);
+}
+
+// Results are written here so that the measured work is not optimized away.
+static volatile uint64_t SINK = 0;
+
+// A module of the corpus, parsed once for the benchmarks of later stages.
+struct CorpusModule {
+  // File path, or the name of a synthetic module.
+  std::string path;
+  bool is_synth;
+  SpirvBinary spv;
+  uint64_t ninstr;
+  // Module-scope nodes; frozen as the app does.
+  std::unique_ptr<IrArena> mod_arena;
+  std::unique_ptr<SpirvModule> mod;
+};
+
+// IR of the entry points of a module, in an arena of its own.
+struct EntryPointIr {
+  std::unique_ptr<IrArena> arena;
+  std::vector<NodeRef> roots;
+
+  // Drop the current IR and extract all entry points of `m` again.
+  void reset(const CorpusModule& m) {
+    // Arena-backed references must be dropped before their arena.
+    roots.clear();
+    arena = std::make_unique<IrArena>(m.mod_arena.get());
+    IrArenaScope arena_scope(*arena);
+    for (const auto& pair : extract_entry_points(*m.mod)) {
+      roots.emplace_back(pair.second);
+    }
+  }
+  uint64_t count_nodes() const {
+    uint64_t out = 0;
+    for (const auto& root : roots) { out += ::count_nodes(root); }
+    return out;
+  }
+};
+
+std::vector<std::string> collect_corpus_paths() {
+  namespace fs = std::filesystem;
+  std::vector<std::string> corpus_paths = CFG.corpus_paths;
+  if (corpus_paths.empty()) {
+    corpus_paths.emplace_back("tests");
+  }
+
+  std::vector<std::string> out;
+  for (const auto& corpus_path : corpus_paths) {
+    if (!fs::is_directory(corpus_path)) {
+      out.emplace_back(corpus_path);
+      continue;
+    }
+    std::vector<std::string> paths = collect_spirv_paths(corpus_path);
+    out.insert(out.end(), paths.begin(), paths.end());
+  }
+  return out;
+}
+
+uint64_t count_instrs(const SpirvBinary& spv) {
+  uint64_t out = 0;
+  // Skip the header.
+  for (
+    InstructionRef cur = spv.beg + 5 < spv.end ? spv.beg + 5 : nullptr;
+    cur != nullptr;
+    cur = cur.next(spv.end)
+  ) {
+    ++out;
+  }
+  return out;
+}
+
+CorpusModule make_corpus_module(
+  const std::string& path,
+  bool is_synth,
+  SpirvBinary&& spv
+) {
+  CorpusModule out {};
+  out.path = path;
+  out.is_synth = is_synth;
+  out.spv = std::move(spv);
+  out.ninstr = count_instrs(out.spv);
+  out.mod_arena = std::make_unique<IrArena>();
+  {
+    IrArenaScope arena_scope(*out.mod_arena);
+    out.mod = std::make_unique<SpirvModule>(
+      parse_spirv_module(scan_spirv(out.spv)));
+  }
+  out.mod_arena->freeze();
+  return out;
+}
+CorpusModule load_corpus_module(const std::string& path) {
+  return make_corpus_module(path, false, map_spirv_binary(path.c_str()));
+}
+
+static uint32_t& get_synth_spirv_param(
+  SynthSpirvConfig& cfg,
+  const std::string& name
+) {
+  if (name == "entry-points") { return cfg.nentry_point; }
+  if (name == "regions") { return cfg.nregion; }
+  if (name == "loop-depth") { return cfg.loop_depth; }
+  if (name == "branch-fanout") { return cfg.branch_fanout; }
+  if (name == "vars") { return cfg.nvar; }
+  if (name == "expr-depth") { return cfg.expr_depth; }
+  if (name == "ac-depth") { return cfg.ac_depth; }
+  panic("unknown synthetic spirv parameter '", name, "'");
+  return cfg.nregion;
+}
+
+// Configs of the synthetic modules to benchmark. Each sweep varies one
+// parameter of the base config.
+std::vector<SynthSpirvConfig> collect_synth_spirv_cfgs() {
+  std::vector<SynthSpirvConfig> out;
+  if (CFG.synth_sweeps.empty()) {
+    out.emplace_back(CFG.synth_spv_cfg);
+    return out;
+  }
+  for (const auto& sweep : CFG.synth_sweeps) {
+    size_t i = sweep.find('=');
+    assert(i != std::string::npos, "synthetic spirv sweep '", sweep, "' is not "
+      "in the form of `param=v1,v2,...`");
+    std::string name = sweep.substr(0, i);
+    size_t beg = i + 1;
+    for (;;) {
+      size_t end = sweep.find(',', beg);
+      std::string lit = sweep.substr(beg, end - beg);
+      SynthSpirvConfig cfg = CFG.synth_spv_cfg;
+      const char* lits[] = { lit.c_str() };
+      bool is_valid = CountParser::parse(lits, &get_synth_spirv_param(cfg, name));
+      assert(is_valid, "invalid value '", lit, "' of synthetic spirv "
+        "parameter '", name, "'");
+      out.emplace_back(cfg);
+      if (end == std::string::npos) { break; }
+      beg = end + 1;
+    }
+  }
+  return out;
+}
+
+CorpusModule make_synth_module(const SynthSpirvConfig& cfg) {
+  std::string name = get_synth_spirv_name(cfg);
+  std::vector<uint32_t> words = make_synth_spirv(cfg);
+  if (!CFG.synth_spv_dir.empty()) {
+    namespace fs = std::filesystem;
+    fs::create_directories(CFG.synth_spv_dir);
+    std::string path = (fs::path(CFG.synth_spv_dir) / (name + ".spv"))
+      .generic_string();
+    util::save_file(path.c_str(), words.data(), words.size() * sizeof(uint32_t));
+    log::info("saved synthetic module to '", path, "'");
+  }
+  return make_corpus_module(name, true, make_spirv_binary(std::move(words)));
+}
+
+static const PassDispatch PASS_DISPATCHES[] = {
+  L_PASS_DISPATCH_VIRTUAL,
+  L_PASS_DISPATCH_STATIC,
+};
+static const char* get_pass_dispatch_name(PassDispatch dispatch) {
+  switch (dispatch) {
+  case L_PASS_DISPATCH_VIRTUAL: return "virtual";
+  case L_PASS_DISPATCH_STATIC: return "static";
+  }
+  unreachable();
+}
+
+void bench_module(BenchSuite& suite, const CorpusModule& m) {
+  if (!m.is_synth) {
+    suite.run("load_spv/" + m.path, "instr", m.ninstr, [&]() {
+      SpirvBinary spv = map_spirv_binary(m.path.c_str());
+      SINK = SINK + spv.nword();
+    });
+  }
+  suite.run("scan_spirv/" + m.path, "instr", m.ninstr, [&]() {
+    SpirvAbstract abstr = scan_spirv(m.spv);
+    SINK = SINK + abstr.nid_occupied;
+  });
+
+  {
+    SpirvAbstract abstr;
+    std::unique_ptr<SpirvModule> mod;
+    std::unique_ptr<IrArena> arena;
+    suite.run("parse_spirv_module/" + m.path, "instr", m.ninstr, [&]() {
+      IrArenaScope arena_scope(*arena);
+      mod = std::make_unique<SpirvModule>(parse_spirv_module(std::move(abstr)));
+    }, [&]() {
+      mod.reset();
+      arena = std::make_unique<IrArena>();
+      abstr = scan_spirv(m.spv);
+    });
+    mod.reset();
+  }
+
+  EntryPointIr ir;
+  ir.reset(m);
+  uint64_t nnode = ir.count_nodes();
+
+  {
+    std::unique_ptr<IrArena> arena;
+    suite.run("extract_entry_points/" + m.path, "node", nnode, [&]() {
+      IrArenaScope arena_scope(*arena);
+      SINK = SINK + extract_entry_points(*m.mod).size();
+    }, [&]() {
+      arena = std::make_unique<IrArena>(m.mod_arena.get());
+    });
+  }
+
+  for (const auto& pass_name : list_passes()) {
+    const Pass* pass = get_pass(pass_name);
+    // Prerequisites are applied out of the measured duration.
+    auto setup = [&]() {
+      ir.reset(m);
+      IrArenaScope arena_scope(*ir.arena);
+      for (auto& root : ir.roots) {
+        PassManager pass_mgr;
+        for (const auto& dep : pass->deps) {
+          pass_mgr.apply(dep, root);
+        }
+      }
+    };
+    setup();
+    uint64_t nnode_in = ir.count_nodes();
+    suite.run("pass/" + pass_name + "/" + m.path, "node", nnode_in, [&]() {
+      IrArenaScope arena_scope(*ir.arena);
+      for (auto& root : ir.roots) {
+        SINK = SINK + pass->apply(root);
+      }
+    }, setup);
+
+    // Virtual against static dispatch of the pass's mutator, on synthetic
+    // modules large enough to tell them apart.
+    if (!m.is_synth) { continue; }
+    for (PassDispatch dispatch : PASS_DISPATCHES) {
+      suite.run("pass/" + pass_name + "/" + get_pass_dispatch_name(dispatch) +
+        "/" + m.path, "node", nnode_in, [&]() {
+        IrArenaScope arena_scope(*ir.arena);
+        for (auto& root : ir.roots) {
+          SINK = SINK + pass->apply_with_dispatch(root, dispatch);
+        }
+      }, setup);
+    }
+  }
+
+  ir.reset(m);
+  suite.run("dbg_print/" + m.path, "node", nnode, [&]() {
+    for (const auto& root : ir.roots) {
+      SINK = SINK + dbg_print(root).size();
+    }
+  });
+}
+
+// Opcode properties from the precomputed table against the switch in
+// `spv::HasResultAndType` the table is derived from.
+void bench_opcode_decode(
+  BenchSuite& suite,
+  const std::vector<CorpusModule>& modules
+) {
+  std::vector<spv::Op> ops;
+  for (const auto& m : modules) {
+    for (
+      InstructionRef cur = m.spv.beg + 5 < m.spv.end ? m.spv.beg + 5 : nullptr;
+      cur != nullptr;
+      cur = cur.next(m.spv.end)
+    ) {
+      ops.emplace_back(cur.op());
+    }
+  }
+  if (ops.empty()) { return; }
+
+  suite.run("opcode-decode/table", "instr", ops.size(), [&]() {
+    uint64_t acc = 0;
+    for (spv::Op op : ops) { acc += OP_PROPERTY_TABLE[op]; }
+    SINK = SINK + acc;
+  });
+  suite.run("opcode-decode/HasResultAndType", "instr", ops.size(), [&]() {
+    uint64_t acc = 0;
+    for (spv::Op op : ops) {
+      bool has_result_id = false;
+      bool has_result_ty_id = false;
+      spv::HasResultAndType(op, &has_result_id, &has_result_ty_id);
+      acc += has_result_id + has_result_ty_id * 2;
+    }
+    SINK = SINK + acc;
+  });
+}
+
+// The default visitors don't descend into stored values, while the mutators
+// do; the counters visit them as well so that both walk the same nodes.
+struct NodeCounter : public Visitor {
+  uint64_t nnode = 0;
+  virtual void visit_stmt_(const StmtStoreRef& x) override final {
+    schedule_visit_(x->dst_ptr);
+    schedule_visit_(x->value);
+    Visitor::visit_stmt_(x);
+  }
+  virtual void post_visit_(const NodeRef& node) override final { ++nnode; }
+};
+struct StaticNodeCounter : public StaticVisitor<StaticNodeCounter> {
+  uint64_t nnode = 0;
+  using StaticVisitor<StaticNodeCounter>::visit_stmt_;
+  void visit_stmt_(const StmtStoreRef& x) {
+    schedule_visit_(x->dst_ptr);
+    schedule_visit_(x->value);
+    StaticVisitor<StaticNodeCounter>::visit_stmt_(x);
+  }
+  void post_visit_(const NodeRef& node) { ++nnode; }
+};
+struct IdentityMutator : public Mutator {};
+struct StaticIdentityMutator : public StaticMutator<StaticIdentityMutator> {};
+
+void invalidate_structured_hashes(const NodeRef& root) {
+  NodeDrain drain;
+  drain.push(root);
+  while (!drain.nodes.empty()) {
+    NodeRef node = std::move(drain.nodes.back());
+    drain.nodes.pop_back();
+    if (node == nullptr) { continue; }
+    node->invalidate_structured_hash();
+    node->collect_children(&drain);
+  }
+}
+
+// Benchmarks on a large synthetic tree, beyond the size of any module in the
+// test corpus.
+void bench_synth_ir(BenchSuite& suite) {
+  SynthIrConfig synth_cfg {};
+  synth_cfg.nstmt = CFG.synth_nstmt;
+  synth_cfg.expr_depth = CFG.synth_expr_depth;
+  synth_cfg.nvar = CFG.synth_nvar;
+
+  std::unique_ptr<IrArena> arena;
+  NodeRef root;
+  auto setup = [&]() {
+    root = nullptr;
+    arena = std::make_unique<IrArena>();
+    IrArenaScope arena_scope(*arena);
+    root = make_synth_int_expr_block(synth_cfg);
+  };
+  setup();
+  uint64_t nnode = count_nodes(root);
+  std::string suffix = "/synth-ir-" + std::to_string(synth_cfg.nstmt) + "x" +
+    std::to_string(synth_cfg.expr_depth);
+
+  suite.run("dbg_print" + suffix, "node", nnode, [&]() {
+    SINK = SINK + dbg_print(root).size();
+  });
+
+  // Visitors and mutators doing nothing but the traversal, so that the
+  // difference is the cost of dispatch.
+  suite.run("visit/virtual" + suffix, "node", nnode, [&]() {
+    NodeCounter v;
+    v.visit(root);
+    SINK = SINK + v.nnode;
+  });
+  suite.run("visit/static" + suffix, "node", nnode, [&]() {
+    StaticNodeCounter v;
+    v.visit(root);
+    SINK = SINK + v.nnode;
+  });
+  suite.run("mutate/virtual" + suffix, "node", nnode, [&]() {
+    IrArenaScope arena_scope(*arena);
+    IdentityMutator m;
+    root = m.mutate(root);
+  });
+  suite.run("mutate/static" + suffix, "node", nnode, [&]() {
+    IrArenaScope arena_scope(*arena);
+    StaticIdentityMutator m;
+    root = m.mutate(root);
+  });
+
+  // Structural hashes of all expressions by a linear scan of the flat pool,
+  // against a traversal of the trees with caches dropped.
+  {
+    setup();
+    std::vector<ExprRef> exprs;
+    for (const auto& stmt : root.as<StmtBlock>()->stmts) {
+      exprs.emplace_back(stmt.as<StmtStore>()->value);
+    }
+    ExprPool pool;
+    for (const auto& expr : exprs) {
+      ExprIndex i = pool.push(expr);
+      // An expression must come out of the pool as it went in.
+      assert(pool.to_tree(i)->structured_hash() == expr->structured_hash(),
+        "pooled expression doesn't round-trip");
+    }
+
+    suite.run("expr-hash/pool-scan" + suffix, "expr", pool.size(), [&]() {
+      SINK = SINK + pool.compute_structured_hashes().back();
+    });
+    suite.run("expr-hash/tree" + suffix, "expr", pool.size(), [&]() {
+      uint64_t acc = 0;
+      for (const auto& expr : exprs) { acc ^= expr->structured_hash(); }
+      SINK = SINK + acc;
+    }, [&]() {
+      invalidate_structured_hashes(root);
+    });
+  }
+
+  // The synthetic block is straight-line integer arithmetic, so only the
+  // passes working on expressions are meaningful here. `ctrlflow-stmt2expr`
+  // in particular inlines every variable into its uses and blows up.
+  static const char* SYNTH_PASS_NAMES[] = {
+    "graph-normalization",
+    "int-expr-simplification",
+  };
+  for (const char* pass_name : SYNTH_PASS_NAMES) {
+    const Pass* pass = get_pass(pass_name);
+    auto setup_pass = [&]() {
+      setup();
+      IrArenaScope arena_scope(*arena);
+      PassManager pass_mgr;
+      for (const auto& dep : pass->deps) {
+        pass_mgr.apply(dep, root);
+      }
+    };
+    setup_pass();
+    uint64_t nnode_in = count_nodes(root);
+    suite.run(std::string("pass/") + pass_name + suffix, "node", nnode_in, [&]() {
+      IrArenaScope arena_scope(*arena);
+      SINK = SINK + pass->apply(root);
+    }, setup_pass);
+    for (PassDispatch dispatch : PASS_DISPATCHES) {
+      suite.run(std::string("pass/") + pass_name + "/" +
+        get_pass_dispatch_name(dispatch) + suffix, "node", nnode_in, [&]() {
+        IrArenaScope arena_scope(*arena);
+        SINK = SINK + pass->apply_with_dispatch(root, dispatch);
+      }, setup_pass);
+    }
+  }
+
+  root = nullptr;
+}
+
+int guarded_main() {
+  BenchConfig bench_cfg {};
+  bench_cfg.nsample = std::max<uint32_t>(CFG.nsample, 1);
+  bench_cfg.min_sample_ns = (uint64_t)CFG.min_sample_us * 1000;
+  bench_cfg.filters = CFG.filters;
+  BenchSuite suite(bench_cfg);
+
+  std::vector<CorpusModule> modules;
+  for (const auto& path : collect_corpus_paths()) {
+    modules.emplace_back(load_corpus_module(path));
+  }
+  log::info("benchmarking ", modules.size(), " modules");
+
+  for (const auto& m : modules) {
+    bench_module(suite, m);
+  }
+  bench_opcode_decode(suite, modules);
+  bench_synth_ir(suite);
+
+  // Synthetic modules are generated and benchmarked one at a time so that
+  // large sweeps don't hold all of them in memory.
+  for (const auto& synth_cfg : collect_synth_spirv_cfgs()) {
+    CorpusModule m = make_synth_module(synth_cfg);
+    log::info("benchmarking synthetic module '", m.path, "' of ", m.ninstr,
+      " instructions");
+    bench_module(suite, m);
+  }
+
+  log::info("results:\n", format_bench_results_table(suite.results));
+  if (!CFG.json_path.empty()) {
+    util::save_text(CFG.json_path.c_str(),
+      format_bench_results_json(suite.results));
+  }
+
+  if (!CFG.baseline_path.empty()) {
+    std::vector<BenchResult> baseline =
+      parse_bench_results_json(util::load_text(CFG.baseline_path.c_str()));
+    size_t nregress = 0;
+    std::string report = compare_bench_results(baseline, suite.results,
+      CFG.max_regression_percent * 0.01, nregress);
+    log::info("compared with baseline '", CFG.baseline_path, "':\n", report);
+    if (nregress > 0) {
+      log::error(nregress, " benchmarks regressed by more than ",
+        CFG.max_regression_percent, "%");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, const char** argv) {
+  initialize(argc, argv);
+  return guarded_main();
+}
@@ -0,0 +1,75 @@
+#include <vector>
+#include "node/gen/ty.hpp"
+#include "node/gen/mem.hpp"
+#include "node/gen/expr.hpp"
+#include "node/gen/stmt.hpp"
+#include "node/intern.hpp"
+#include "synth-ir.hpp"
+
+using namespace liong;
+
+struct SynthIrBuilder {
+  const SynthIrConfig& cfg;
+  uint64_t rand_state;
+  TypeRef ty;
+  std::vector<MemoryRef> vars;
+
+  SynthIrBuilder(const SynthIrConfig& cfg) :
+    cfg(cfg),
+    rand_state(cfg.seed * 6364136223846793005ull + 1442695040888963407ull),
+    ty(intern_ty(new TypeInt(32, true)))
+  {
+    assert(cfg.nvar > 0, "synthetic ir needs at least one variable");
+    NodeHandleAllocator handle_alloc;
+    for (uint32_t i = 0; i < cfg.nvar; ++i) {
+      vars.emplace_back(new MemoryFunctionVariable(ty, AccessChain(),
+        handle_alloc.alloc()));
+    }
+  }
+
+  // PCG-like generator; statistical quality doesn't matter here but
+  // determinism across platforms does.
+  uint32_t rand(uint32_t n) {
+    rand_state = rand_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rand_state >> 33) % n;
+  }
+
+  ExprRef make_leaf() {
+    if (rand(2) == 0) {
+      return new ExprIntImm(ty, (int64_t)rand(16));
+    } else {
+      return new ExprLoad(ty, vars[rand((uint32_t)vars.size())]);
+    }
+  }
+  // Chain of `depth` operations, each with a leaf on either side, so the tree
+  // grows linearly with the depth.
+  ExprRef make_expr(uint32_t depth) {
+    ExprRef out = make_leaf();
+    for (uint32_t i = 0; i < depth; ++i) {
+      ExprRef a = std::move(out);
+      ExprRef b = make_leaf();
+      if (rand(2) == 0) { std::swap(a, b); }
+      switch (rand(3)) {
+      case 0: out = new ExprAdd(ty, a, b); break;
+      case 1: out = new ExprSub(ty, a, b); break;
+      default: out = new ExprMul(ty, a, b); break;
+      }
+    }
+    return out;
+  }
+
+  StmtRef build() {
+    NodeList<StmtRef> stmts;
+    stmts.reserve(cfg.nstmt);
+    for (uint32_t i = 0; i < cfg.nstmt; ++i) {
+      const MemoryRef& dst = vars[rand((uint32_t)vars.size())];
+      stmts.emplace_back(new StmtStore(dst, make_expr(cfg.expr_depth)));
+    }
+    return new StmtBlock(std::move(stmts));
+  }
+};
+
+StmtRef make_synth_int_expr_block(const SynthIrConfig& cfg) {
+  SynthIrBuilder builder(cfg);
+  return builder.build();
+}
@@ -0,0 +1,22 @@
+// Synthetic IR trees for benchmarks.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include "node/reg.hpp"
+
+struct SynthIrConfig {
+  // Number of statements in the block.
+  uint32_t nstmt = 1024;
+  // Number of binary operations in the expression stored by each statement.
+  uint32_t expr_depth = 16;
+  // Number of distinct function variables loaded from and stored to.
+  uint32_t nvar = 8;
+  uint32_t seed = 1;
+};
+
+// A block of stores of random integer expressions to function variables. The
+// expressions are built of additions, subtractions and multiplications of
+// variable loads and constants, with constants on either side of an operator,
+// so that `graph-normalization` and `int-expr-simplification` both have work
+// to do. The same config always produces the same tree.
+StmtRef make_synth_int_expr_block(const SynthIrConfig& cfg);
@@ -0,0 +1,345 @@
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include "gft/assert.hpp"
+#include "spirv/unified1/spirv.hpp11"
+#include "synth-spv.hpp"
+
+using namespace liong;
+
+// Number of distinct integer constants; constant `i` has value `i`.
+static const uint32_t NCONST = 16;
+
+// Instructions are written to separate streams of module sections, which are
+// concatenated at last because IDs are allocated on the fly.
+struct SynthSpirvBuilder {
+  const SynthSpirvConfig& cfg;
+  uint64_t rand_state;
+  uint32_t bound;
+
+  std::vector<uint32_t> preamble;
+  std::vector<uint32_t> annotations;
+  std::vector<uint32_t> declrs;
+  std::vector<uint32_t> funcs;
+
+  uint32_t void_ty;
+  uint32_t func_ty;
+  uint32_t int_ty;
+  uint32_t bool_ty;
+  uint32_t buf_ptr_ty;
+  uint32_t buf_int_ptr_ty;
+  uint32_t func_int_ptr_ty;
+  std::vector<uint32_t> consts;
+  uint32_t buf_var;
+
+  // Objects of the function being built.
+  std::vector<uint32_t> vars;
+  std::vector<uint32_t> loop_counters;
+
+  SynthSpirvBuilder(const SynthSpirvConfig& cfg) :
+    cfg(cfg),
+    rand_state(cfg.seed * 6364136223846793005ull + 1442695040888963407ull),
+    bound(1)
+  {
+    assert(cfg.nentry_point > 0, "synthetic spirv needs at least one entry "
+      "point");
+    assert(cfg.nvar > 0, "synthetic spirv needs at least one variable");
+    assert(cfg.ac_depth > 0, "access chains need at least one index");
+  }
+
+  // Same generator as the synthetic IR.
+  uint32_t rand(uint32_t n) {
+    rand_state = rand_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rand_state >> 33) % n;
+  }
+
+  uint32_t alloc_id() {
+    return bound++;
+  }
+  static void emit(
+    std::vector<uint32_t>& dst,
+    spv::Op op,
+    std::initializer_list<uint32_t> operands
+  ) {
+    dst.emplace_back(((uint32_t)(operands.size() + 1) << 16) | (uint32_t)op);
+    dst.insert(dst.end(), operands.begin(), operands.end());
+  }
+  // Null-terminated string literal padded to whole words.
+  static std::vector<uint32_t> make_str(const std::string& x) {
+    std::vector<uint32_t> out(x.size() / 4 + 1, 0);
+    std::memcpy(out.data(), x.data(), x.size());
+    return out;
+  }
+
+  void build_types() {
+    void_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypeVoid, { void_ty });
+    func_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypeFunction, { func_ty, void_ty });
+    int_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypeInt, { int_ty, 32, 1 });
+    bool_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypeBool, { bool_ty });
+
+    // The innermost struct has two integers; each outer level has an integer
+    // and the struct of the level below. The last index of a chain picks
+    // either integer of the innermost struct.
+    uint32_t struct_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypeStruct, { struct_ty, int_ty, int_ty });
+    emit(annotations, spv::Op::OpMemberDecorate,
+      { struct_ty, 0, (uint32_t)spv::Decoration::Offset, 0 });
+    emit(annotations, spv::Op::OpMemberDecorate,
+      { struct_ty, 1, (uint32_t)spv::Decoration::Offset, 4 });
+    for (uint32_t i = 1; i < cfg.ac_depth; ++i) {
+      uint32_t outer_ty = alloc_id();
+      emit(declrs, spv::Op::OpTypeStruct, { outer_ty, int_ty, struct_ty });
+      emit(annotations, spv::Op::OpMemberDecorate,
+        { outer_ty, 0, (uint32_t)spv::Decoration::Offset, 0 });
+      emit(annotations, spv::Op::OpMemberDecorate,
+        { outer_ty, 1, (uint32_t)spv::Decoration::Offset, 4 });
+      struct_ty = outer_ty;
+    }
+    emit(annotations, spv::Op::OpDecorate,
+      { struct_ty, (uint32_t)spv::Decoration::BufferBlock });
+
+    buf_ptr_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypePointer,
+      { buf_ptr_ty, (uint32_t)spv::StorageClass::Uniform, struct_ty });
+    buf_int_ptr_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypePointer,
+      { buf_int_ptr_ty, (uint32_t)spv::StorageClass::Uniform, int_ty });
+    func_int_ptr_ty = alloc_id();
+    emit(declrs, spv::Op::OpTypePointer,
+      { func_int_ptr_ty, (uint32_t)spv::StorageClass::Function, int_ty });
+
+    for (uint32_t i = 0; i < NCONST; ++i) {
+      uint32_t id = alloc_id();
+      emit(declrs, spv::Op::OpConstant, { int_ty, id, i });
+      consts.emplace_back(id);
+    }
+
+    buf_var = alloc_id();
+    emit(declrs, spv::Op::OpVariable,
+      { buf_ptr_ty, buf_var, (uint32_t)spv::StorageClass::Uniform });
+    emit(annotations, spv::Op::OpDecorate,
+      { buf_var, (uint32_t)spv::Decoration::DescriptorSet, 0 });
+    emit(annotations, spv::Op::OpDecorate,
+      { buf_var, (uint32_t)spv::Decoration::Binding, 0 });
+  }
+
+  uint32_t make_label() {
+    uint32_t id = alloc_id();
+    emit(funcs, spv::Op::OpLabel, { id });
+    return id;
+  }
+
+  // Pointer to a random integer member of the innermost buffer struct.
+  uint32_t make_buf_ptr() {
+    uint32_t id = alloc_id();
+    funcs.emplace_back(((cfg.ac_depth + 4) << 16) |
+      (uint32_t)spv::Op::OpAccessChain);
+    funcs.emplace_back(buf_int_ptr_ty);
+    funcs.emplace_back(id);
+    funcs.emplace_back(buf_var);
+    for (uint32_t i = 1; i < cfg.ac_depth; ++i) {
+      funcs.emplace_back(consts[1]);
+    }
+    funcs.emplace_back(consts[rand(2)]);
+    return id;
+  }
+  uint32_t make_load(uint32_t ptr) {
+    uint32_t id = alloc_id();
+    emit(funcs, spv::Op::OpLoad, { int_ty, id, ptr });
+    return id;
+  }
+  uint32_t make_binary(spv::Op op, uint32_t ty, uint32_t a, uint32_t b) {
+    uint32_t id = alloc_id();
+    emit(funcs, op, { ty, id, a, b });
+    return id;
+  }
+
+  uint32_t make_leaf() {
+    switch (rand(4)) {
+    case 0: return consts[rand(NCONST)];
+    case 1: return make_load(make_buf_ptr());
+    default: return make_load(vars[rand((uint32_t)vars.size())]);
+    }
+  }
+  // Left-leaning chain of `depth` operations, like `a + b * c + d` parsed
+  // from GLSL, so the module grows linearly with the depth.
+  uint32_t make_expr(uint32_t depth) {
+    uint32_t out = make_leaf();
+    for (uint32_t i = 0; i < depth; ++i) {
+      spv::Op op = rand(2) == 0 ? spv::Op::OpIAdd : spv::Op::OpIMul;
+      out = make_binary(op, int_ty, out, make_leaf());
+    }
+    return out;
+  }
+  void make_store() {
+    uint32_t value = make_expr(cfg.expr_depth);
+    emit(funcs, spv::Op::OpStore, { vars[rand((uint32_t)vars.size())], value });
+  }
+
+  // If-else-if chain from arm `iarm` on, in the current block. The last arm
+  // is the else branch of the one before it.
+  void make_branch_chain(uint32_t iarm) {
+    uint32_t narm = cfg.branch_fanout;
+    if (iarm + 1 >= narm) {
+      make_store();
+      return;
+    }
+    uint32_t sel = make_load(make_buf_ptr());
+    uint32_t cond = make_binary(spv::Op::OpIEqual, bool_ty, sel,
+      consts[iarm % NCONST]);
+    uint32_t then_label = alloc_id();
+    uint32_t else_label = alloc_id();
+    uint32_t merge_label = alloc_id();
+    emit(funcs, spv::Op::OpSelectionMerge, { merge_label, 0 });
+    emit(funcs, spv::Op::OpBranchConditional,
+      { cond, then_label, else_label });
+
+    emit(funcs, spv::Op::OpLabel, { then_label });
+    make_store();
+    emit(funcs, spv::Op::OpBranch, { merge_label });
+
+    emit(funcs, spv::Op::OpLabel, { else_label });
+    make_branch_chain(iarm + 1);
+    emit(funcs, spv::Op::OpBranch, { merge_label });
+
+    emit(funcs, spv::Op::OpLabel, { merge_label });
+  }
+
+  // Loop nest from level `depth` on, in the current block. Loops count up to
+  // a buffer member like a GLSL `for` loop.
+  void make_region(uint32_t depth) {
+    if (depth >= cfg.loop_depth) {
+      make_branch_chain(0);
+      return;
+    }
+    uint32_t counter = loop_counters[depth];
+    uint32_t header_label = alloc_id();
+    uint32_t cond_label = alloc_id();
+    uint32_t body_label = alloc_id();
+    uint32_t continue_label = alloc_id();
+    uint32_t merge_label = alloc_id();
+
+    emit(funcs, spv::Op::OpStore, { counter, consts[0] });
+    emit(funcs, spv::Op::OpBranch, { header_label });
+
+    emit(funcs, spv::Op::OpLabel, { header_label });
+    emit(funcs, spv::Op::OpLoopMerge, { merge_label, continue_label, 0 });
+    emit(funcs, spv::Op::OpBranch, { cond_label });
+
+    emit(funcs, spv::Op::OpLabel, { cond_label });
+    uint32_t i = make_load(counter);
+    uint32_t n = make_load(make_buf_ptr());
+    uint32_t cond = make_binary(spv::Op::OpSLessThan, bool_ty, i, n);
+    emit(funcs, spv::Op::OpBranchConditional, { cond, body_label, merge_label });
+
+    emit(funcs, spv::Op::OpLabel, { body_label });
+    make_region(depth + 1);
+    emit(funcs, spv::Op::OpBranch, { continue_label });
+
+    emit(funcs, spv::Op::OpLabel, { continue_label });
+    uint32_t i2 = make_load(counter);
+    uint32_t i3 = make_binary(spv::Op::OpIAdd, int_ty, i2, consts[1]);
+    emit(funcs, spv::Op::OpStore, { counter, i3 });
+    emit(funcs, spv::Op::OpBranch, { header_label });
+
+    emit(funcs, spv::Op::OpLabel, { merge_label });
+  }
+
+  // Returns the ID of the entry point function.
+  uint32_t build_entry_point(uint32_t ientry_point) {
+    uint32_t func = alloc_id();
+    std::string name = "main";
+    if (ientry_point > 0) { name += std::to_string(ientry_point); }
+
+    std::vector<uint32_t> name_words = make_str(name);
+    preamble.emplace_back(((uint32_t)name_words.size() + 3) << 16 |
+      (uint32_t)spv::Op::OpEntryPoint);
+    preamble.emplace_back((uint32_t)spv::ExecutionModel::GLCompute);
+    preamble.emplace_back(func);
+    preamble.insert(preamble.end(), name_words.begin(), name_words.end());
+
+    emit(funcs, spv::Op::OpFunction,
+      { void_ty, func, (uint32_t)spv::FunctionControlMask::MaskNone, func_ty });
+    make_label();
+
+    // Function variables must lead the entry block.
+    vars.clear();
+    loop_counters.clear();
+    for (uint32_t i = 0; i < cfg.nvar; ++i) {
+      uint32_t id = alloc_id();
+      emit(funcs, spv::Op::OpVariable,
+        { func_int_ptr_ty, id, (uint32_t)spv::StorageClass::Function });
+      vars.emplace_back(id);
+    }
+    for (uint32_t i = 0; i < cfg.loop_depth; ++i) {
+      uint32_t id = alloc_id();
+      emit(funcs, spv::Op::OpVariable,
+        { func_int_ptr_ty, id, (uint32_t)spv::StorageClass::Function });
+      loop_counters.emplace_back(id);
+    }
+    for (uint32_t var : vars) {
+      emit(funcs, spv::Op::OpStore, { var, consts[rand(NCONST)] });
+    }
+
+    for (uint32_t i = 0; i < cfg.nregion; ++i) {
+      make_region(0);
+      // Write a result back so that the region has an observable effect.
+      uint32_t value = make_load(vars[rand((uint32_t)vars.size())]);
+      emit(funcs, spv::Op::OpStore, { make_buf_ptr(), value });
+    }
+
+    emit(funcs, spv::Op::OpReturn, {});
+    emit(funcs, spv::Op::OpFunctionEnd, {});
+    return func;
+  }
+  // Execution modes must follow all entry points.
+  void build_exec_modes(const std::vector<uint32_t>& entry_funcs) {
+    for (uint32_t func : entry_funcs) {
+      emit(preamble, spv::Op::OpExecutionMode,
+        { func, (uint32_t)spv::ExecutionMode::LocalSize, 1, 1, 1 });
+    }
+  }
+
+  std::vector<uint32_t> build() {
+    build_types();
+
+    std::vector<uint32_t> entry_funcs;
+    for (uint32_t i = 0; i < cfg.nentry_point; ++i) {
+      entry_funcs.emplace_back(build_entry_point(i));
+    }
+    build_exec_modes(entry_funcs);
+
+    std::vector<uint32_t> out {
+      spv::MagicNumber, 0x00010000, 0, bound, 0,
+    };
+    emit(out, spv::Op::OpCapability, { (uint32_t)spv::Capability::Shader });
+    emit(out, spv::Op::OpMemoryModel, {
+      (uint32_t)spv::AddressingModel::Logical,
+      (uint32_t)spv::MemoryModel::GLSL450,
+    });
+    out.insert(out.end(), preamble.begin(), preamble.end());
+    out.insert(out.end(), annotations.begin(), annotations.end());
+    out.insert(out.end(), declrs.begin(), declrs.end());
+    out.insert(out.end(), funcs.begin(), funcs.end());
+    return out;
+  }
+};
+
+std::string get_synth_spirv_name(const SynthSpirvConfig& cfg) {
+  return "synth-spv-ep" + std::to_string(cfg.nentry_point) +
+    "-r" + std::to_string(cfg.nregion) +
+    "-l" + std::to_string(cfg.loop_depth) +
+    "-b" + std::to_string(cfg.branch_fanout) +
+    "-v" + std::to_string(cfg.nvar) +
+    "-e" + std::to_string(cfg.expr_depth) +
+    "-ac" + std::to_string(cfg.ac_depth);
+}
+
+std::vector<uint32_t> make_synth_spirv(const SynthSpirvConfig& cfg) {
+  SynthSpirvBuilder builder(cfg);
+  return builder.build();
+}
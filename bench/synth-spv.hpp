@@ -0,0 +1,39 @@
+// Synthetic SPIR-V modules for scaling benchmarks.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SynthSpirvConfig {
+  // Number of entry points; each has a body of its own.
+  uint32_t nentry_point = 1;
+  // Number of regions in the body of each entry point. A region is a loop
+  // nest with a branch chain inside, so the module size grows linearly with
+  // it.
+  uint32_t nregion = 16;
+  // Number of loops nested in each region.
+  uint32_t loop_depth = 2;
+  // Number of arms of the if-else-if chain in the innermost loop body. There
+  // is no branch if it's less than 2.
+  uint32_t branch_fanout = 2;
+  // Number of integer function variables loaded from and stored to.
+  uint32_t nvar = 8;
+  // Number of binary operations in the expression stored in each branch arm.
+  uint32_t expr_depth = 6;
+  // Number of indices of each access chain into the storage buffer, which is
+  // a struct nested as deep as needed. At least 1.
+  uint32_t ac_depth = 2;
+  uint32_t seed = 1;
+};
+
+// Short name listing the parameters of `cfg`, e.g., to tell benchmarks apart
+// or to name a saved module.
+std::string get_synth_spirv_name(const SynthSpirvConfig& cfg);
+
+// Words of a compute-shader module in the shape glslang emits for GLSL:
+// structured loops over a counter bounded by a buffer member, if-else-if
+// chains testing another buffer member, and stores of integer arithmetic of
+// variable loads, buffer loads and constants. Only instructions cspv parses
+// are used. The same config always produces the same module.
+std::vector<uint32_t> make_synth_spirv(const SynthSpirvConfig& cfg);
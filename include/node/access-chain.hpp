@@ -0,0 +1,76 @@
+// Persistent access chains of memory nodes.
+// @PENGUINLIONG
+#pragma once
+#include "node/node.hpp"
+
+// A link of an access chain: one index on top of the chain of its parent.
+// Links are immutable once created and shared by all the chains extending
+// them, so a memory derived from another by `OpAccessChain` refers to the
+// chain of its base rather than copying it.
+struct AccessChainLink {
+  mutable NodeRefCount nref;
+  // Parent link, or null for the first index. Owned by this link.
+  const AccessChainLink* parent;
+  ExprRef idx;
+  // Number of indices from the root to this link, inclusive.
+  uint32_t depth;
+  // Lazily computed structural hash of the chain ending at this link, zero if
+  // not computed yet.
+  mutable uint64_t structured_hash_cache;
+};
+
+// An immutable list of access chain indices. Copying a chain or appending an
+// index to it is O(1); chains appended from the same base share its links.
+// Comparison of two chains stops at the first link they share, and hashes are
+// cached by the links so that a derived chain only hashes its own index.
+//
+// Like node hashes, link hashes are cached on first use. Indices are not
+// expected to be modified in place once they are in a chain.
+struct AccessChain {
+  const AccessChainLink* tail;
+
+  inline AccessChain() : tail(nullptr) {}
+  inline AccessChain(const AccessChain& b) : tail(b.tail) { inc_ref_(); }
+  inline AccessChain(AccessChain&& b) : tail(std::exchange(b.tail, nullptr)) {}
+  inline ~AccessChain() { release(tail); }
+
+  inline AccessChain& operator=(const AccessChain& b) {
+    const AccessChainLink* prev = std::exchange(tail, b.tail);
+    inc_ref_();
+    release(prev);
+    return *this;
+  }
+  inline AccessChain& operator=(AccessChain&& b) {
+    if (this != &b) {
+      release(std::exchange(tail, std::exchange(b.tail, nullptr)));
+    }
+    return *this;
+  }
+
+  // Chain of this chain's indices followed by `idx`.
+  AccessChain append(const ExprRef& idx) const;
+
+  inline size_t size() const { return tail == nullptr ? 0 : tail->depth; }
+  inline bool empty() const { return tail == nullptr; }
+  // The last index.
+  inline const ExprRef& back() const {
+    liong::assert(tail != nullptr, "access chain is empty");
+    return tail->idx;
+  }
+
+  // Indices from the root to the tail.
+  NodeList<ExprRef> to_list() const;
+  // Push the indices to `drain` from the root to the tail.
+  void collect_indices(NodeDrain* drain) const;
+
+  bool structured_eq(const AccessChain& b) const;
+  uint64_t structured_hash() const;
+
+  // Drop a reference to `link` and free the links it solely owned.
+  static void release(const AccessChainLink* link);
+
+private:
+  inline void inc_ref_() const {
+    if (tail != nullptr) { inc_ref_count(tail->nref); }
+  }
+};
@@ -0,0 +1,86 @@
+// Bump-allocated storage for IR nodes.
+// @PENGUINLIONG
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct IrArena;
+struct TypeInterner;
+
+// Every node allocation is prefixed with this header so that a node can tell
+// where it lives without any lookup. `arena` is null for heap-allocated nodes.
+struct alignas(alignof(std::max_align_t)) NodeAllocHeader {
+  IrArena* arena;
+  // Cleared when the node's constructor threw so that the arena doesn't try to
+  // destroy a half-constructed node on release.
+  bool alive;
+};
+
+// An arena owning the memory of all nodes created while it's bound to the
+// current thread with `IrArenaScope`. Nodes are bump-allocated from large
+// blocks and released all at once when the arena is destroyed, so references
+// to arena-backed nodes carry no ownership and no refcount. No reference to an
+// arena-backed node should outlive the arena.
+//
+// An arena can be frozen once it's fully populated. Nodes of a frozen arena
+// are read-only, so they can be shared by child arenas used on other threads;
+// see `IrArena(const IrArena*)`.
+struct IrArena {
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  std::vector<std::unique_ptr<uint8_t[]>> blocks;
+  uint8_t* cur;
+  size_t nbyte_remain;
+  // Allocated nodes in creation order, destroyed in reverse on release.
+  std::vector<NodeAllocHeader*> allocs;
+  // Types are interned per arena; see `intern_ty`. Created on first use.
+  std::unique_ptr<TypeInterner> ty_interner;
+  // Frozen arena whose nodes are referenced by the nodes of this arena, or
+  // null. It must outlive this arena.
+  const IrArena* parent;
+  bool is_frozen;
+
+  // Statistics.
+  size_t nnode;
+  size_t nbyte_node;
+  size_t nbyte_block;
+
+  IrArena();
+  // An arena for nodes referring to the nodes of a frozen `parent`. Types
+  // already interned by `parent` are reused.
+  explicit IrArena(const IrArena* parent);
+  IrArena(const IrArena&) = delete;
+  IrArena(IrArena&&) = delete;
+  ~IrArena();
+
+  // Allocate `size` bytes of node storage with a `NodeAllocHeader` in front.
+  // Returns the address right after the header.
+  void* alloc_node(size_t size);
+  // Stop allocating and make all nodes read-only. Structured hashes are
+  // computed ahead of time so that no shared node is written afterwards.
+  void freeze();
+  // Destroy all nodes and return the memory to the system.
+  void release();
+
+  TypeInterner& get_ty_interner();
+
+  // The arena bound to the current thread, or null if nodes should be
+  // allocated on the heap.
+  static IrArena* current();
+  // Bytes of node storage the current thread has allocated from any arena so
+  // far. The difference across a piece of work is its IR footprint, even if
+  // the work binds arenas of its own.
+  static uint64_t nbyte_alloc_by_thread();
+};
+
+// Bind an arena to the current thread for the lifetime of the scope object.
+// Scopes can be nested; the previously bound arena is restored on exit.
+struct IrArenaScope {
+  IrArena* prev;
+
+  IrArenaScope(IrArena& arena);
+  IrArenaScope(const IrArenaScope&) = delete;
+  ~IrArenaScope();
+};
@@ -0,0 +1,88 @@
+// GENERATED BY `scripts/gen-visitor-templates.py`; DO NOT MODIFY.
+// Flat expression pool.
+// @PENGUINLIONG
+#pragma once
+#include <unordered_map>
+#include "node/gen/expr.hpp"
+
+// Index of an expression in an `ExprPool`.
+typedef uint32_t ExprIndex;
+
+enum ExprPayloadKind {
+  L_EXPR_PAYLOAD_KIND_NONE,
+  L_EXPR_PAYLOAD_KIND_LITERAL,
+  L_EXPR_PAYLOAD_KIND_REF,
+};
+
+inline uint32_t get_expr_noperand(ExprOp op) {
+  switch (op) {
+  case L_EXPR_OP_ADD: return 2;
+  case L_EXPR_OP_SUB: return 2;
+  case L_EXPR_OP_MUL: return 2;
+  case L_EXPR_OP_DIV: return 2;
+  case L_EXPR_OP_MOD: return 2;
+  case L_EXPR_OP_LT: return 2;
+  case L_EXPR_OP_EQ: return 2;
+  case L_EXPR_OP_NOT: return 1;
+  case L_EXPR_OP_TYPE_CAST: return 1;
+  case L_EXPR_OP_SELECT: return 3;
+  default: return 0;
+  }
+}
+inline ExprPayloadKind get_expr_payload_kind(ExprOp op) {
+  switch (op) {
+  case L_EXPR_OP_BOOL_IMM: return L_EXPR_PAYLOAD_KIND_LITERAL;
+  case L_EXPR_OP_INT_IMM: return L_EXPR_PAYLOAD_KIND_LITERAL;
+  case L_EXPR_OP_FLOAT_IMM: return L_EXPR_PAYLOAD_KIND_LITERAL;
+  case L_EXPR_OP_LOAD: return L_EXPR_PAYLOAD_KIND_REF;
+  default: return L_EXPR_PAYLOAD_KIND_NONE;
+  }
+}
+
+// Expressions stored as parallel arrays linked by 32-bit indices instead of
+// pointers. Operands always precede their users so bulk analyses can run
+// bottom-up in a single linear scan. Expressions shared in the source trees
+// are shared in the pool too. Pattern expressions can't be pooled.
+struct ExprPool {
+  // Attributes of each expression, indexed by `ExprIndex`.
+  std::vector<ExprOp> op;
+  // Index into `ty_table`.
+  std::vector<uint32_t> ty;
+  // Index of the first operand in `operands`; see `get_expr_noperand`.
+  std::vector<uint32_t> operand_begin;
+  // Bits of the literal, or an index into `ref_table` for a non-operand
+  // node field; see `get_expr_payload_kind`.
+  std::vector<uint64_t> payload;
+
+  std::vector<ExprIndex> operands;
+  std::vector<TypeRef> ty_table;
+  std::vector<NodeRef> ref_table;
+  // Pooled expressions, indexed by `ExprIndex`. Like the tables above, they
+  // are held by the pool so that the address of a pooled node can't be
+  // reused by another node while it's a key of `expr_idx_map`.
+  std::vector<ExprRef> expr_table;
+
+  std::unordered_map<const Node*, ExprIndex> expr_idx_map;
+  std::unordered_map<const Node*, uint32_t> ty_idx_map;
+  std::unordered_map<const Node*, uint32_t> ref_idx_map;
+
+  inline size_t size() const { return op.size(); }
+  inline const ExprIndex* get_operands(ExprIndex i) const {
+    return operands.data() + operand_begin[i];
+  }
+
+  // Append `expr` and its operands if they are not pooled yet. Returns the
+  // index of `expr`.
+  ExprIndex push(const ExprRef& expr);
+  // Rebuild the expression tree rooted at the `i`-th expression.
+  ExprRef to_tree(ExprIndex i) const;
+
+  // Structural hashes of all expressions in a single scan. Equal for
+  // structurally equal expressions of the pool.
+  std::vector<uint64_t> compute_structured_hashes() const;
+
+private:
+  uint32_t intern_ty_(const TypeRef& ty);
+  uint32_t intern_ref_(const NodeRef& ref);
+  void append_(const Expr& expr);
+};
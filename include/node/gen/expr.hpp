@@ -35,11 +35,19 @@ struct ExprPatternCapture : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprPatternCapture>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprPatternCapture>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!captured->structured_eq(b2_.captured)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_PATTERN_CAPTURE);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(captured));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(captured);
@@ -65,13 +73,23 @@ struct ExprPatternBinaryOp : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprPatternBinaryOp>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprPatternBinaryOp>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (op != b2_.op) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_PATTERN_BINARY_OP);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_field(op));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -91,11 +109,19 @@ struct ExprBoolImm : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprBoolImm>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprBoolImm>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (lit != b2_.lit) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_BOOL_IMM);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_field(lit));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
   }
@@ -113,11 +139,19 @@ struct ExprIntImm : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprIntImm>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprIntImm>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (lit != b2_.lit) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_INT_IMM);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_field(lit));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
   }
@@ -135,11 +169,19 @@ struct ExprFloatImm : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprFloatImm>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprFloatImm>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (lit != b2_.lit) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_FLOAT_IMM);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_field(lit));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
   }
@@ -158,11 +200,19 @@ struct ExprLoad : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprLoad>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprLoad>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!src_ptr->structured_eq(b2_.src_ptr)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_LOAD);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(src_ptr));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(src_ptr);
@@ -185,12 +235,21 @@ struct ExprAdd : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprAdd>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprAdd>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_ADD);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -214,12 +273,21 @@ struct ExprSub : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprSub>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprSub>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_SUB);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -243,12 +311,21 @@ struct ExprMul : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprMul>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprMul>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_MUL);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -272,12 +349,21 @@ struct ExprDiv : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprDiv>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprDiv>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_DIV);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -301,12 +387,21 @@ struct ExprMod : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprMod>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprMod>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_MOD);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -330,12 +425,21 @@ struct ExprLt : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprLt>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprLt>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_LT);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -359,12 +463,21 @@ struct ExprEq : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprEq>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprEq>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_EQ);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -385,11 +498,19 @@ struct ExprNot : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprNot>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprNot>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_NOT);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(a));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(a);
@@ -409,11 +530,19 @@ struct ExprTypeCast : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprTypeCast>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprTypeCast>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!src->structured_eq(b2_.src)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_TYPE_CAST);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(src));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(src);
@@ -439,13 +568,23 @@ struct ExprSelect : public Expr {
 
   virtual bool structured_eq(ExprRef b_) const override final {
     if (!b_->is<ExprSelect>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<ExprSelect>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
+    if (ty != b2_.ty) { return false; }
     if (!cond->structured_eq(b2_.cond)) { return false; }
     if (!a->structured_eq(b2_.a)) { return false; }
     if (!b->structured_eq(b2_.b)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_EXPR_OP_SELECT);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, hash_node_structure(cond));
+    out = hash_combine(out, hash_node_structure(a));
+    out = hash_combine(out, hash_node_structure(b));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
     drain->push(cond);
@@ -456,22 +595,22 @@ struct ExprSelect : public Expr {
 
 constexpr bool is_expr_binary_op(ExprOp op) {
   switch (op) {
-  case L_EXPR_OP_MOD:
   case L_EXPR_OP_ADD:
-  case L_EXPR_OP_DIV:
-  case L_EXPR_OP_EQ:
+  case L_EXPR_OP_SUB:
   case L_EXPR_OP_MUL:
+  case L_EXPR_OP_DIV:
+  case L_EXPR_OP_MOD:
   case L_EXPR_OP_LT:
-  case L_EXPR_OP_SUB:
+  case L_EXPR_OP_EQ:
     return true;
   default: return false;
   }
 }
 constexpr bool is_expr_constant(ExprOp op) {
   switch (op) {
+  case L_EXPR_OP_BOOL_IMM:
   case L_EXPR_OP_INT_IMM:
   case L_EXPR_OP_FLOAT_IMM:
-  case L_EXPR_OP_BOOL_IMM:
     return true;
   default: return false;
   }
@@ -3,6 +3,7 @@
 // @PENGUINLIONG
 #pragma once
 #include "node/node.hpp"
+#include "node/access-chain.hpp"
 
 enum MemoryClass {
   L_MEMORY_CLASS_PATTERN_CAPTURE,
@@ -17,7 +18,7 @@ enum MemoryClass {
 struct Memory : public Node {
   const MemoryClass cls;
   TypeRef ty;
-  std::vector<ExprRef> ac;
+  AccessChain ac;
 
   template<typename T>
   const T& as() const {
@@ -34,10 +35,9 @@ protected:
   inline Memory(
     MemoryClass cls,
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac
-  ) : Node(L_NODE_VARIANT_MEMORY), cls(cls), ty(ty), ac(ac)
+    AccessChain ac
+  ) : Node(L_NODE_VARIANT_MEMORY), cls(cls), ty(ty), ac(std::move(ac))
   {
     liong::assert(ty != nullptr);
-    for (const auto& x : ac) { liong::assert(x != nullptr); }
   }
 };
@@ -18,56 +18,68 @@ struct MemoryPatternCapture : public Memory {
 
   inline MemoryPatternCapture(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
+    AccessChain ac,
     const MemoryRef& captured
-  ) : Memory(L_MEMORY_CLASS_PATTERN_CAPTURE, ty, ac), captured(captured) {
+  ) : Memory(L_MEMORY_CLASS_PATTERN_CAPTURE, ty, std::move(ac)), captured(captured) {
     liong::assert(captured != nullptr);
   }
-  inline MemoryPatternCapture(const TypeRef& ty, const std::vector<ExprRef>& ac) : Memory(L_MEMORY_CLASS_PATTERN_CAPTURE, ty, ac) {}
+  inline MemoryPatternCapture(const TypeRef& ty, AccessChain ac) : Memory(L_MEMORY_CLASS_PATTERN_CAPTURE, ty, std::move(ac)) {}
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemoryPatternCapture>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemoryPatternCapture>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (!captured->structured_eq(b2_.captured)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_PATTERN_CAPTURE);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_structure(captured));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
     drain->push(captured);
   }
 };
 
 struct MemoryFunctionVariable : public Memory {
   static const MemoryClass CLS = L_MEMORY_CLASS_FUNCTION_VARIABLE;
-  std::shared_ptr<uint8_t> handle;
+  NodeHandle handle;
 
   inline MemoryFunctionVariable(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
-    std::shared_ptr<uint8_t> handle
-  ) : Memory(L_MEMORY_CLASS_FUNCTION_VARIABLE, ty, ac), handle(handle) {
+    AccessChain ac,
+    NodeHandle handle
+  ) : Memory(L_MEMORY_CLASS_FUNCTION_VARIABLE, ty, std::move(ac)), handle(handle) {
   }
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemoryFunctionVariable>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemoryFunctionVariable>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (handle != b2_.handle) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_FUNCTION_VARIABLE);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_field(handle));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
   }
 };
 
@@ -79,11 +91,11 @@ struct MemoryIterationVariable : public Memory {
 
   inline MemoryIterationVariable(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
+    AccessChain ac,
     const ExprRef& begin,
     const ExprRef& end,
     const ExprRef& stride
-  ) : Memory(L_MEMORY_CLASS_ITERATION_VARIABLE, ty, ac), begin(begin), end(end), stride(stride) {
+  ) : Memory(L_MEMORY_CLASS_ITERATION_VARIABLE, ty, std::move(ac)), begin(begin), end(end), stride(stride) {
     liong::assert(begin != nullptr);
     liong::assert(end != nullptr);
     liong::assert(stride != nullptr);
@@ -91,20 +103,28 @@ struct MemoryIterationVariable : public Memory {
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemoryIterationVariable>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemoryIterationVariable>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (!begin->structured_eq(b2_.begin)) { return false; }
     if (!end->structured_eq(b2_.end)) { return false; }
     if (!stride->structured_eq(b2_.stride)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_ITERATION_VARIABLE);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_structure(begin));
+    out = hash_combine(out, hash_node_structure(end));
+    out = hash_combine(out, hash_node_structure(stride));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
     drain->push(begin);
     drain->push(end);
     drain->push(stride);
@@ -118,27 +138,34 @@ struct MemoryUniformBuffer : public Memory {
 
   inline MemoryUniformBuffer(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
+    AccessChain ac,
     uint32_t binding,
     uint32_t set
-  ) : Memory(L_MEMORY_CLASS_UNIFORM_BUFFER, ty, ac), binding(binding), set(set) {
+  ) : Memory(L_MEMORY_CLASS_UNIFORM_BUFFER, ty, std::move(ac)), binding(binding), set(set) {
   }
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemoryUniformBuffer>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemoryUniformBuffer>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (binding != b2_.binding) { return false; }
     if (set != b2_.set) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_UNIFORM_BUFFER);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_field(binding));
+    out = hash_combine(out, hash_node_field(set));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
   }
 };
 
@@ -149,27 +176,34 @@ struct MemoryStorageBuffer : public Memory {
 
   inline MemoryStorageBuffer(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
+    AccessChain ac,
     uint32_t binding,
     uint32_t set
-  ) : Memory(L_MEMORY_CLASS_STORAGE_BUFFER, ty, ac), binding(binding), set(set) {
+  ) : Memory(L_MEMORY_CLASS_STORAGE_BUFFER, ty, std::move(ac)), binding(binding), set(set) {
   }
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemoryStorageBuffer>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemoryStorageBuffer>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (binding != b2_.binding) { return false; }
     if (set != b2_.set) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_STORAGE_BUFFER);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_field(binding));
+    out = hash_combine(out, hash_node_field(set));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
   }
 };
 
@@ -180,27 +214,34 @@ struct MemorySampledImage : public Memory {
 
   inline MemorySampledImage(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
+    AccessChain ac,
     uint32_t binding,
     uint32_t set
-  ) : Memory(L_MEMORY_CLASS_SAMPLED_IMAGE, ty, ac), binding(binding), set(set) {
+  ) : Memory(L_MEMORY_CLASS_SAMPLED_IMAGE, ty, std::move(ac)), binding(binding), set(set) {
   }
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemorySampledImage>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemorySampledImage>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (binding != b2_.binding) { return false; }
     if (set != b2_.set) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_SAMPLED_IMAGE);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_field(binding));
+    out = hash_combine(out, hash_node_field(set));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
   }
 };
 
@@ -211,26 +252,33 @@ struct MemoryStorageImage : public Memory {
 
   inline MemoryStorageImage(
     const TypeRef& ty,
-    const std::vector<ExprRef>& ac,
+    AccessChain ac,
     uint32_t binding,
     uint32_t set
-  ) : Memory(L_MEMORY_CLASS_STORAGE_IMAGE, ty, ac), binding(binding), set(set) {
+  ) : Memory(L_MEMORY_CLASS_STORAGE_IMAGE, ty, std::move(ac)), binding(binding), set(set) {
   }
 
   virtual bool structured_eq(MemoryRef b_) const override final {
     if (!b_->is<MemoryStorageImage>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<MemoryStorageImage>();
-    if (!ty->structured_eq(b2_.ty)) { return false; }
-    if (ac.size() != b2_.ac.size()) { return false; }
-    for (size_t i = 0; i < ac.size(); ++i) {
-      if (!ac.at(i)->structured_eq(b2_.ac.at(i))) { return false; }
-    }
+    if (ty != b2_.ty) { return false; }
+    if (!ac.structured_eq(b2_.ac)) { return false; }
     if (binding != b2_.binding) { return false; }
     if (set != b2_.set) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_MEMORY_CLASS_STORAGE_IMAGE);
+    out = hash_combine(out, hash_node_field(ty));
+    out = hash_combine(out, ac.structured_hash());
+    out = hash_combine(out, hash_node_field(binding));
+    out = hash_combine(out, hash_node_field(set));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(ty);
-    for (const auto& x : ac) { drain->push(x); }
+    ac.collect_indices(drain);
   }
 };
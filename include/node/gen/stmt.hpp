@@ -32,10 +32,17 @@ struct StmtPatternCapture : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtPatternCapture>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtPatternCapture>();
     if (!captured->structured_eq(b2_.captured)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_PATTERN_CAPTURE);
+    out = hash_combine(out, hash_node_structure(captured));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(captured);
   }
@@ -53,10 +60,17 @@ struct StmtPatternHead : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtPatternHead>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtPatternHead>();
     if (!inner->structured_eq(b2_.inner)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_PATTERN_HEAD);
+    out = hash_combine(out, hash_node_structure(inner));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(inner);
   }
@@ -74,10 +88,17 @@ struct StmtPatternTail : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtPatternTail>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtPatternTail>();
     if (!inner->structured_eq(b2_.inner)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_PATTERN_TAIL);
+    out = hash_combine(out, hash_node_structure(inner));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(inner);
   }
@@ -92,25 +113,33 @@ struct StmtNop : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtNop>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtNop>();
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_NOP);
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
 
 struct StmtBlock : public Stmt {
   static const StmtOp OP = L_STMT_OP_BLOCK;
-  std::vector<StmtRef> stmts;
+  NodeList<StmtRef> stmts;
 
   inline StmtBlock(
-    const std::vector<StmtRef>& stmts
-  ) : Stmt(L_STMT_OP_BLOCK), stmts(stmts) {
-    for (const auto& x : stmts) { liong::assert(x != nullptr); }
+    NodeList<StmtRef> stmts
+  ) : Stmt(L_STMT_OP_BLOCK), stmts(std::move(stmts)) {
+    for (const auto& x : this->stmts) { liong::assert(x != nullptr); }
   }
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtBlock>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtBlock>();
     if (stmts.size() != b2_.stmts.size()) { return false; }
     for (size_t i = 0; i < stmts.size(); ++i) {
@@ -118,6 +147,11 @@ struct StmtBlock : public Stmt {
     }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_BLOCK);
+    for (const auto& x : stmts) { out = hash_combine(out, hash_node_structure(x)); }
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     for (const auto& x : stmts) { drain->push(x); }
   }
@@ -141,12 +175,21 @@ struct StmtConditionalBranch : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtConditionalBranch>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtConditionalBranch>();
     if (!cond->structured_eq(b2_.cond)) { return false; }
     if (!then_block->structured_eq(b2_.then_block)) { return false; }
     if (!else_block->structured_eq(b2_.else_block)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_CONDITIONAL_BRANCH);
+    out = hash_combine(out, hash_node_structure(cond));
+    out = hash_combine(out, hash_node_structure(then_block));
+    out = hash_combine(out, hash_node_structure(else_block));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(cond);
     drain->push(then_block);
@@ -158,12 +201,12 @@ struct StmtLoop : public Stmt {
   static const StmtOp OP = L_STMT_OP_LOOP;
   StmtRef body_block;
   StmtRef continue_block;
-  std::shared_ptr<uint8_t> handle;
+  NodeHandle handle;
 
   inline StmtLoop(
     const StmtRef& body_block,
     const StmtRef& continue_block,
-    std::shared_ptr<uint8_t> handle
+    NodeHandle handle
   ) : Stmt(L_STMT_OP_LOOP), body_block(body_block), continue_block(continue_block), handle(handle) {
     liong::assert(body_block != nullptr);
     liong::assert(continue_block != nullptr);
@@ -171,12 +214,21 @@ struct StmtLoop : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtLoop>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtLoop>();
     if (!body_block->structured_eq(b2_.body_block)) { return false; }
     if (!continue_block->structured_eq(b2_.continue_block)) { return false; }
     if (handle != b2_.handle) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_LOOP);
+    out = hash_combine(out, hash_node_structure(body_block));
+    out = hash_combine(out, hash_node_structure(continue_block));
+    out = hash_combine(out, hash_node_field(handle));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(body_block);
     drain->push(continue_block);
@@ -188,13 +240,13 @@ struct StmtConditionalLoop : public Stmt {
   ExprRef cond;
   StmtRef body_block;
   StmtRef continue_block;
-  std::shared_ptr<uint8_t> handle;
+  NodeHandle handle;
 
   inline StmtConditionalLoop(
     const ExprRef& cond,
     const StmtRef& body_block,
     const StmtRef& continue_block,
-    std::shared_ptr<uint8_t> handle
+    NodeHandle handle
   ) : Stmt(L_STMT_OP_CONDITIONAL_LOOP), cond(cond), body_block(body_block), continue_block(continue_block), handle(handle) {
     liong::assert(cond != nullptr);
     liong::assert(body_block != nullptr);
@@ -203,6 +255,8 @@ struct StmtConditionalLoop : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtConditionalLoop>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtConditionalLoop>();
     if (!cond->structured_eq(b2_.cond)) { return false; }
     if (!body_block->structured_eq(b2_.body_block)) { return false; }
@@ -210,6 +264,14 @@ struct StmtConditionalLoop : public Stmt {
     if (handle != b2_.handle) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_CONDITIONAL_LOOP);
+    out = hash_combine(out, hash_node_structure(cond));
+    out = hash_combine(out, hash_node_structure(body_block));
+    out = hash_combine(out, hash_node_structure(continue_block));
+    out = hash_combine(out, hash_node_field(handle));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(cond);
     drain->push(body_block);
@@ -226,66 +288,93 @@ struct StmtReturn : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtReturn>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtReturn>();
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_RETURN);
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
 
 struct StmtLoopMerge : public Stmt {
   static const StmtOp OP = L_STMT_OP_LOOP_MERGE;
-  std::shared_ptr<uint8_t> handle;
+  NodeHandle handle;
 
   inline StmtLoopMerge(
-    std::shared_ptr<uint8_t> handle
+    NodeHandle handle
   ) : Stmt(L_STMT_OP_LOOP_MERGE), handle(handle) {
   }
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtLoopMerge>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtLoopMerge>();
     if (handle != b2_.handle) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_LOOP_MERGE);
+    out = hash_combine(out, hash_node_field(handle));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
 
 struct StmtLoopContinue : public Stmt {
   static const StmtOp OP = L_STMT_OP_LOOP_CONTINUE;
-  std::shared_ptr<uint8_t> handle;
+  NodeHandle handle;
 
   inline StmtLoopContinue(
-    std::shared_ptr<uint8_t> handle
+    NodeHandle handle
   ) : Stmt(L_STMT_OP_LOOP_CONTINUE), handle(handle) {
   }
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtLoopContinue>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtLoopContinue>();
     if (handle != b2_.handle) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_LOOP_CONTINUE);
+    out = hash_combine(out, hash_node_field(handle));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
 
 struct StmtLoopBackEdge : public Stmt {
   static const StmtOp OP = L_STMT_OP_LOOP_BACK_EDGE;
-  std::shared_ptr<uint8_t> handle;
+  NodeHandle handle;
 
   inline StmtLoopBackEdge(
-    std::shared_ptr<uint8_t> handle
+    NodeHandle handle
   ) : Stmt(L_STMT_OP_LOOP_BACK_EDGE), handle(handle) {
   }
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtLoopBackEdge>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtLoopBackEdge>();
     if (handle != b2_.handle) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_LOOP_BACK_EDGE);
+    out = hash_combine(out, hash_node_field(handle));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
@@ -305,11 +394,19 @@ struct StmtRangedLoop : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtRangedLoop>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtRangedLoop>();
     if (!body_block->structured_eq(b2_.body_block)) { return false; }
     if (!itervar->structured_eq(b2_.itervar)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_RANGED_LOOP);
+    out = hash_combine(out, hash_node_structure(body_block));
+    out = hash_combine(out, hash_node_structure(itervar));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(body_block);
     drain->push(itervar);
@@ -331,11 +428,19 @@ struct StmtStore : public Stmt {
 
   virtual bool structured_eq(StmtRef b_) const override final {
     if (!b_->is<StmtStore>()) { return false; }
+    if (this == b_.get()) { return true; }
+    if (structured_hash() != b_->structured_hash()) { return false; }
     const auto& b2_ = b_->as<StmtStore>();
     if (!dst_ptr->structured_eq(b2_.dst_ptr)) { return false; }
     if (!value->structured_eq(b2_.value)) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_STMT_OP_STORE);
+    out = hash_combine(out, hash_node_structure(dst_ptr));
+    out = hash_combine(out, hash_node_structure(value));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(dst_ptr);
     drain->push(value);
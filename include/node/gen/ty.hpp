@@ -26,9 +26,14 @@ struct TypePatternCapture : public Type {
   virtual bool structured_eq(TypeRef b_) const override final {
     if (!b_->is<TypePatternCapture>()) { return false; }
     const auto& b2_ = b_->as<TypePatternCapture>();
-    if (!captured->structured_eq(b2_.captured)) { return false; }
+    if (captured != b2_.captured) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_PATTERN_CAPTURE);
+    out = hash_combine(out, hash_node_field(captured));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(captured);
   }
@@ -46,6 +51,10 @@ struct TypeVoid : public Type {
     const auto& b2_ = b_->as<TypeVoid>();
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_VOID);
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
@@ -62,6 +71,10 @@ struct TypeBool : public Type {
     const auto& b2_ = b_->as<TypeBool>();
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_BOOL);
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
@@ -84,6 +97,12 @@ struct TypeInt : public Type {
     if (is_signed != b2_.is_signed) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_INT);
+    out = hash_combine(out, hash_node_field(nbit));
+    out = hash_combine(out, hash_node_field(is_signed));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
@@ -103,29 +122,36 @@ struct TypeFloat : public Type {
     if (nbit != b2_.nbit) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_FLOAT);
+    out = hash_combine(out, hash_node_field(nbit));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
   }
 };
 
 struct TypeStruct : public Type {
   static const TypeClass CLS = L_TYPE_CLASS_STRUCT;
-  std::vector<TypeRef> members;
+  NodeList<TypeRef> members;
 
   inline TypeStruct(
-    const std::vector<TypeRef>& members
-  ) : Type(L_TYPE_CLASS_STRUCT), members(members) {
-    for (const auto& x : members) { liong::assert(x != nullptr); }
+    NodeList<TypeRef> members
+  ) : Type(L_TYPE_CLASS_STRUCT), members(std::move(members)) {
+    for (const auto& x : this->members) { liong::assert(x != nullptr); }
   }
 
   virtual bool structured_eq(TypeRef b_) const override final {
     if (!b_->is<TypeStruct>()) { return false; }
     const auto& b2_ = b_->as<TypeStruct>();
-    if (members.size() != b2_.members.size()) { return false; }
-    for (size_t i = 0; i < members.size(); ++i) {
-      if (!members.at(i)->structured_eq(b2_.members.at(i))) { return false; }
-    }
+    if (members != b2_.members) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_STRUCT);
+    for (const auto& x : members) { out = hash_combine(out, hash_node_field(x)); }
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     for (const auto& x : members) { drain->push(x); }
   }
@@ -146,10 +172,16 @@ struct TypePointer : public Type {
   virtual bool structured_eq(TypeRef b_) const override final {
     if (!b_->is<TypePointer>()) { return false; }
     const auto& b2_ = b_->as<TypePointer>();
-    if (!inner->structured_eq(b2_.inner)) { return false; }
+    if (inner != b2_.inner) { return false; }
     if (storage_cls != b2_.storage_cls) { return false; }
     return true;
   }
+  virtual uint64_t compute_structured_hash() const override final {
+    uint64_t out = hash_node_field(L_TYPE_CLASS_POINTER);
+    out = hash_combine(out, hash_node_field(inner));
+    out = hash_combine(out, hash_node_field(storage_cls));
+    return out;
+  }
   virtual void collect_children(NodeDrain* drain) const override final {
     drain->push(inner);
   }
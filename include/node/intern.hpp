@@ -0,0 +1,31 @@
+// Hash-consing of type nodes.
+// @PENGUINLIONG
+#pragma once
+#include <unordered_map>
+#include "node/reg.hpp"
+
+// Canonicalizes structurally identical types into a single instance so that
+// types can be compared by identity. Children of a type must be interned
+// before the type itself. Type patterns are mutable and must never be
+// interned.
+struct TypeInterner {
+  std::unordered_map<uint64_t, std::vector<TypeRef>> buckets;
+  // Interner of a frozen arena looked up before this one. It's only read, so
+  // it can be shared by interners on multiple threads.
+  const TypeInterner* parent;
+
+  // Statistics.
+  size_t nhit;
+  size_t nmiss;
+
+  inline TypeInterner(const TypeInterner* parent = nullptr) :
+    buckets(), parent(parent), nhit(0), nmiss(0) {}
+
+  // The interned instance of `ty`, or null if there isn't any.
+  TypeRef find(const TypeRef& ty) const;
+  TypeRef intern(const TypeRef& ty);
+};
+
+// Intern `ty` with the type interner of the arena bound to the current
+// thread. A thread-local interner is used if no arena is bound.
+TypeRef intern_ty(const TypeRef& ty);
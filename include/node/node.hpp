@@ -1,14 +1,55 @@
 // Abstraction of everything in the control flow graph.
 // @PENGUINLIONG
 #pragma once
+#include <atomic>
 #include <memory>
 #include <vector>
 #include "gft/assert.hpp"
 #include "spirv/unified1/spirv.hpp"
+#include "node/arena.hpp"
+#include "util/small-vector.hpp"
 
 enum AttributeClass;
 struct Attribute;
 
+// Refcounts only need to be atomic if heap-allocated nodes are shared across
+// threads, which the pipeline never does: each module is processed on a single
+// thread. Build with `CSPV_ATOMIC_REFCOUNT` otherwise.
+#ifdef CSPV_ATOMIC_REFCOUNT
+typedef std::atomic<uint32_t> NodeRefCount;
+#else
+typedef uint32_t NodeRefCount;
+#endif
+
+inline void inc_ref_count(NodeRefCount& nref) {
+#ifdef CSPV_ATOMIC_REFCOUNT
+  nref.fetch_add(1, std::memory_order_relaxed);
+#else
+  ++nref;
+#endif
+}
+// Returns true if the last reference is dropped.
+inline bool dec_ref_count(NodeRefCount& nref) {
+#ifdef CSPV_ATOMIC_REFCOUNT
+  return nref.fetch_sub(1, std::memory_order_acq_rel) == 1;
+#else
+  return --nref == 0;
+#endif
+}
+
+// Identity of a function variable or a structured control-flow construct.
+// Handles are allocated densely from zero for each entry point, so maps keyed
+// by handles can be flat vectors.
+typedef uint32_t NodeHandle;
+const NodeHandle INVALID_NODE_HANDLE = ~(NodeHandle)0;
+struct NodeHandleAllocator {
+  uint32_t nhandle = 0;
+
+  inline NodeHandle alloc() { return nhandle++; }
+  // Number of handles allocated; all handles are less than it.
+  inline uint32_t size() const { return nhandle; }
+};
+
 enum NodeVariant {
   L_NODE_VARIANT_MEMORY,
   L_NODE_VARIANT_TYPE,
@@ -17,9 +58,42 @@ enum NodeVariant {
 };
 struct Node {
   const NodeVariant nova;
+  // Lazily computed structural hash, zero if not computed yet.
+  mutable uint64_t structured_hash_cache;
+  // Number of `Reference`s to a heap-allocated node. Arena-backed nodes are
+  // owned by their arena and aren't counted.
+  mutable NodeRefCount nref;
   //std::map<AttributeClass, std::unique_ptr<Attribute>> attrs;
 
-  inline Node(NodeVariant nova) : nova(nova) {}
+  inline Node(NodeVariant nova) : nova(nova), structured_hash_cache(0), nref(0) {}
+  Node(const Node&) = delete;
+  virtual ~Node() {}
+
+  // Nodes are allocated from the arena bound to the current thread if any
+  // (see `IrArenaScope`), or from the heap otherwise.
+  static void* operator new(size_t size);
+  static void operator delete(void* ptr);
+
+  inline const NodeAllocHeader* get_alloc_header() const {
+    return (const NodeAllocHeader*)this - 1;
+  }
+  inline bool is_arena_backed() const {
+    return get_alloc_header()->arena != nullptr;
+  }
+  // Nodes of a frozen arena are shared read-only; see `IrArena::freeze`.
+  inline bool is_frozen() const {
+    const IrArena* arena = get_alloc_header()->arena;
+    return arena != nullptr && arena->is_frozen;
+  }
+
+  inline void inc_ref() const {
+    if (is_arena_backed()) { return; }
+    inc_ref_count(nref);
+  }
+  inline void dec_ref() const {
+    if (is_arena_backed()) { return; }
+    if (dec_ref_count(nref)) { delete this; }
+  }
 
   template<typename TAttr>
   void set_attr(TAttr&& attr) {
@@ -31,46 +105,87 @@ struct Node {
   }
 
   virtual void collect_children(struct NodeDrain* drain) const {}
+
+  // Hash consistent with `structured_eq`. It's cached on first use, so if a
+  // node is modified in place outside of a `Mutator`, the cache of the node
+  // and all its ancestors must be invalidated manually.
+  inline uint64_t structured_hash() const {
+    if (structured_hash_cache == 0) {
+      fill_structured_hashes();
+    }
+    return structured_hash_cache;
+  }
+  // Compute the missing hash caches of this node and its descendants. Deep
+  // trees are filled in post-order with an explicit stack, so that
+  // `compute_structured_hash` only combines the caches of the children and
+  // doesn't overflow the call stack.
+  void fill_structured_hashes() const;
+  inline void invalidate_structured_hash() const {
+    // Frozen nodes never change.
+    if (is_frozen()) { return; }
+    structured_hash_cache = 0;
+  }
+  virtual uint64_t compute_structured_hash() const { liong::unimplemented(); }
 };
 
+template<typename T>
+struct BorrowedReference;
+
+// A reference to a node. Heap-allocated nodes are owned collectively by their
+// references through the intrusive refcount `Node::nref`; arena-backed nodes
+// are owned by their arena, so copying such a reference involves no
+// refcounting at all.
 template<typename T>
 struct Reference {
-  std::shared_ptr<Node> alloc;
   T* ref;
 
-  Reference() : alloc(nullptr), ref(nullptr) {}
-  Reference(T* ptr) : alloc(std::shared_ptr<Node>(ptr)), ref(ptr) {}
-  Reference(const Reference<T>& b) : alloc(b.alloc), ref(b.ref) {}
-  Reference(Reference<T>&& b) :
-    alloc(std::exchange(b.alloc, nullptr)),
-    ref(std::exchange(b.ref, nullptr)) {}
-  Reference(std::shared_ptr<Node>&& alloc, T* ref) :
-    alloc(std::forward<std::shared_ptr<Node>>(alloc)), ref(ref) {}
+  Reference() : ref(nullptr) {}
+  Reference(T* ptr) : ref(ptr) { inc_ref_(); }
+  Reference(const Reference<T>& b) : ref(b.ref) { inc_ref_(); }
+  Reference(Reference<T>&& b) : ref(std::exchange(b.ref, nullptr)) {}
   template<typename U,
     typename _ = std::enable_if_t<std::is_base_of_v<T, U> || std::is_base_of_v<U, T>>>
-  Reference(const Reference<U>& b) : alloc(b.alloc), ref((T*)b.ref) {}
+  Reference(const Reference<U>& b) : ref((T*)b.ref) { inc_ref_(); }
+  ~Reference() { dec_ref_(); }
 
   inline Reference<T>& operator=(const Reference<T>& b) {
-    alloc = b.alloc;
-    ref = b.ref;
+    // Take the new reference first in case `b` is kept alive by `ref`.
+    T* prev = std::exchange(ref, b.ref);
+    inc_ref_();
+    if (prev != nullptr) { ((const Node*)prev)->dec_ref(); }
     return *this;
   }
   inline Reference<T>& operator=(Reference<T>&& b) {
-    alloc = std::exchange(b.alloc, nullptr);
-    ref = std::exchange(b.ref, nullptr);
+    if (this != &b) {
+      T* prev = std::exchange(ref, std::exchange(b.ref, nullptr));
+      if (prev != nullptr) { ((const Node*)prev)->dec_ref(); }
+    }
     return *this;
   }
 
+  inline void inc_ref_() const {
+    if (ref != nullptr) { ((const Node*)ref)->inc_ref(); }
+  }
+  inline void dec_ref_() const {
+    if (ref != nullptr) { ((const Node*)ref)->dec_ref(); }
+  }
+
   constexpr T* get() { return ref; }
   constexpr const T* get() const { return ref; }
 
-  constexpr Node* get_alloc() { return alloc.get(); }
-  constexpr const Node* get_alloc() const { return alloc.get(); }
+  // Identity of the referenced node regardless of how it's allocated.
+  constexpr Node* get_alloc() { return (Node*)ref; }
+  constexpr const Node* get_alloc() const { return (const Node*)ref; }
 
   template<typename U>
   inline Reference<U> as() const {
-    return Reference<U>(std::shared_ptr<Node>(alloc), (U*)ref);
+    return Reference<U>((U*)ref);
   }
+  // Borrow the referenced node as a related node type without taking a share
+  // of the ownership; see `BorrowedReference`. The referenced node must
+  // actually be a `U`.
+  template<typename U>
+  inline BorrowedReference<U> borrow_as() const;
 
   constexpr T* operator->() { return ref; }
   constexpr const T* operator->() const { return ref; }
@@ -83,7 +198,7 @@ struct Reference {
   template<typename U,
     typename _ = std::enable_if_t<std::is_base_of_v<T, U> || std::is_base_of_v<U, T>>>
   inline operator Reference<U>() {
-    return Reference<U>(std::shared_ptr<Node>(alloc), (U*)ref);
+    return Reference<U>((U*)ref);
   }
 
   template<typename U>
@@ -100,7 +215,73 @@ struct Reference {
   }
 };
 
+// A reference to a node that takes no share of the ownership, so that a node
+// can be passed down as a `const Reference<T>&` of another node type without
+// refcounting. Copies taken from it are ordinary references. It must not
+// outlive the reference it's borrowed from, so it's only meant to be passed
+// as an argument.
+template<typename T>
+struct BorrowedReference {
+  Reference<T> inner;
+
+  explicit BorrowedReference(T* ptr) { inner.ref = ptr; }
+  BorrowedReference(const BorrowedReference<T>&) = delete;
+  BorrowedReference<T>& operator=(const BorrowedReference<T>&) = delete;
+  // Let go of the node without dropping any reference to it.
+  ~BorrowedReference() { inner.ref = nullptr; }
+
+  inline operator const Reference<T>&() const { return inner; }
+};
+
+template<typename T>
+template<typename U>
+inline BorrowedReference<U> Reference<T>::borrow_as() const {
+  static_assert(std::is_base_of_v<T, U> || std::is_base_of_v<U, T>,
+    "borrowing as an unrelated node type");
+  return BorrowedReference<U>((U*)ref);
+}
+
 typedef Reference<Node> NodeRef;
+static_assert(sizeof(NodeRef) == sizeof(Node*),
+  "node references should be as cheap as pointers");
+
+// List of nodes in a node field. Such lists are usually short (a few access
+// chain indices or statements) so that they are stored inline.
+template<typename T>
+using NodeList = SmallVector<T, 4>;
+
+inline uint64_t hash_combine(uint64_t seed, uint64_t x) {
+  return seed ^ (x + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+// Hash of a field of plain data.
+template<typename T>
+inline uint64_t hash_node_field(const T& x) {
+  return std::hash<T>{}(x);
+}
+// Hash of a node field by identity.
+template<typename T>
+inline uint64_t hash_node_field(const Reference<T>& x) {
+  return std::hash<const void*>{}(x.get_alloc());
+}
+// Hash of a node field by structure.
+template<typename T>
+inline uint64_t hash_node_structure(const Reference<T>& x) {
+  return x == nullptr ? 0 : x->structured_hash();
+}
+
+// Functors for hash-keyed containers of nodes compared by structure.
+template<typename T>
+struct StructuredHash {
+  inline size_t operator()(const Reference<T>& x) const {
+    return (size_t)x->structured_hash();
+  }
+};
+template<typename T>
+struct StructuredEq {
+  inline bool operator()(const Reference<T>& a, const Reference<T>& b) const {
+    return a->structured_eq(b);
+  }
+};
 
 struct NodeDrain {
   std::vector<NodeRef> nodes;
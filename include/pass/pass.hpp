@@ -1,17 +1,101 @@
 // Pass: Ranged-loop elevation
 // @PENGUINLIONG
+#include <set>
+#include <vector>
 #include "visitor/visitor.hpp"
 
+// How the mutator of a pass dispatches to its overrides; see `Mutator` and
+// `StaticMutator`.
+enum PassDispatch {
+  L_PASS_DISPATCH_VIRTUAL,
+  L_PASS_DISPATCH_STATIC,
+};
+
 struct Pass {
   const std::string name;
-  Pass(const std::string& name) : name(name) {}
+  // Names of passes that must have been applied before this pass; they are
+  // scheduled by `PassManager` if they haven't.
+  const std::vector<std::string> deps;
+  Pass(const std::string& name, std::vector<std::string> deps = {}) :
+    name(name), deps(std::move(deps)) {}
 
-  virtual void apply(NodeRef& node) {}
+  // Passes are shared by all threads so they must not keep any state between
+  // invocations. Put the state in a `Mutator` local to `apply` instead.
+  //
+  // Returns true if the tree is changed. A pass is expected to change nothing
+  // if it's applied twice in a row.
+  virtual bool apply(NodeRef& node) const { return false; }
+  // Apply the pass with its mutator dispatching as `dispatch` specifies, so
+  // that cspv-bench can compare the two; `apply` uses whichever is faster for
+  // the pass. Passes without a choice ignore `dispatch`.
+  virtual bool apply_with_dispatch(NodeRef& node, PassDispatch dispatch) const {
+    return apply(node);
+  }
 };
 
+// Mutate `x` with `mutator` and tell whether anything is changed. Overrides
+// returning their input untouched keep the tree unchanged; see
+// `Mutator::mark_changed` for in-place writes.
+template<typename TMutator>
+inline bool apply_mutator(TMutator& mutator, NodeRef& x) {
+  x = mutator.mutate(x);
+  return mutator.is_changed();
+}
+
+// A mutator template `TMutator<TBase>` written against either `Mutator` or
+// `StaticMutator`, completed with the latter. The static base needs the final
+// type to dispatch to.
+template<template<typename> class TMutator>
+struct StaticDispatchMutator :
+  public TMutator<StaticMutator<StaticDispatchMutator<TMutator>>> {};
+
+// Mutate `x` with mutator template `TMutator` dispatching as `dispatch`
+// specifies, and tell whether anything is changed.
+template<template<typename> class TMutator>
+inline bool apply_mutator(NodeRef& x, PassDispatch dispatch) {
+  if (dispatch == L_PASS_DISPATCH_STATIC) {
+    StaticDispatchMutator<TMutator> mutator;
+    return apply_mutator(mutator, x);
+  } else {
+    TMutator<Mutator> mutator;
+    return apply_mutator(mutator, x);
+  }
+}
+
 Pass* reg_pass(std::unique_ptr<Pass>&& pass);
 template<typename T>
 inline Pass* reg_pass() {
   return reg_pass(std::make_unique<T>());
 }
-void apply_pass(const std::string& name, NodeRef& node);
+const Pass* get_pass(const std::string& name);
+// Names of all registered passes in lexicographical order.
+std::vector<std::string> list_passes();
+// Apply a single pass regardless of its dependencies. Returns true if the tree
+// is changed.
+bool apply_pass(const std::string& name, NodeRef& node);
+
+// Applies passes to a tree along with their prerequisites. The manager tracks
+// which passes have been applied and which of them are still in effect, i.e.,
+// the tree hasn't been changed by any other pass since, so that a pass in
+// effect is skipped rather than rewriting the whole tree for nothing.
+struct PassManager {
+  // Maximal number of iterations of `apply_fixed_point`.
+  uint32_t max_niter;
+  // Passes that have been applied to the tree.
+  std::set<const Pass*> applied;
+  // Passes whose result is still in effect.
+  std::set<const Pass*> valid;
+
+  PassManager(uint32_t max_niter = 8) : max_niter(max_niter) {}
+
+  // Apply pass `name` unless it's in effect. Prerequisites never applied
+  // before are applied first. Returns true if the tree is changed.
+  bool apply(const std::string& name, NodeRef& node);
+  // Apply a group of passes in order repeatedly until none of them changes
+  // the tree, for up to `max_niter` iterations. Returns true if the tree is
+  // changed.
+  bool apply_fixed_point(const std::vector<std::string>& names, NodeRef& node);
+
+private:
+  bool apply_(const Pass* pass, NodeRef& node, std::vector<const Pass*>& stack);
+};
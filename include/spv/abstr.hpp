@@ -3,8 +3,8 @@
 #pragma once
 #include <cstdint>
 #include <vector>
-#include <map>
 #include "spv/instr.hpp"
+#include "spv/binary.hpp"
 
 struct SpirvHeader {
   uint32_t magic;
@@ -15,13 +15,24 @@ struct SpirvHeader {
 };
 struct SpirvAbstract {
   SpirvHeader head;
-  std::map<spv::Id, InstructionRef> id2instr_map;
+  // Instructions indexed by their result ids. SPIR-V ids are dense and bounded
+  // by `head.bound` so a flat table is used. Unassigned slots are null.
+  std::vector<InstructionRef> id2instr_map;
+  // Number of non-null slots in `id2instr_map`.
+  size_t nid_occupied;
+  // Keeps the words alive as long as any `InstructionRef` points into it.
+  SpirvBinary binary;
   const uint32_t* beg;
   const uint32_t* end;
 
-  const InstructionRef& lookup_instr(spv::Id id) const {
-    return id2instr_map.at(id);
+  inline bool has_instr(spv::Id id) const {
+    return id < id2instr_map.size() && id2instr_map[id] != nullptr;
+  }
+  inline const InstructionRef& lookup_instr(spv::Id id) const {
+    liong::assert(has_instr(id), "id #", id, " is not assigned to any "
+      "instruction");
+    return id2instr_map[id];
   }
 };
 
-SpirvAbstract scan_spirv(const std::vector<uint32_t>& spv);
+SpirvAbstract scan_spirv(const SpirvBinary& binary);
@@ -3,6 +3,16 @@
 #pragma once
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 #include "spv/mod.hpp"
 
-std::map<std::string, StmtRef> extract_entry_points(SpirvModule& mod);
+// Names of all entry points declared in `mod`.
+std::vector<std::string> list_entry_points(const SpirvModule& mod);
+// Parse the function body of entry point `name` into structured IR. Function
+// bodies are only converted into nodes on request, so entry points that are
+// never extracted cost nothing beyond module-scope parsing. `mod` is only
+// read, so multiple entry points can be extracted concurrently.
+StmtRef extract_entry_point(const SpirvModule& mod, const std::string& name);
+// Extract all entry points declared in `mod`.
+std::map<std::string, StmtRef> extract_entry_points(const SpirvModule& mod);
@@ -0,0 +1,28 @@
+// SPIR-V binary storage.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A read-only span of SPIR-V words. `storage` owns the memory `beg` and `end`
+// point into, which can either be a memory-mapped file or an owned word
+// buffer. Any structure holding pointers into the binary (like
+// `InstructionRef`s in `SpirvAbstract`) should keep a copy of it alive.
+struct SpirvBinary {
+  std::shared_ptr<const void> storage;
+  const uint32_t* beg;
+  const uint32_t* end;
+
+  inline SpirvBinary() : storage(nullptr), beg(nullptr), end(nullptr) {}
+
+  constexpr size_t nword() const {
+    return end - beg;
+  }
+};
+
+// Map a SPIR-V file into memory read-only. The magic number and word alignment
+// are checked in place; the content is never copied.
+SpirvBinary map_spirv_binary(const char* path);
+// Take the ownership of an in-memory SPIR-V word buffer.
+SpirvBinary make_spirv_binary(std::vector<uint32_t>&& words);
@@ -0,0 +1,43 @@
+// Id-indexed table of parsed SPIR-V objects.
+// @PENGUINLIONG
+#pragma once
+#include <vector>
+#include "gft/assert.hpp"
+#include "spirv/unified1/spirv.hpp"
+
+// Objects parsed from SPIR-V instructions, indexed by the result ids of the
+// instructions. Ids are dense and bounded by the module header so lookups are
+// plain array accesses. `T` must be nullable; null slots are unassigned.
+template<typename T>
+struct SpirvIdMap {
+  // What the objects are, for error messages.
+  const char* kind;
+  std::vector<T> slots;
+  // Number of assigned slots.
+  size_t nslot_occupied;
+
+  inline SpirvIdMap(const char* kind, uint32_t bound) :
+    kind(kind), slots(bound), nslot_occupied(0) {}
+
+  inline size_t size() const { return nslot_occupied; }
+  inline bool has(spv::Id id) const {
+    return id < slots.size() && slots[id] != nullptr;
+  }
+
+  inline const T& at(spv::Id id) const {
+    liong::assert(has(id), "id #", id, " is not a parsed ", kind);
+    return slots[id];
+  }
+  // Assign `x` to `id` if it's not assigned yet. Like `std::map::emplace`,
+  // the existing object is kept otherwise and false is returned.
+  inline bool emplace(spv::Id id, T x) {
+    liong::assert(id < slots.size(), "id #", id, " of ", kind, " exceeds the "
+      "id bound ", slots.size());
+    liong::assert(x != nullptr, "id #", id, " is assigned to a null ", kind);
+    T& slot = slots[id];
+    if (slot != nullptr) { return false; }
+    slot = std::move(x);
+    ++nslot_occupied;
+    return true;
+  }
+};
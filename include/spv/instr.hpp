@@ -9,6 +9,36 @@
 
 const spv::Id L_INVALID_ID = spv::Id(0);
 
+// Per-opcode properties needed to decode an instruction header. The properties
+// are derived from `spv::HasResultAndType` once for all 2^16 possible opcodes,
+// so that decoding an instruction is a single table load rather than a walk
+// through the giant switch.
+enum OpPropertyBits : uint8_t {
+  L_OP_PROPERTY_HAS_RESULT_ID_BIT = 0x01,
+  L_OP_PROPERTY_HAS_RESULT_TY_ID_BIT = 0x02,
+  // Word offset of the first parameter, stored in the higher bits.
+  L_OP_PROPERTY_PARAM_OFFSET_SHIFT = 2,
+};
+// `HasResultAndType` isn't constexpr, so the table is filled at run time. It
+// has no constructor and is zero-initialized at compile time; it's filled by
+// the first `OpPropertyTableInit` constructed instead. Every translation unit
+// including this header has one of them, constructed ahead of its own static
+// objects, so the table is ready even for instructions decoded during static
+// initialization.
+struct OpPropertyTable {
+  uint8_t props[0x10000];
+
+  inline uint8_t operator[](spv::Op op) const {
+    return props[(uint32_t)op & 0xffff];
+  }
+};
+extern OpPropertyTable OP_PROPERTY_TABLE;
+
+struct OpPropertyTableInit {
+  OpPropertyTableInit();
+};
+static OpPropertyTableInit OP_PROPERTY_TABLE_INIT;
+
 struct InstructionParameterExtractor {
   const uint32_t* cur;
   const uint32_t* end;
@@ -45,39 +75,57 @@ struct InstructionParameterExtractor {
 };
 struct InstructionRef {
   spv::Op op_;
-  uint32_t len_;
+  uint16_t len_;
+  // Opcode properties decoded from `OP_PROPERTY_TABLE` on construction.
+  uint8_t props_;
   const uint32_t* inner;
 
-  inline InstructionRef() : inner(nullptr), op_(spv::Op::OpNop), len_(0) {}
+  inline InstructionRef() :
+    inner(nullptr), op_(spv::Op::OpNop), len_(0), props_(0) {}
   inline InstructionRef(const uint32_t* inner) :
     inner(inner),
     op_(inner != nullptr ? (spv::Op)(*inner & 0xffff) : spv::Op::OpNop),
-    len_(inner != nullptr ? (*inner >> 16) : 0) {}
+    len_(inner != nullptr ? (uint16_t)(*inner >> 16) : 0),
+    props_(inner != nullptr ? OP_PROPERTY_TABLE[op_] : 0) {}
   inline InstructionRef(const InstructionRef& rhs) :
     inner(rhs.inner),
     op_(rhs.op_),
-    len_(rhs.len_) {}
+    len_(rhs.len_),
+    props_(rhs.props_) {}
   inline InstructionRef(InstructionRef&& rhs) :
     inner(std::exchange(rhs.inner, nullptr)),
     op_(std::exchange(rhs.op_, spv::Op::OpNop)),
-    len_(std::exchange(rhs.len_, (uint32_t)0)) {}
+    len_(std::exchange(rhs.len_, (uint16_t)0)),
+    props_(std::exchange(rhs.props_, (uint8_t)0)) {}
 
   inline InstructionRef& operator=(const InstructionRef& rhs) {
     inner = rhs.inner;
     op_ = rhs.op_;
     len_ = rhs.len_;
+    props_ = rhs.props_;
     return *this;
   }
   inline InstructionRef& operator=(InstructionRef&& rhs) {
     inner = std::exchange(rhs.inner, nullptr);
     op_ = std::exchange(rhs.op_, spv::Op::OpNop);
-    len_ = std::exchange(rhs.len_, (uint32_t)0);
+    len_ = std::exchange(rhs.len_, (uint16_t)0);
+    props_ = std::exchange(rhs.props_, (uint8_t)0);
     return *this;
   }
 
   inline InstructionRef next() const {
     return inner + len();
   }
+  // The instruction following this one in a module ending at `end`, or null
+  // if this is the last one. Nothing at or past `end` is read, so it's safe to
+  // step off the end of a memory-mapped module.
+  inline InstructionRef next(const uint32_t* end) const {
+    liong::assert(len() != 0, "spirv corrupted: instruction has zero length");
+    const uint32_t* next_inner = inner + len();
+    liong::assert(next_inner <= end, "spirv corrupted: instruction exceeds "
+      "the end of module");
+    return next_inner < end ? InstructionRef(next_inner) : InstructionRef();
+  }
 
   constexpr bool operator==(std::nullptr_t) const { return inner == nullptr; }
   constexpr bool operator!=(std::nullptr_t) const { return inner != nullptr; }
@@ -112,37 +160,34 @@ struct InstructionRef {
     return len_;
   }
 
-  inline spv::Id result_ty_id() const {
-    bool has_result_ty_id, has_result_id;
-    spv::HasResultAndType(op(), &has_result_id, &has_result_ty_id);
+  constexpr bool has_result_ty_id() const {
+    return (props_ & L_OP_PROPERTY_HAS_RESULT_TY_ID_BIT) != 0;
+  }
+  constexpr bool has_result_id() const {
+    return (props_ & L_OP_PROPERTY_HAS_RESULT_ID_BIT) != 0;
+  }
+  constexpr size_t param_offset() const {
+    return props_ >> L_OP_PROPERTY_PARAM_OFFSET_SHIFT;
+  }
 
-    if (has_result_ty_id) {
+  inline spv::Id result_ty_id() const {
+    if (has_result_ty_id()) {
       return inner[1];
     } else {
       return L_INVALID_ID;
     }
   }
   inline spv::Id result_id() const {
-    bool has_result_ty_id, has_result_id;
-    spv::HasResultAndType(op(), &has_result_id, &has_result_ty_id);
-
-    if (has_result_id) {
-      return has_result_ty_id ? inner[2] : inner[1];
+    if (has_result_id()) {
+      // The result id always immediately precedes the parameters.
+      return inner[param_offset() - 1];
     } else {
       return L_INVALID_ID;
     }
   }
 
   inline InstructionParameterExtractor extract_params() const {
-    bool has_result_ty_id, has_result_id;
-    spv::HasResultAndType(op(), &has_result_id, &has_result_ty_id);
-
-    const uint32_t* param_beg;
-    if (has_result_id) {
-      param_beg = has_result_ty_id ? inner + 3 : inner + 2;
-    } else {
-      param_beg = inner + 1;
-    }
+    const uint32_t* param_beg = inner + param_offset();
     const uint32_t* param_end = inner + len();
 
     return InstructionParameterExtractor(param_beg, param_end);
@@ -2,7 +2,9 @@
 // module.
 // @PENGUINLIONG
 #pragma once
+#include <map>
 #include "spv/abstr.hpp"
+#include "spv/id-map.hpp"
 #include "node/gen/ty.hpp"
 #include "node/gen/mem.hpp"
 #include "node/gen/expr.hpp"
@@ -35,16 +37,107 @@ struct Decoration {
   spv::Decoration deco;
   InstructionRef instr;
 };
-struct MemberDecoration {
-  spv::Decoration deco;
-  uint32_t imember;
-  InstructionRef instr;
+// Decorations applied to an id or to a member of a struct type. Scalar
+// decorations looked up while parsing the module are decoded ahead of time;
+// the rest are kept as instructions.
+struct SpirvDecorationSet {
+  std::vector<Decoration> decos;
+
+  bool is_buffer_block = false;
+  bool has_binding = false;
+  bool has_set = false;
+  uint32_t binding = 0;
+  uint32_t set = 0;
+
+  // Register an `OpDecorate` or `OpMemberDecorate`. `e` is positioned right
+  // after the decoration enum.
+  inline void reg(
+    spv::Decoration deco,
+    const InstructionRef& instr,
+    InstructionParameterExtractor& e
+  ) {
+    switch (deco) {
+    case spv::Decoration::BufferBlock: is_buffer_block = true; break;
+    case spv::Decoration::Binding: has_binding = true; binding = e.read_u32(); break;
+    case spv::Decoration::DescriptorSet: has_set = true; set = e.read_u32(); break;
+    default: break;
+    }
+    decos.emplace_back(Decoration { deco, instr });
+  }
+
+  inline InstructionRef find_deco_instr(spv::Decoration deco) const {
+    for (const auto& x : decos) {
+      if (x.deco == deco) { return x.instr; }
+    }
+    return nullptr;
+  }
+  // The first literal of decoration `deco`, which must be present.
+  inline uint32_t get_deco_u32(spv::Decoration deco) const {
+    InstructionRef deco_instr = find_deco_instr(deco);
+    liong::assert(deco_instr, "missing decoration ", (uint32_t)deco);
+    auto e = deco_instr.extract_params();
+    e.read_id();
+    if (deco_instr.op() == spv::Op::OpMemberDecorate) {
+      e.read_u32();
+    }
+    e.read_u32();
+    return e.read_u32();
+  }
+};
+struct SpirvIdDecorations {
+  SpirvDecorationSet decos;
+  // Indexed by member indices.
+  std::vector<SpirvDecorationSet> member_decos;
+};
+// Decorations grouped by the decorated ids. Only decorated ids have a record
+// so that the index stays compact.
+struct SpirvDecorationIndex {
+  static constexpr uint32_t INVALID_RECORD_INDEX = ~0u;
+
+  std::vector<uint32_t> id2irecord;
+  std::vector<SpirvIdDecorations> records;
+
+  inline SpirvDecorationIndex(uint32_t bound) :
+    id2irecord(bound, INVALID_RECORD_INDEX), records() {}
+
+  inline SpirvIdDecorations& get_or_create(spv::Id id) {
+    liong::assert(id < id2irecord.size(), "decorated id #", id, " exceeds "
+      "the id bound ", id2irecord.size());
+    uint32_t& irecord = id2irecord[id];
+    if (irecord == INVALID_RECORD_INDEX) {
+      irecord = (uint32_t)records.size();
+      records.emplace_back();
+    }
+    return records[irecord];
+  }
+  inline const SpirvIdDecorations* find(spv::Id id) const {
+    if (id >= id2irecord.size()) { return nullptr; }
+    uint32_t irecord = id2irecord[id];
+    return irecord == INVALID_RECORD_INDEX ? nullptr : &records[irecord];
+  }
+
+  // Decorations of `id`; empty if it's not decorated at all.
+  inline const SpirvDecorationSet& get_decos(spv::Id id) const {
+    static const SpirvDecorationSet EMPTY {};
+    const SpirvIdDecorations* record = find(id);
+    return record == nullptr ? EMPTY : record->decos;
+  }
+  inline const SpirvDecorationSet& get_member_decos(
+    spv::Id id,
+    uint32_t imember
+  ) const {
+    static const SpirvDecorationSet EMPTY {};
+    const SpirvIdDecorations* record = find(id);
+    if (record == nullptr || imember >= record->member_decos.size()) {
+      return EMPTY;
+    }
+    return record->member_decos[imember];
+  }
 };
 struct SpirvModule {
   SpirvAbstract abstr;
 
-  std::map<InstructionRef, std::vector<Decoration>> instr2deco_map;
-  std::map<InstructionRef, std::vector<MemberDecoration>> instr2member_deco_map;
+  SpirvDecorationIndex deco_index;
 
   std::vector<spv::Capability> caps;
   std::vector<std::string> exts;
@@ -56,33 +149,46 @@ struct SpirvModule {
   std::map<InstructionRef, SpirvEntryPoint> entry_points;
   std::map<InstructionRef, SpirvFunction> funcs;
 
-  // Things that have IDs and cannot be forward referenced.
-  std::map<spv::Id, TypeRef> ty_map;
-  std::map<spv::Id, MemoryRef> mem_map;
-  std::map<spv::Id, ExprRef> expr_map;
-  std::map<spv::Id, InstructionRef> label_map;
+  // Module-scope things that have IDs and cannot be forward referenced. Sized
+  // by the id bound of the module. Objects local to functions are kept apart
+  // while parsing entry points; see `extract_entry_point`.
+  SpirvIdMap<TypeRef> ty_map;
+  SpirvIdMap<MemoryRef> mem_map;
+  SpirvIdMap<ExprRef> expr_map;
+  SpirvIdMap<InstructionRef> label_map;
 
   inline SpirvModule(SpirvAbstract&& abstr) :
-    abstr(std::forward<SpirvAbstract>(abstr)) {}
+    abstr(std::forward<SpirvAbstract>(abstr)),
+    deco_index(this->abstr.head.bound),
+    ty_map("type", this->abstr.head.bound),
+    mem_map("memory", this->abstr.head.bound),
+    expr_map("expression", this->abstr.head.bound),
+    label_map("label", this->abstr.head.bound) {}
+
+  inline const SpirvDecorationSet& get_decos(
+    const InstructionRef& instr
+  ) const {
+    return deco_index.get_decos(instr.result_id());
+  }
+  inline const SpirvDecorationSet& get_member_decos(
+    uint32_t imember,
+    const InstructionRef& instr
+  ) const {
+    return deco_index.get_member_decos(instr.result_id(), imember);
+  }
 
   inline InstructionRef get_deco_instr(
     spv::Decoration deco,
     const InstructionRef& instr
   ) const {
-    for (const auto& x : instr2deco_map.at(instr)) {
-      if (x.deco == deco) { return x.instr; }
-    }
-    return nullptr;
+    return get_decos(instr).find_deco_instr(deco);
   }
   inline InstructionRef get_member_deco_instr(
     spv::Decoration deco,
     uint32_t imember,
     const InstructionRef& instr
   ) const {
-    for (const auto& x : instr2member_deco_map.at(instr)) {
-      if (x.imember == imember && x.deco == deco) { return x.instr; }
-    }
-    return nullptr;
+    return get_member_decos(imember, instr).find_deco_instr(deco);
   }
   inline bool has_deco(
     spv::Decoration deco,
@@ -94,16 +200,11 @@ struct SpirvModule {
     spv::Decoration deco,
     const InstructionRef& instr
   ) const {
-    InstructionRef deco_instr = get_deco_instr(deco, instr);
-    liong::assert(deco_instr);
-    auto e = deco_instr.extract_params();
-    e.read_id();
-    e.read_u32();
-    return e.read_u32();
+    return get_decos(instr).get_deco_u32(deco);
   }
 
   inline const InstructionRef& lookup_instr(spv::Id id) const {
-    return abstr.id2instr_map.at(id);
+    return abstr.lookup_instr(id);
   }
 };
 
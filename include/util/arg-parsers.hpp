@@ -0,0 +1,34 @@
+// Command line argument parsers shared by the executables.
+// @PENGUINLIONG
+#pragma once
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "gft/util.hpp"
+
+// Collects the arguments of a repeated option, e.g. `-p a -p b`.
+struct StringListParser {
+  typedef std::vector<std::string> arg_ty;
+  static const uint32_t narg = 1;
+  static bool parse(const char* lit[], void* dst) {
+    ((std::vector<std::string>*)dst)->emplace_back(lit[0]);
+    return true;
+  }
+  static std::string lit(const void* src) {
+    return liong::util::join(",", *(std::vector<std::string>*)src);
+  }
+};
+struct CountParser {
+  typedef uint32_t arg_ty;
+  static const uint32_t narg = 1;
+  static bool parse(const char* lit[], void* dst) {
+    char* end = nullptr;
+    unsigned long n = std::strtoul(lit[0], &end, 10);
+    if (end == lit[0] || *end != '\0') { return false; }
+    *(uint32_t*)dst = (uint32_t)n;
+    return true;
+  }
+  static std::string lit(const void* src) {
+    return std::to_string(*(const uint32_t*)src);
+  }
+};
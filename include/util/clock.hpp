@@ -0,0 +1,7 @@
+// Clocks to measure durations with.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+
+// Nanoseconds of a monotonic wall clock since an unspecified epoch.
+uint64_t get_wall_ns();
@@ -0,0 +1,9 @@
+// File system helpers.
+// @PENGUINLIONG
+#pragma once
+#include <string>
+#include <vector>
+
+// Paths of all `.spv` files in directory `dir` and its subdirectories, in
+// lexicographical order.
+std::vector<std::string> collect_spirv_paths(const std::string& dir);
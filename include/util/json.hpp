@@ -0,0 +1,7 @@
+// Helpers to write JSON reports.
+// @PENGUINLIONG
+#pragma once
+#include <string>
+
+// Escape `x` to be put between the quotes of a JSON string.
+std::string escape_json(const std::string& x);
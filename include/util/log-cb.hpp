@@ -0,0 +1,9 @@
+// Log output shared by the executables.
+// @PENGUINLIONG
+#pragma once
+#include <string>
+#include "gft/log.hpp"
+
+// Print a log line to the standard output, colored by its level. Safe to call
+// from multiple threads.
+void log_cb(liong::log::LogLevel lv, const std::string& msg);
@@ -0,0 +1,180 @@
+// Vector with inline storage for a few elements.
+// @PENGUINLIONG
+#pragma once
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <utility>
+#include "gft/assert.hpp"
+
+// A vector that stores up to `N` elements inline and only allocates on the
+// heap when it grows beyond that. Iterators are plain pointers; like
+// `std::vector`, they are invalidated when the vector grows or is moved.
+template<typename T, size_t N>
+struct SmallVector {
+  static_assert(N > 0, "small vector must have inline storage");
+
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  T* data_;
+  size_t size_;
+  size_t capacity_;
+  alignas(T) unsigned char inline_[N * sizeof(T)];
+
+  SmallVector() : data_(get_inline_()), size_(0), capacity_(N) {}
+  SmallVector(std::initializer_list<T> xs) : SmallVector() {
+    append_(xs.begin(), xs.end());
+  }
+  template<typename TIter,
+    typename _ = typename std::iterator_traits<TIter>::iterator_category>
+  SmallVector(TIter beg, TIter end) : SmallVector() {
+    append_(beg, end);
+  }
+  SmallVector(const SmallVector<T, N>& b) : SmallVector() {
+    append_(b.begin(), b.end());
+  }
+  SmallVector(SmallVector<T, N>&& b) : SmallVector() {
+    steal_(b);
+  }
+  ~SmallVector() {
+    clear();
+    free_heap_();
+  }
+
+  inline SmallVector<T, N>& operator=(const SmallVector<T, N>& b) {
+    if (this != &b) {
+      clear();
+      append_(b.begin(), b.end());
+    }
+    return *this;
+  }
+  inline SmallVector<T, N>& operator=(SmallVector<T, N>&& b) {
+    if (this != &b) {
+      clear();
+      free_heap_();
+      steal_(b);
+    }
+    return *this;
+  }
+
+  inline T* begin() { return data_; }
+  inline T* end() { return data_ + size_; }
+  inline const T* begin() const { return data_; }
+  inline const T* end() const { return data_ + size_; }
+  inline T* data() { return data_; }
+  inline const T* data() const { return data_; }
+
+  inline size_t size() const { return size_; }
+  inline size_t capacity() const { return capacity_; }
+  inline bool empty() const { return size_ == 0; }
+  inline bool is_inline() const { return data_ == get_inline_(); }
+
+  inline T& operator[](size_t i) { return data_[i]; }
+  inline const T& operator[](size_t i) const { return data_[i]; }
+  inline T& at(size_t i) {
+    liong::assert(i < size_, "small vector index out of range");
+    return data_[i];
+  }
+  inline const T& at(size_t i) const {
+    liong::assert(i < size_, "small vector index out of range");
+    return data_[i];
+  }
+  inline T& front() { return data_[0]; }
+  inline const T& front() const { return data_[0]; }
+  inline T& back() { return data_[size_ - 1]; }
+  inline const T& back() const { return data_[size_ - 1]; }
+
+  void reserve(size_t n) {
+    if (n <= capacity_) { return; }
+    T* dst = (T*)::operator new(n * sizeof(T));
+    move_to_(dst);
+    data_ = dst;
+    capacity_ = n;
+  }
+  template<typename ... TArgs>
+  T& emplace_back(TArgs&& ... args) {
+    if (size_ < capacity_) {
+      new(data_ + size_) T(std::forward<TArgs>(args) ...);
+    } else {
+      // Construct the new element before moving the old ones in case `args`
+      // refer to elements of this vector.
+      size_t capacity = capacity_ * 2;
+      T* dst = (T*)::operator new(capacity * sizeof(T));
+      new(dst + size_) T(std::forward<TArgs>(args) ...);
+      move_to_(dst);
+      data_ = dst;
+      capacity_ = capacity;
+    }
+    return data_[size_++];
+  }
+  inline void push_back(const T& x) { emplace_back(x); }
+  inline void push_back(T&& x) { emplace_back(std::move(x)); }
+  inline void pop_back() {
+    data_[--size_].~T();
+  }
+  inline void clear() {
+    for (size_t i = size_; i > 0; --i) {
+      data_[i - 1].~T();
+    }
+    size_ = 0;
+  }
+
+  template<size_t M>
+  bool operator==(const SmallVector<T, M>& b) const {
+    if (size_ != b.size()) { return false; }
+    for (size_t i = 0; i < size_; ++i) {
+      if (data_[i] != b[i]) { return false; }
+    }
+    return true;
+  }
+  template<size_t M>
+  inline bool operator!=(const SmallVector<T, M>& b) const {
+    return !(*this == b);
+  }
+
+private:
+  inline T* get_inline_() { return (T*)inline_; }
+  inline const T* get_inline_() const { return (const T*)inline_; }
+
+  template<typename TIter>
+  void append_(TIter beg, TIter end) {
+    reserve(size_ + std::distance(beg, end));
+    for (auto it = beg; it != end; ++it) {
+      new(data_ + size_) T(*it);
+      ++size_;
+    }
+  }
+  // Move the elements to `dst` and release the current storage.
+  void move_to_(T* dst) {
+    for (size_t i = 0; i < size_; ++i) {
+      new(dst + i) T(std::move(data_[i]));
+      data_[i].~T();
+    }
+    free_heap_();
+  }
+  void free_heap_() {
+    if (!is_inline()) {
+      ::operator delete(data_);
+      data_ = get_inline_();
+      capacity_ = N;
+    }
+  }
+  // Take over the elements of `b`, which is left empty. The current storage
+  // must be empty and inline.
+  void steal_(SmallVector<T, N>& b) {
+    if (b.is_inline()) {
+      for (size_t i = 0; i < b.size_; ++i) {
+        new(data_ + i) T(std::move(b.data_[i]));
+      }
+      size_ = b.size_;
+      b.clear();
+    } else {
+      data_ = std::exchange(b.data_, b.get_inline_());
+      size_ = std::exchange(b.size_, 0);
+      capacity_ = std::exchange(b.capacity_, N);
+    }
+  }
+};
@@ -0,0 +1,79 @@
+// Per-stage wall time, CPU time and IR allocation statistics.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Statistics of a processing stage, or a pass, summed over all its
+// invocations.
+struct StageStats {
+  std::string name;
+  // `stage` for the fixed processing stages, or `pass` for IR passes.
+  std::string category;
+  uint64_t ninvoke;
+  // Number of invocations reporting changes to the IR. Only passes report
+  // changes.
+  uint64_t nchanged;
+  double wall_ms;
+  // CPU time of the invoking thread.
+  double cpu_ms;
+  // Whether node counts are collected for this stage.
+  bool has_nnode;
+  // Number of distinct IR nodes reachable from the root before and after the
+  // stage.
+  uint64_t nnode_before;
+  uint64_t nnode_after;
+  // Nodes allocated from the arena bound to the invoking thread.
+  uint64_t nnode_alloc;
+  uint64_t nbyte_alloc;
+};
+
+// Statistics are only collected once enabled. Disabled timers cost a branch.
+void enable_stage_stats(bool enable);
+bool is_stage_stats_enabled();
+
+// Measure a stage from construction to `stop` or destruction, and add the
+// measurement to the process-wide statistics of the stage on destruction.
+// Timers can be used on any thread.
+struct StageTimer {
+  bool enabled;
+  bool is_stopped;
+  std::string name;
+  std::string category;
+  bool changed;
+  bool has_nnode;
+  uint64_t nnode_before;
+  uint64_t nnode_after;
+  uint64_t beg_wall_ns;
+  uint64_t beg_cpu_ns;
+  uint64_t beg_nnode_alloc;
+  uint64_t beg_nbyte_alloc;
+  // Measurements, valid once stopped.
+  uint64_t wall_ns;
+  uint64_t cpu_ns;
+  uint64_t nnode_alloc;
+  uint64_t nbyte_alloc;
+
+  StageTimer(const std::string& name, const char* category = "stage");
+  StageTimer(const StageTimer&) = delete;
+  ~StageTimer();
+
+  // End the measured duration early, e.g., to exclude the work collecting node
+  // counts.
+  void stop();
+
+  inline void set_changed(bool changed) { this->changed = changed; }
+  inline void set_node_counts(uint64_t nnode_before, uint64_t nnode_after) {
+    has_nnode = true;
+    this->nnode_before = nnode_before;
+    this->nnode_after = nnode_after;
+  }
+};
+
+// Statistics of all stages, in the order they were first measured.
+std::vector<StageStats> get_stage_stats();
+// Human-readable table of `stats`.
+std::string format_stage_stats_table(const std::vector<StageStats>& stats);
+// JSON document of `stats` for tooling.
+std::string format_stage_stats_json(const std::vector<StageStats>& stats);
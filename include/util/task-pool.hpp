@@ -0,0 +1,19 @@
+// Minimal fork-join task pool.
+// @PENGUINLIONG
+#pragma once
+#include <cstdint>
+#include <functional>
+
+// Number of workers to use when the user doesn't specify one. It's the number
+// of hardware threads, or 1 if it cannot be determined.
+uint32_t get_default_nworker();
+
+// Invoke `f(i)` for each `i` in `[0, n)` on up to `nworker` threads, and wait
+// for all of them to finish. Tasks are claimed in index order. If any task
+// throws, the remaining unclaimed tasks are skipped and the first exception is
+// rethrown on the calling thread.
+void parallel_for(
+  size_t n,
+  uint32_t nworker,
+  const std::function<void(size_t)>& f
+);
@@ -0,0 +1,51 @@
+// Scoped-span tracer emitting Chrome trace-event JSON.
+// @PENGUINLIONG
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Spans are recorded only after `start_trace`; until then a span costs an
+// atomic load.
+extern std::atomic<bool> IS_TRACING;
+inline bool is_tracing() {
+  return IS_TRACING.load(std::memory_order_acquire);
+}
+// Start recording spans. Call it before any thread records spans.
+void start_trace();
+// Nanoseconds since `start_trace`.
+uint64_t get_trace_time_ns();
+// Record a span of the current thread from `beg_ns` to now. `name` is not
+// copied so it must live until the trace is saved, e.g., a string literal.
+void record_trace_span(const char* name, uint64_t beg_ns);
+// Write spans recorded so far to `path` in the Chrome trace-event format,
+// which can be opened in `chrome://tracing` or Perfetto. Spans still open are
+// not included. Threads recording spans must have been joined.
+void save_trace(const std::string& path);
+
+// Records the lifetime of itself as a span named `name`.
+struct TraceSpan {
+  const char* name;
+  bool is_active;
+  uint64_t beg_ns;
+
+  inline TraceSpan(const char* name) :
+    name(name), is_active(is_tracing()), beg_ns(0)
+  {
+    if (is_active) { beg_ns = get_trace_time_ns(); }
+  }
+  TraceSpan(const TraceSpan&) = delete;
+  inline ~TraceSpan() {
+    if (is_active) { record_trace_span(name, beg_ns); }
+  }
+};
+
+// Trace the enclosing scope. Compiled out unless `CSPV_TRACE` is defined.
+#ifdef CSPV_TRACE
+#define CSPV_TRACE_CONCAT_IMPL_(a, b) a##b
+#define CSPV_TRACE_CONCAT_(a, b) CSPV_TRACE_CONCAT_IMPL_(a, b)
+#define CSPV_TRACE_SCOPE(name) \
+  TraceSpan CSPV_TRACE_CONCAT_(trace_span_, __LINE__)(name)
+#else
+#define CSPV_TRACE_SCOPE(name) ((void)0)
+#endif
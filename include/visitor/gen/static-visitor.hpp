@@ -0,0 +1,877 @@
+// GENERATED BY `scripts/gen-visitor-templates.py`; DO NOT MODIFY.
+// Statically dispatched node visitor and mutator.
+// @PENGUINLIONG
+#pragma once
+
+#include "visitor/gen/visitor.hpp"
+
+// Same traversal as `Visitor`, but override points are resolved at compile
+// time through `TDerived` so the default implementations can be inlined.
+// Override points hide the base overloads of the same name; bring them
+// back with `using StaticVisitor::visit_*_;`.
+template<typename TDerived>
+struct StaticVisitor {
+  typedef Visitor::Task Task;
+  // Tasks scheduled by the node being dispatched, in program order.
+  std::vector<Task>* pending_ = nullptr;
+
+  inline TDerived& derived_() { return *static_cast<TDerived*>(this); }
+
+  inline void drive_(const NodeRef& root) {
+    std::vector<Task>* prev_pending = pending_;
+    std::vector<Task> pending;
+    std::vector<Task> stack;
+    pending_ = &pending;
+    stack.push_back(Task { Visitor::L_TASK_KIND_VISIT, root, nullptr });
+    while (!stack.empty()) {
+      Task task = std::move(stack.back());
+      stack.pop_back();
+      switch (task.kind) {
+      case Visitor::L_TASK_KIND_VISIT: dispatch_(task.node); break;
+      case Visitor::L_TASK_KIND_POST_VISIT: derived_().post_visit_(task.node); break;
+      case Visitor::L_TASK_KIND_CALLBACK: task.f(); break;
+      default: liong::unreachable();
+      }
+      // Scheduled tasks run in program order.
+      for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+        stack.emplace_back(std::move(*it));
+      }
+      pending.clear();
+    }
+    pending_ = prev_pending;
+  }
+  inline void dispatch_(const NodeRef& node) {
+    switch (node->nova) {
+    case L_NODE_VARIANT_MEMORY: dispatch_mem_(node.borrow_as<Memory>()); break;
+    case L_NODE_VARIANT_TYPE: dispatch_ty_(node.borrow_as<Type>()); break;
+    case L_NODE_VARIANT_EXPR: dispatch_expr_(node.borrow_as<Expr>()); break;
+    case L_NODE_VARIANT_STMT: dispatch_stmt_(node.borrow_as<Stmt>()); break;
+    default: liong::unimplemented();
+    }
+  }
+  inline void schedule_visit_node_(const NodeRef& node) {
+    if (pending_ == nullptr) {
+      drive_(node);
+    } else {
+      pending_->emplace_back(Task { Visitor::L_TASK_KIND_VISIT, node, nullptr });
+    }
+  }
+  inline void schedule_post_visit_node_(const NodeRef& node) {
+    if (pending_ == nullptr) {
+      derived_().post_visit_(node);
+    } else {
+      pending_->emplace_back(Task { Visitor::L_TASK_KIND_POST_VISIT, node, nullptr });
+    }
+  }
+  inline void schedule_(std::function<void()>&& f) {
+    if (pending_ == nullptr) {
+      f();
+    } else {
+      pending_->emplace_back(Task { Visitor::L_TASK_KIND_CALLBACK, nullptr, std::move(f) });
+    }
+  }
+  template<typename T>
+  inline void schedule_visit_(const Reference<T>& node) {
+    schedule_visit_node_(node.template borrow_as<Node>());
+  }
+  template<typename T>
+  inline void schedule_post_visit_(const Reference<T>& node) {
+    schedule_post_visit_node_(node.template borrow_as<Node>());
+  }
+  // Called after the children of a node traversed by default are visited.
+  inline void post_visit_(const NodeRef& node) {}
+
+  template<typename T>
+  void visit(const Reference<T>& node) {
+    drive_(node.template borrow_as<Node>());
+  }
+  inline void visit(const MemoryRef& mem) { return visit_mem(mem); }
+  inline void visit(const TypeRef& ty) { return visit_ty(ty); }
+  inline void visit(const ExprRef& expr) { return visit_expr(expr); }
+  inline void visit(const StmtRef& stmt) { return visit_stmt(stmt); }
+
+  inline void visit_mem(const MemoryRef& mem) { drive_(mem.template borrow_as<Node>()); }
+  inline void visit_ty(const TypeRef& ty) { drive_(ty.template borrow_as<Node>()); }
+  inline void visit_expr(const ExprRef& expr) { drive_(expr.template borrow_as<Node>()); }
+  inline void visit_stmt(const StmtRef& stmt) { drive_(stmt.template borrow_as<Node>()); }
+
+  inline void dispatch_mem_(const MemoryRef& mem) {
+    switch (mem->cls) {
+    case L_MEMORY_CLASS_PATTERN_CAPTURE: derived_().visit_mem_(mem.template borrow_as<MemoryPatternCapture>()); break;
+    case L_MEMORY_CLASS_FUNCTION_VARIABLE: derived_().visit_mem_(mem.template borrow_as<MemoryFunctionVariable>()); break;
+    case L_MEMORY_CLASS_ITERATION_VARIABLE: derived_().visit_mem_(mem.template borrow_as<MemoryIterationVariable>()); break;
+    case L_MEMORY_CLASS_UNIFORM_BUFFER: derived_().visit_mem_(mem.template borrow_as<MemoryUniformBuffer>()); break;
+    case L_MEMORY_CLASS_STORAGE_BUFFER: derived_().visit_mem_(mem.template borrow_as<MemoryStorageBuffer>()); break;
+    case L_MEMORY_CLASS_SAMPLED_IMAGE: derived_().visit_mem_(mem.template borrow_as<MemorySampledImage>()); break;
+    case L_MEMORY_CLASS_STORAGE_IMAGE: derived_().visit_mem_(mem.template borrow_as<MemoryStorageImage>()); break;
+    default: liong::unreachable();
+    }
+  }
+  inline void dispatch_ty_(const TypeRef& ty) {
+    switch (ty->cls) {
+    case L_TYPE_CLASS_PATTERN_CAPTURE: derived_().visit_ty_(ty.template borrow_as<TypePatternCapture>()); break;
+    case L_TYPE_CLASS_VOID: derived_().visit_ty_(ty.template borrow_as<TypeVoid>()); break;
+    case L_TYPE_CLASS_BOOL: derived_().visit_ty_(ty.template borrow_as<TypeBool>()); break;
+    case L_TYPE_CLASS_INT: derived_().visit_ty_(ty.template borrow_as<TypeInt>()); break;
+    case L_TYPE_CLASS_FLOAT: derived_().visit_ty_(ty.template borrow_as<TypeFloat>()); break;
+    case L_TYPE_CLASS_STRUCT: derived_().visit_ty_(ty.template borrow_as<TypeStruct>()); break;
+    case L_TYPE_CLASS_POINTER: derived_().visit_ty_(ty.template borrow_as<TypePointer>()); break;
+    default: liong::unreachable();
+    }
+  }
+  inline void dispatch_expr_(const ExprRef& expr) {
+    switch (expr->op) {
+    case L_EXPR_OP_PATTERN_CAPTURE: derived_().visit_expr_(expr.template borrow_as<ExprPatternCapture>()); break;
+    case L_EXPR_OP_PATTERN_BINARY_OP: derived_().visit_expr_(expr.template borrow_as<ExprPatternBinaryOp>()); break;
+    case L_EXPR_OP_BOOL_IMM: derived_().visit_expr_(expr.template borrow_as<ExprBoolImm>()); break;
+    case L_EXPR_OP_INT_IMM: derived_().visit_expr_(expr.template borrow_as<ExprIntImm>()); break;
+    case L_EXPR_OP_FLOAT_IMM: derived_().visit_expr_(expr.template borrow_as<ExprFloatImm>()); break;
+    case L_EXPR_OP_LOAD: derived_().visit_expr_(expr.template borrow_as<ExprLoad>()); break;
+    case L_EXPR_OP_ADD: derived_().visit_expr_(expr.template borrow_as<ExprAdd>()); break;
+    case L_EXPR_OP_SUB: derived_().visit_expr_(expr.template borrow_as<ExprSub>()); break;
+    case L_EXPR_OP_MUL: derived_().visit_expr_(expr.template borrow_as<ExprMul>()); break;
+    case L_EXPR_OP_DIV: derived_().visit_expr_(expr.template borrow_as<ExprDiv>()); break;
+    case L_EXPR_OP_MOD: derived_().visit_expr_(expr.template borrow_as<ExprMod>()); break;
+    case L_EXPR_OP_LT: derived_().visit_expr_(expr.template borrow_as<ExprLt>()); break;
+    case L_EXPR_OP_EQ: derived_().visit_expr_(expr.template borrow_as<ExprEq>()); break;
+    case L_EXPR_OP_NOT: derived_().visit_expr_(expr.template borrow_as<ExprNot>()); break;
+    case L_EXPR_OP_TYPE_CAST: derived_().visit_expr_(expr.template borrow_as<ExprTypeCast>()); break;
+    case L_EXPR_OP_SELECT: derived_().visit_expr_(expr.template borrow_as<ExprSelect>()); break;
+    default: liong::unreachable();
+    }
+  }
+  inline void dispatch_stmt_(const StmtRef& stmt) {
+    switch (stmt->op) {
+    case L_STMT_OP_PATTERN_CAPTURE: derived_().visit_stmt_(stmt.template borrow_as<StmtPatternCapture>()); break;
+    case L_STMT_OP_PATTERN_HEAD: derived_().visit_stmt_(stmt.template borrow_as<StmtPatternHead>()); break;
+    case L_STMT_OP_PATTERN_TAIL: derived_().visit_stmt_(stmt.template borrow_as<StmtPatternTail>()); break;
+    case L_STMT_OP_NOP: derived_().visit_stmt_(stmt.template borrow_as<StmtNop>()); break;
+    case L_STMT_OP_BLOCK: derived_().visit_stmt_(stmt.template borrow_as<StmtBlock>()); break;
+    case L_STMT_OP_CONDITIONAL_BRANCH: derived_().visit_stmt_(stmt.template borrow_as<StmtConditionalBranch>()); break;
+    case L_STMT_OP_LOOP: derived_().visit_stmt_(stmt.template borrow_as<StmtLoop>()); break;
+    case L_STMT_OP_CONDITIONAL_LOOP: derived_().visit_stmt_(stmt.template borrow_as<StmtConditionalLoop>()); break;
+    case L_STMT_OP_RETURN: derived_().visit_stmt_(stmt.template borrow_as<StmtReturn>()); break;
+    case L_STMT_OP_LOOP_MERGE: derived_().visit_stmt_(stmt.template borrow_as<StmtLoopMerge>()); break;
+    case L_STMT_OP_LOOP_CONTINUE: derived_().visit_stmt_(stmt.template borrow_as<StmtLoopContinue>()); break;
+    case L_STMT_OP_LOOP_BACK_EDGE: derived_().visit_stmt_(stmt.template borrow_as<StmtLoopBackEdge>()); break;
+    case L_STMT_OP_RANGED_LOOP: derived_().visit_stmt_(stmt.template borrow_as<StmtRangedLoop>()); break;
+    case L_STMT_OP_STORE: derived_().visit_stmt_(stmt.template borrow_as<StmtStore>()); break;
+    default: liong::unreachable();
+    }
+  }
+
+  inline void visit_mem_(const MemoryPatternCaptureRef& x) {
+    schedule_visit_(x->captured);
+    schedule_post_visit_(x);
+  }
+  inline void visit_mem_(const MemoryFunctionVariableRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_mem_(const MemoryIterationVariableRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_mem_(const MemoryUniformBufferRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_mem_(const MemoryStorageBufferRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_mem_(const MemorySampledImageRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_mem_(const MemoryStorageImageRef& x) {
+    schedule_post_visit_(x);
+  }
+
+  inline void visit_ty_(const TypePatternCaptureRef& x) {
+    schedule_visit_(x->captured);
+    schedule_post_visit_(x);
+  }
+  inline void visit_ty_(const TypeVoidRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_ty_(const TypeBoolRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_ty_(const TypeIntRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_ty_(const TypeFloatRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_ty_(const TypeStructRef& x) {
+    for (const auto& x : x->members) { schedule_visit_(x); }
+    schedule_post_visit_(x);
+  }
+  inline void visit_ty_(const TypePointerRef& x) {
+    schedule_visit_(x->inner);
+    schedule_post_visit_(x);
+  }
+
+  inline void visit_expr_(const ExprPatternCaptureRef& x) {
+    schedule_visit_(x->captured);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprPatternBinaryOpRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprBoolImmRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprIntImmRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprFloatImmRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprLoadRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprAddRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprSubRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprMulRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprDivRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprModRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprLtRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprEqRef& x) {
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprNotRef& x) {
+    schedule_visit_(x->a);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprTypeCastRef& x) {
+    schedule_visit_(x->src);
+    schedule_post_visit_(x);
+  }
+  inline void visit_expr_(const ExprSelectRef& x) {
+    schedule_visit_(x->cond);
+    schedule_visit_(x->a);
+    schedule_visit_(x->b);
+    schedule_post_visit_(x);
+  }
+
+  inline void visit_stmt_(const StmtPatternCaptureRef& x) {
+    schedule_visit_(x->captured);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtPatternHeadRef& x) {
+    schedule_visit_(x->inner);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtPatternTailRef& x) {
+    schedule_visit_(x->inner);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtNopRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtBlockRef& x) {
+    for (const auto& x : x->stmts) { schedule_visit_(x); }
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtConditionalBranchRef& x) {
+    schedule_visit_(x->then_block);
+    schedule_visit_(x->else_block);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtLoopRef& x) {
+    schedule_visit_(x->body_block);
+    schedule_visit_(x->continue_block);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtConditionalLoopRef& x) {
+    schedule_visit_(x->body_block);
+    schedule_visit_(x->continue_block);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtReturnRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtLoopMergeRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtLoopContinueRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtLoopBackEdgeRef& x) {
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtRangedLoopRef& x) {
+    schedule_visit_(x->body_block);
+    schedule_post_visit_(x);
+  }
+  inline void visit_stmt_(const StmtStoreRef& x) {
+    schedule_post_visit_(x);
+  }
+
+};
+
+// Same traversal as `Mutator`, but override points are resolved at compile
+// time through `TDerived` so the default implementations can be inlined.
+// Override points hide the base overloads of the same name; bring them
+// back with `using StaticMutator::mutate_*_;`.
+template<typename TDerived>
+struct StaticMutator {
+  // The node the driver is dispatching; set until any other node is
+  // dispatched.
+  const Node* expanding_ = nullptr;
+  // Set by a default implementation reached from the driver directly.
+  bool is_expanded_ = false;
+  // Set once any node is replaced or written in place.
+  bool is_changed_ = false;
+
+  inline TDerived& derived_() { return *static_cast<TDerived*>(this); }
+
+  inline NodeRef drive_(const NodeRef& root) {
+    bool expand = false;
+    NodeRef out = dispatch_(root, expand);
+    if (out != root) { is_changed_ = true; }
+    if (expand) {
+      mutate_children_node_(out);
+    }
+    // Fields might have been written in place.
+    root->invalidate_structured_hash();
+    if (out != nullptr) { out->invalidate_structured_hash(); }
+    return out;
+  }
+  inline NodeRef dispatch_(const NodeRef& node, bool& expand) {
+    expanding_ = node.get();
+    is_expanded_ = false;
+    NodeRef out;
+    switch (node->nova) {
+    case L_NODE_VARIANT_MEMORY: out = dispatch_mem_(node.borrow_as<Memory>()); break;
+    case L_NODE_VARIANT_TYPE: out = dispatch_ty_(node.borrow_as<Type>()); break;
+    case L_NODE_VARIANT_EXPR: out = dispatch_expr_(node.borrow_as<Expr>()); break;
+    case L_NODE_VARIANT_STMT: out = dispatch_stmt_(node.borrow_as<Stmt>()); break;
+    default: liong::unimplemented();
+    }
+    expand = is_expanded_;
+    expanding_ = nullptr;
+    is_expanded_ = false;
+    liong::assert(!expand || out == node,
+      "default mutator implementation must be called as a tail call");
+    return out;
+  }
+  inline void mutate_children_node_(const NodeRef& node) {
+    liong::assert(!node->is_frozen(), "frozen nodes cannot be mutated");
+    // Each frame owns the slots from `islot_beg` to the beginning of the next
+    // frame's slots.
+    struct Frame {
+      NodeRef node;
+      size_t islot_beg;
+      size_t islot;
+    };
+    std::vector<Frame> frames;
+    std::vector<NodeRef*> slots;
+
+    collect_child_slots(node, slots);
+    frames.emplace_back(Frame { node, 0, 0 });
+    while (!frames.empty()) {
+      Frame& frame = frames.back();
+      if (frame.islot < slots.size()) {
+        NodeRef* slot = slots[frame.islot++];
+        NodeRef child = *slot;
+        bool expand = false;
+        NodeRef out = dispatch_(child, expand);
+        if (out != child) { is_changed_ = true; }
+        *slot = out;
+        if (expand) {
+          size_t islot_beg = slots.size();
+          collect_child_slots(out, slots);
+          frames.emplace_back(Frame { out, islot_beg, islot_beg });
+        } else {
+          child->invalidate_structured_hash();
+          if (out != nullptr) { out->invalidate_structured_hash(); }
+        }
+      } else {
+        NodeRef x = std::move(frame.node);
+        slots.resize(frame.islot_beg);
+        frames.pop_back();
+        x->invalidate_structured_hash();
+        derived_().post_mutate_(x);
+      }
+    }
+  }
+  // Mutate the children of `node` in place, as the default implementations
+  // do.
+  template<typename T>
+  inline void mutate_children_(const Reference<T>& node) {
+    mutate_children_node_(node.template borrow_as<Node>());
+  }
+  // Called after the children of a node traversed by default are mutated.
+  inline void post_mutate_(const NodeRef& node) {}
+  // Overrides that write the fields of a node in place rather than
+  // returning a new node must call this.
+  inline void mark_changed() { is_changed_ = true; }
+  // Whether anything has been changed since the mutator was created.
+  inline bool is_changed() const { return is_changed_; }
+
+  template<typename T>
+  NodeRef mutate(const Reference<T>& node) {
+    return drive_(node.template borrow_as<Node>());
+  }
+  inline MemoryRef mutate(const MemoryRef& mem) { return mutate_mem(mem); }
+  inline TypeRef mutate(const TypeRef& ty) { return mutate_ty(ty); }
+  inline ExprRef mutate(const ExprRef& expr) { return mutate_expr(expr); }
+  inline StmtRef mutate(const StmtRef& stmt) { return mutate_stmt(stmt); }
+
+  inline MemoryRef mutate_mem(const MemoryRef& mem) {
+    return drive_(mem.template borrow_as<Node>()).template as<Memory>();
+  }
+  inline TypeRef mutate_ty(const TypeRef& ty) {
+    return drive_(ty.template borrow_as<Node>()).template as<Type>();
+  }
+  inline ExprRef mutate_expr(const ExprRef& expr) {
+    return drive_(expr.template borrow_as<Node>()).template as<Expr>();
+  }
+  inline StmtRef mutate_stmt(const StmtRef& stmt) {
+    return drive_(stmt.template borrow_as<Node>()).template as<Stmt>();
+  }
+
+  inline MemoryRef dispatch_mem_(const MemoryRef& mem) {
+    switch (mem->cls) {
+    case L_MEMORY_CLASS_PATTERN_CAPTURE: return derived_().mutate_mem_(mem.template borrow_as<MemoryPatternCapture>());
+    case L_MEMORY_CLASS_FUNCTION_VARIABLE: return derived_().mutate_mem_(mem.template borrow_as<MemoryFunctionVariable>());
+    case L_MEMORY_CLASS_ITERATION_VARIABLE: return derived_().mutate_mem_(mem.template borrow_as<MemoryIterationVariable>());
+    case L_MEMORY_CLASS_UNIFORM_BUFFER: return derived_().mutate_mem_(mem.template borrow_as<MemoryUniformBuffer>());
+    case L_MEMORY_CLASS_STORAGE_BUFFER: return derived_().mutate_mem_(mem.template borrow_as<MemoryStorageBuffer>());
+    case L_MEMORY_CLASS_SAMPLED_IMAGE: return derived_().mutate_mem_(mem.template borrow_as<MemorySampledImage>());
+    case L_MEMORY_CLASS_STORAGE_IMAGE: return derived_().mutate_mem_(mem.template borrow_as<MemoryStorageImage>());
+    default: liong::unreachable();
+    }
+  }
+  inline TypeRef dispatch_ty_(const TypeRef& ty) {
+    switch (ty->cls) {
+    case L_TYPE_CLASS_PATTERN_CAPTURE: return derived_().mutate_ty_(ty.template borrow_as<TypePatternCapture>());
+    case L_TYPE_CLASS_VOID: return derived_().mutate_ty_(ty.template borrow_as<TypeVoid>());
+    case L_TYPE_CLASS_BOOL: return derived_().mutate_ty_(ty.template borrow_as<TypeBool>());
+    case L_TYPE_CLASS_INT: return derived_().mutate_ty_(ty.template borrow_as<TypeInt>());
+    case L_TYPE_CLASS_FLOAT: return derived_().mutate_ty_(ty.template borrow_as<TypeFloat>());
+    case L_TYPE_CLASS_STRUCT: return derived_().mutate_ty_(ty.template borrow_as<TypeStruct>());
+    case L_TYPE_CLASS_POINTER: return derived_().mutate_ty_(ty.template borrow_as<TypePointer>());
+    default: liong::unreachable();
+    }
+  }
+  inline ExprRef dispatch_expr_(const ExprRef& expr) {
+    switch (expr->op) {
+    case L_EXPR_OP_PATTERN_CAPTURE: return derived_().mutate_expr_(expr.template borrow_as<ExprPatternCapture>());
+    case L_EXPR_OP_PATTERN_BINARY_OP: return derived_().mutate_expr_(expr.template borrow_as<ExprPatternBinaryOp>());
+    case L_EXPR_OP_BOOL_IMM: return derived_().mutate_expr_(expr.template borrow_as<ExprBoolImm>());
+    case L_EXPR_OP_INT_IMM: return derived_().mutate_expr_(expr.template borrow_as<ExprIntImm>());
+    case L_EXPR_OP_FLOAT_IMM: return derived_().mutate_expr_(expr.template borrow_as<ExprFloatImm>());
+    case L_EXPR_OP_LOAD: return derived_().mutate_expr_(expr.template borrow_as<ExprLoad>());
+    case L_EXPR_OP_ADD: return derived_().mutate_expr_(expr.template borrow_as<ExprAdd>());
+    case L_EXPR_OP_SUB: return derived_().mutate_expr_(expr.template borrow_as<ExprSub>());
+    case L_EXPR_OP_MUL: return derived_().mutate_expr_(expr.template borrow_as<ExprMul>());
+    case L_EXPR_OP_DIV: return derived_().mutate_expr_(expr.template borrow_as<ExprDiv>());
+    case L_EXPR_OP_MOD: return derived_().mutate_expr_(expr.template borrow_as<ExprMod>());
+    case L_EXPR_OP_LT: return derived_().mutate_expr_(expr.template borrow_as<ExprLt>());
+    case L_EXPR_OP_EQ: return derived_().mutate_expr_(expr.template borrow_as<ExprEq>());
+    case L_EXPR_OP_NOT: return derived_().mutate_expr_(expr.template borrow_as<ExprNot>());
+    case L_EXPR_OP_TYPE_CAST: return derived_().mutate_expr_(expr.template borrow_as<ExprTypeCast>());
+    case L_EXPR_OP_SELECT: return derived_().mutate_expr_(expr.template borrow_as<ExprSelect>());
+    default: liong::unreachable();
+    }
+  }
+  inline StmtRef dispatch_stmt_(const StmtRef& stmt) {
+    switch (stmt->op) {
+    case L_STMT_OP_PATTERN_CAPTURE: return derived_().mutate_stmt_(stmt.template borrow_as<StmtPatternCapture>());
+    case L_STMT_OP_PATTERN_HEAD: return derived_().mutate_stmt_(stmt.template borrow_as<StmtPatternHead>());
+    case L_STMT_OP_PATTERN_TAIL: return derived_().mutate_stmt_(stmt.template borrow_as<StmtPatternTail>());
+    case L_STMT_OP_NOP: return derived_().mutate_stmt_(stmt.template borrow_as<StmtNop>());
+    case L_STMT_OP_BLOCK: return derived_().mutate_stmt_(stmt.template borrow_as<StmtBlock>());
+    case L_STMT_OP_CONDITIONAL_BRANCH: return derived_().mutate_stmt_(stmt.template borrow_as<StmtConditionalBranch>());
+    case L_STMT_OP_LOOP: return derived_().mutate_stmt_(stmt.template borrow_as<StmtLoop>());
+    case L_STMT_OP_CONDITIONAL_LOOP: return derived_().mutate_stmt_(stmt.template borrow_as<StmtConditionalLoop>());
+    case L_STMT_OP_RETURN: return derived_().mutate_stmt_(stmt.template borrow_as<StmtReturn>());
+    case L_STMT_OP_LOOP_MERGE: return derived_().mutate_stmt_(stmt.template borrow_as<StmtLoopMerge>());
+    case L_STMT_OP_LOOP_CONTINUE: return derived_().mutate_stmt_(stmt.template borrow_as<StmtLoopContinue>());
+    case L_STMT_OP_LOOP_BACK_EDGE: return derived_().mutate_stmt_(stmt.template borrow_as<StmtLoopBackEdge>());
+    case L_STMT_OP_RANGED_LOOP: return derived_().mutate_stmt_(stmt.template borrow_as<StmtRangedLoop>());
+    case L_STMT_OP_STORE: return derived_().mutate_stmt_(stmt.template borrow_as<StmtStore>());
+    default: liong::unreachable();
+    }
+  }
+
+  inline MemoryRef mutate_mem_(const MemoryPatternCaptureRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Memory>();
+  }
+  inline MemoryRef mutate_mem_(const MemoryFunctionVariableRef& x) {
+    return x.as<Memory>();
+  }
+  inline MemoryRef mutate_mem_(const MemoryIterationVariableRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Memory>();
+  }
+  inline MemoryRef mutate_mem_(const MemoryUniformBufferRef& x) {
+    return x.as<Memory>();
+  }
+  inline MemoryRef mutate_mem_(const MemoryStorageBufferRef& x) {
+    return x.as<Memory>();
+  }
+  inline MemoryRef mutate_mem_(const MemorySampledImageRef& x) {
+    return x.as<Memory>();
+  }
+  inline MemoryRef mutate_mem_(const MemoryStorageImageRef& x) {
+    return x.as<Memory>();
+  }
+
+  inline TypeRef mutate_ty_(const TypePatternCaptureRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Type>();
+  }
+  inline TypeRef mutate_ty_(const TypeVoidRef& x) {
+    return x.as<Type>();
+  }
+  inline TypeRef mutate_ty_(const TypeBoolRef& x) {
+    return x.as<Type>();
+  }
+  inline TypeRef mutate_ty_(const TypeIntRef& x) {
+    return x.as<Type>();
+  }
+  inline TypeRef mutate_ty_(const TypeFloatRef& x) {
+    return x.as<Type>();
+  }
+  inline TypeRef mutate_ty_(const TypeStructRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Type>();
+  }
+  inline TypeRef mutate_ty_(const TypePointerRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Type>();
+  }
+
+  inline ExprRef mutate_expr_(const ExprPatternCaptureRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprPatternBinaryOpRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprBoolImmRef& x) {
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprIntImmRef& x) {
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprFloatImmRef& x) {
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprLoadRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprAddRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprSubRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprMulRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprDivRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprModRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprLtRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprEqRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprNotRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprTypeCastRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+  inline ExprRef mutate_expr_(const ExprSelectRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Expr>();
+  }
+
+  inline StmtRef mutate_stmt_(const StmtPatternCaptureRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtPatternHeadRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtPatternTailRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtNopRef& x) {
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtBlockRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtConditionalBranchRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtLoopRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtConditionalLoopRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtReturnRef& x) {
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtLoopMergeRef& x) {
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtLoopContinueRef& x) {
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtLoopBackEdgeRef& x) {
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtRangedLoopRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+  inline StmtRef mutate_stmt_(const StmtStoreRef& x) {
+    if (x->is_frozen()) {
+      // Frozen nodes are shared read-only; keep them as they are.
+    } else if (expanding_ == x.get()) {
+      // Reached from the driver; leave the children to the work stack.
+      is_expanded_ = true;
+    } else {
+      mutate_children_(x);
+    }
+    return x.as<Stmt>();
+  }
+
+};
@@ -3,152 +3,215 @@
 // @PENGUINLIONG
 #pragma once
 
+#include <functional>
 #include "node/gen/mem.hpp"
 #include "node/gen/ty.hpp"
 #include "node/gen/expr.hpp"
 #include "node/gen/stmt.hpp"
 
+// Nodes are visited with an explicit work stack rather than recursion.
+// An override point `visit_*_` is called when a node is reached; the
+// default implementation schedules the children to be visited after it
+// returns, and `post_visit_` after them. Overrides can schedule work in the
+// same way, or call `visit` to traverse a subtree immediately.
 struct Visitor {
+  enum TaskKind {
+    L_TASK_KIND_VISIT,
+    L_TASK_KIND_POST_VISIT,
+    L_TASK_KIND_CALLBACK,
+  };
+  struct Task {
+    TaskKind kind;
+    NodeRef node;
+    std::function<void()> f;
+  };
+  // Tasks scheduled by the node being dispatched, in program order.
+  std::vector<Task>* pending_ = nullptr;
+
+  void drive_(const NodeRef& root);
+  void dispatch_(const NodeRef& node);
+  void schedule_visit_node_(const NodeRef& node);
+  void schedule_post_visit_node_(const NodeRef& node);
+  // Schedule `f` to run after everything scheduled so far.
+  void schedule_(std::function<void()>&& f);
+  template<typename T>
+  inline void schedule_visit_(const Reference<T>& node) {
+    schedule_visit_node_(node.template borrow_as<Node>());
+  }
+  template<typename T>
+  inline void schedule_post_visit_(const Reference<T>& node) {
+    schedule_post_visit_node_(node.template borrow_as<Node>());
+  }
+  // Called after the children of a node traversed by default are visited.
+  virtual void post_visit_(const NodeRef& node) {}
+
   template<typename T>
   void visit(const Reference<T>& node) {
-    switch (node->nova) {
-    case L_NODE_VARIANT_MEMORY: visit_mem(node.as<Memory>()); break;
-    case L_NODE_VARIANT_TYPE: visit_ty(node.as<Type>()); break;
-    case L_NODE_VARIANT_EXPR: visit_expr(node.as<Expr>()); break;
-    case L_NODE_VARIANT_STMT: visit_stmt(node.as<Stmt>()); break;
-    default: liong::unimplemented();
-    }
+    drive_(node.template borrow_as<Node>());
   }
   inline void visit(const MemoryRef& mem) { return visit_mem(mem); }
   inline void visit(const TypeRef& ty) { return visit_ty(ty); }
   inline void visit(const ExprRef& expr) { return visit_expr(expr); }
   inline void visit(const StmtRef& stmt) { return visit_stmt(stmt); }
 
-  inline void visit_mem(const MemoryRef& mem) {
+  inline void visit_mem(const MemoryRef& mem) { drive_(mem.borrow_as<Node>()); }
+  inline void visit_ty(const TypeRef& ty) { drive_(ty.borrow_as<Node>()); }
+  inline void visit_expr(const ExprRef& expr) { drive_(expr.borrow_as<Node>()); }
+  inline void visit_stmt(const StmtRef& stmt) { drive_(stmt.borrow_as<Node>()); }
+
+  inline void dispatch_mem_(const MemoryRef& mem) {
     switch (mem->cls) {
-    case L_MEMORY_CLASS_PATTERN_CAPTURE: visit_mem_(mem.as<MemoryPatternCapture>()); break;
-    case L_MEMORY_CLASS_FUNCTION_VARIABLE: visit_mem_(mem.as<MemoryFunctionVariable>()); break;
-    case L_MEMORY_CLASS_ITERATION_VARIABLE: visit_mem_(mem.as<MemoryIterationVariable>()); break;
-    case L_MEMORY_CLASS_UNIFORM_BUFFER: visit_mem_(mem.as<MemoryUniformBuffer>()); break;
-    case L_MEMORY_CLASS_STORAGE_BUFFER: visit_mem_(mem.as<MemoryStorageBuffer>()); break;
-    case L_MEMORY_CLASS_SAMPLED_IMAGE: visit_mem_(mem.as<MemorySampledImage>()); break;
-    case L_MEMORY_CLASS_STORAGE_IMAGE: visit_mem_(mem.as<MemoryStorageImage>()); break;
+    case L_MEMORY_CLASS_PATTERN_CAPTURE: visit_mem_(mem.borrow_as<MemoryPatternCapture>()); break;
+    case L_MEMORY_CLASS_FUNCTION_VARIABLE: visit_mem_(mem.borrow_as<MemoryFunctionVariable>()); break;
+    case L_MEMORY_CLASS_ITERATION_VARIABLE: visit_mem_(mem.borrow_as<MemoryIterationVariable>()); break;
+    case L_MEMORY_CLASS_UNIFORM_BUFFER: visit_mem_(mem.borrow_as<MemoryUniformBuffer>()); break;
+    case L_MEMORY_CLASS_STORAGE_BUFFER: visit_mem_(mem.borrow_as<MemoryStorageBuffer>()); break;
+    case L_MEMORY_CLASS_SAMPLED_IMAGE: visit_mem_(mem.borrow_as<MemorySampledImage>()); break;
+    case L_MEMORY_CLASS_STORAGE_IMAGE: visit_mem_(mem.borrow_as<MemoryStorageImage>()); break;
     default: liong::unreachable();
     }
   }
-  inline void visit_ty(const TypeRef& ty) {
+  inline void dispatch_ty_(const TypeRef& ty) {
     switch (ty->cls) {
-    case L_TYPE_CLASS_PATTERN_CAPTURE: visit_ty_(ty.as<TypePatternCapture>()); break;
-    case L_TYPE_CLASS_VOID: visit_ty_(ty.as<TypeVoid>()); break;
-    case L_TYPE_CLASS_BOOL: visit_ty_(ty.as<TypeBool>()); break;
-    case L_TYPE_CLASS_INT: visit_ty_(ty.as<TypeInt>()); break;
-    case L_TYPE_CLASS_FLOAT: visit_ty_(ty.as<TypeFloat>()); break;
-    case L_TYPE_CLASS_STRUCT: visit_ty_(ty.as<TypeStruct>()); break;
-    case L_TYPE_CLASS_POINTER: visit_ty_(ty.as<TypePointer>()); break;
+    case L_TYPE_CLASS_PATTERN_CAPTURE: visit_ty_(ty.borrow_as<TypePatternCapture>()); break;
+    case L_TYPE_CLASS_VOID: visit_ty_(ty.borrow_as<TypeVoid>()); break;
+    case L_TYPE_CLASS_BOOL: visit_ty_(ty.borrow_as<TypeBool>()); break;
+    case L_TYPE_CLASS_INT: visit_ty_(ty.borrow_as<TypeInt>()); break;
+    case L_TYPE_CLASS_FLOAT: visit_ty_(ty.borrow_as<TypeFloat>()); break;
+    case L_TYPE_CLASS_STRUCT: visit_ty_(ty.borrow_as<TypeStruct>()); break;
+    case L_TYPE_CLASS_POINTER: visit_ty_(ty.borrow_as<TypePointer>()); break;
     default: liong::unreachable();
     }
   }
-  inline void visit_expr(const ExprRef& expr) {
+  inline void dispatch_expr_(const ExprRef& expr) {
     switch (expr->op) {
-    case L_EXPR_OP_PATTERN_CAPTURE: visit_expr_(expr.as<ExprPatternCapture>()); break;
-    case L_EXPR_OP_PATTERN_BINARY_OP: visit_expr_(expr.as<ExprPatternBinaryOp>()); break;
-    case L_EXPR_OP_BOOL_IMM: visit_expr_(expr.as<ExprBoolImm>()); break;
-    case L_EXPR_OP_INT_IMM: visit_expr_(expr.as<ExprIntImm>()); break;
-    case L_EXPR_OP_FLOAT_IMM: visit_expr_(expr.as<ExprFloatImm>()); break;
-    case L_EXPR_OP_LOAD: visit_expr_(expr.as<ExprLoad>()); break;
-    case L_EXPR_OP_ADD: visit_expr_(expr.as<ExprAdd>()); break;
-    case L_EXPR_OP_SUB: visit_expr_(expr.as<ExprSub>()); break;
-    case L_EXPR_OP_MUL: visit_expr_(expr.as<ExprMul>()); break;
-    case L_EXPR_OP_DIV: visit_expr_(expr.as<ExprDiv>()); break;
-    case L_EXPR_OP_MOD: visit_expr_(expr.as<ExprMod>()); break;
-    case L_EXPR_OP_LT: visit_expr_(expr.as<ExprLt>()); break;
-    case L_EXPR_OP_EQ: visit_expr_(expr.as<ExprEq>()); break;
-    case L_EXPR_OP_NOT: visit_expr_(expr.as<ExprNot>()); break;
-    case L_EXPR_OP_TYPE_CAST: visit_expr_(expr.as<ExprTypeCast>()); break;
-    case L_EXPR_OP_SELECT: visit_expr_(expr.as<ExprSelect>()); break;
+    case L_EXPR_OP_PATTERN_CAPTURE: visit_expr_(expr.borrow_as<ExprPatternCapture>()); break;
+    case L_EXPR_OP_PATTERN_BINARY_OP: visit_expr_(expr.borrow_as<ExprPatternBinaryOp>()); break;
+    case L_EXPR_OP_BOOL_IMM: visit_expr_(expr.borrow_as<ExprBoolImm>()); break;
+    case L_EXPR_OP_INT_IMM: visit_expr_(expr.borrow_as<ExprIntImm>()); break;
+    case L_EXPR_OP_FLOAT_IMM: visit_expr_(expr.borrow_as<ExprFloatImm>()); break;
+    case L_EXPR_OP_LOAD: visit_expr_(expr.borrow_as<ExprLoad>()); break;
+    case L_EXPR_OP_ADD: visit_expr_(expr.borrow_as<ExprAdd>()); break;
+    case L_EXPR_OP_SUB: visit_expr_(expr.borrow_as<ExprSub>()); break;
+    case L_EXPR_OP_MUL: visit_expr_(expr.borrow_as<ExprMul>()); break;
+    case L_EXPR_OP_DIV: visit_expr_(expr.borrow_as<ExprDiv>()); break;
+    case L_EXPR_OP_MOD: visit_expr_(expr.borrow_as<ExprMod>()); break;
+    case L_EXPR_OP_LT: visit_expr_(expr.borrow_as<ExprLt>()); break;
+    case L_EXPR_OP_EQ: visit_expr_(expr.borrow_as<ExprEq>()); break;
+    case L_EXPR_OP_NOT: visit_expr_(expr.borrow_as<ExprNot>()); break;
+    case L_EXPR_OP_TYPE_CAST: visit_expr_(expr.borrow_as<ExprTypeCast>()); break;
+    case L_EXPR_OP_SELECT: visit_expr_(expr.borrow_as<ExprSelect>()); break;
     default: liong::unreachable();
     }
   }
-  inline void visit_stmt(const StmtRef& stmt) {
+  inline void dispatch_stmt_(const StmtRef& stmt) {
     switch (stmt->op) {
-    case L_STMT_OP_PATTERN_CAPTURE: visit_stmt_(stmt.as<StmtPatternCapture>()); break;
-    case L_STMT_OP_PATTERN_HEAD: visit_stmt_(stmt.as<StmtPatternHead>()); break;
-    case L_STMT_OP_PATTERN_TAIL: visit_stmt_(stmt.as<StmtPatternTail>()); break;
-    case L_STMT_OP_NOP: visit_stmt_(stmt.as<StmtNop>()); break;
-    case L_STMT_OP_BLOCK: visit_stmt_(stmt.as<StmtBlock>()); break;
-    case L_STMT_OP_CONDITIONAL_BRANCH: visit_stmt_(stmt.as<StmtConditionalBranch>()); break;
-    case L_STMT_OP_LOOP: visit_stmt_(stmt.as<StmtLoop>()); break;
-    case L_STMT_OP_CONDITIONAL_LOOP: visit_stmt_(stmt.as<StmtConditionalLoop>()); break;
-    case L_STMT_OP_RETURN: visit_stmt_(stmt.as<StmtReturn>()); break;
-    case L_STMT_OP_LOOP_MERGE: visit_stmt_(stmt.as<StmtLoopMerge>()); break;
-    case L_STMT_OP_LOOP_CONTINUE: visit_stmt_(stmt.as<StmtLoopContinue>()); break;
-    case L_STMT_OP_LOOP_BACK_EDGE: visit_stmt_(stmt.as<StmtLoopBackEdge>()); break;
-    case L_STMT_OP_RANGED_LOOP: visit_stmt_(stmt.as<StmtRangedLoop>()); break;
-    case L_STMT_OP_STORE: visit_stmt_(stmt.as<StmtStore>()); break;
+    case L_STMT_OP_PATTERN_CAPTURE: visit_stmt_(stmt.borrow_as<StmtPatternCapture>()); break;
+    case L_STMT_OP_PATTERN_HEAD: visit_stmt_(stmt.borrow_as<StmtPatternHead>()); break;
+    case L_STMT_OP_PATTERN_TAIL: visit_stmt_(stmt.borrow_as<StmtPatternTail>()); break;
+    case L_STMT_OP_NOP: visit_stmt_(stmt.borrow_as<StmtNop>()); break;
+    case L_STMT_OP_BLOCK: visit_stmt_(stmt.borrow_as<StmtBlock>()); break;
+    case L_STMT_OP_CONDITIONAL_BRANCH: visit_stmt_(stmt.borrow_as<StmtConditionalBranch>()); break;
+    case L_STMT_OP_LOOP: visit_stmt_(stmt.borrow_as<StmtLoop>()); break;
+    case L_STMT_OP_CONDITIONAL_LOOP: visit_stmt_(stmt.borrow_as<StmtConditionalLoop>()); break;
+    case L_STMT_OP_RETURN: visit_stmt_(stmt.borrow_as<StmtReturn>()); break;
+    case L_STMT_OP_LOOP_MERGE: visit_stmt_(stmt.borrow_as<StmtLoopMerge>()); break;
+    case L_STMT_OP_LOOP_CONTINUE: visit_stmt_(stmt.borrow_as<StmtLoopContinue>()); break;
+    case L_STMT_OP_LOOP_BACK_EDGE: visit_stmt_(stmt.borrow_as<StmtLoopBackEdge>()); break;
+    case L_STMT_OP_RANGED_LOOP: visit_stmt_(stmt.borrow_as<StmtRangedLoop>()); break;
+    case L_STMT_OP_STORE: visit_stmt_(stmt.borrow_as<StmtStore>()); break;
     default: liong::unreachable();
     }
   }
 
-  virtual void visit_mem_(MemoryPatternCaptureRef);
-  virtual void visit_mem_(MemoryFunctionVariableRef);
-  virtual void visit_mem_(MemoryIterationVariableRef);
-  virtual void visit_mem_(MemoryUniformBufferRef);
-  virtual void visit_mem_(MemoryStorageBufferRef);
-  virtual void visit_mem_(MemorySampledImageRef);
-  virtual void visit_mem_(MemoryStorageImageRef);
-
-  virtual void visit_ty_(TypePatternCaptureRef);
-  virtual void visit_ty_(TypeVoidRef);
-  virtual void visit_ty_(TypeBoolRef);
-  virtual void visit_ty_(TypeIntRef);
-  virtual void visit_ty_(TypeFloatRef);
-  virtual void visit_ty_(TypeStructRef);
-  virtual void visit_ty_(TypePointerRef);
-
-  virtual void visit_expr_(ExprPatternCaptureRef);
-  virtual void visit_expr_(ExprPatternBinaryOpRef);
-  virtual void visit_expr_(ExprBoolImmRef);
-  virtual void visit_expr_(ExprIntImmRef);
-  virtual void visit_expr_(ExprFloatImmRef);
-  virtual void visit_expr_(ExprLoadRef);
-  virtual void visit_expr_(ExprAddRef);
-  virtual void visit_expr_(ExprSubRef);
-  virtual void visit_expr_(ExprMulRef);
-  virtual void visit_expr_(ExprDivRef);
-  virtual void visit_expr_(ExprModRef);
-  virtual void visit_expr_(ExprLtRef);
-  virtual void visit_expr_(ExprEqRef);
-  virtual void visit_expr_(ExprNotRef);
-  virtual void visit_expr_(ExprTypeCastRef);
-  virtual void visit_expr_(ExprSelectRef);
-
-  virtual void visit_stmt_(StmtPatternCaptureRef);
-  virtual void visit_stmt_(StmtPatternHeadRef);
-  virtual void visit_stmt_(StmtPatternTailRef);
-  virtual void visit_stmt_(StmtNopRef);
-  virtual void visit_stmt_(StmtBlockRef);
-  virtual void visit_stmt_(StmtConditionalBranchRef);
-  virtual void visit_stmt_(StmtLoopRef);
-  virtual void visit_stmt_(StmtConditionalLoopRef);
-  virtual void visit_stmt_(StmtReturnRef);
-  virtual void visit_stmt_(StmtLoopMergeRef);
-  virtual void visit_stmt_(StmtLoopContinueRef);
-  virtual void visit_stmt_(StmtLoopBackEdgeRef);
-  virtual void visit_stmt_(StmtRangedLoopRef);
-  virtual void visit_stmt_(StmtStoreRef);
+  virtual void visit_mem_(const MemoryPatternCaptureRef&);
+  virtual void visit_mem_(const MemoryFunctionVariableRef&);
+  virtual void visit_mem_(const MemoryIterationVariableRef&);
+  virtual void visit_mem_(const MemoryUniformBufferRef&);
+  virtual void visit_mem_(const MemoryStorageBufferRef&);
+  virtual void visit_mem_(const MemorySampledImageRef&);
+  virtual void visit_mem_(const MemoryStorageImageRef&);
+
+  virtual void visit_ty_(const TypePatternCaptureRef&);
+  virtual void visit_ty_(const TypeVoidRef&);
+  virtual void visit_ty_(const TypeBoolRef&);
+  virtual void visit_ty_(const TypeIntRef&);
+  virtual void visit_ty_(const TypeFloatRef&);
+  virtual void visit_ty_(const TypeStructRef&);
+  virtual void visit_ty_(const TypePointerRef&);
+
+  virtual void visit_expr_(const ExprPatternCaptureRef&);
+  virtual void visit_expr_(const ExprPatternBinaryOpRef&);
+  virtual void visit_expr_(const ExprBoolImmRef&);
+  virtual void visit_expr_(const ExprIntImmRef&);
+  virtual void visit_expr_(const ExprFloatImmRef&);
+  virtual void visit_expr_(const ExprLoadRef&);
+  virtual void visit_expr_(const ExprAddRef&);
+  virtual void visit_expr_(const ExprSubRef&);
+  virtual void visit_expr_(const ExprMulRef&);
+  virtual void visit_expr_(const ExprDivRef&);
+  virtual void visit_expr_(const ExprModRef&);
+  virtual void visit_expr_(const ExprLtRef&);
+  virtual void visit_expr_(const ExprEqRef&);
+  virtual void visit_expr_(const ExprNotRef&);
+  virtual void visit_expr_(const ExprTypeCastRef&);
+  virtual void visit_expr_(const ExprSelectRef&);
+
+  virtual void visit_stmt_(const StmtPatternCaptureRef&);
+  virtual void visit_stmt_(const StmtPatternHeadRef&);
+  virtual void visit_stmt_(const StmtPatternTailRef&);
+  virtual void visit_stmt_(const StmtNopRef&);
+  virtual void visit_stmt_(const StmtBlockRef&);
+  virtual void visit_stmt_(const StmtConditionalBranchRef&);
+  virtual void visit_stmt_(const StmtLoopRef&);
+  virtual void visit_stmt_(const StmtConditionalLoopRef&);
+  virtual void visit_stmt_(const StmtReturnRef&);
+  virtual void visit_stmt_(const StmtLoopMergeRef&);
+  virtual void visit_stmt_(const StmtLoopContinueRef&);
+  virtual void visit_stmt_(const StmtLoopBackEdgeRef&);
+  virtual void visit_stmt_(const StmtRangedLoopRef&);
+  virtual void visit_stmt_(const StmtStoreRef&);
 
 };
 
+// Nodes are mutated with an explicit work stack rather than recursion.
+// When the driver reaches a node whose override point `mutate_*_` isn't
+// overridden, the children are pushed to the work stack and `post_mutate_`
+// is called once they are all mutated. An override that needs the children
+// mutated before it continues should call `mutate_children_`; calling the
+// base `mutate_*_` is only allowed as a tail call.
+// Collect the fields the default mutator implementations write to.
+extern void collect_child_slots(const NodeRef& node, std::vector<NodeRef*>& slots);
+
 struct Mutator {
+  // The node the driver is dispatching; set until any other node is
+  // dispatched.
+  const Node* expanding_ = nullptr;
+  // Set by a default implementation reached from the driver directly.
+  bool is_expanded_ = false;
+  // Set once any node is replaced or written in place.
+  bool is_changed_ = false;
+
+  NodeRef drive_(const NodeRef& root);
+  NodeRef dispatch_(const NodeRef& node, bool& expand);
+  void mutate_children_node_(const NodeRef& node);
+  // Mutate the children of `node` in place, as the default implementations
+  // do.
+  template<typename T>
+  inline void mutate_children_(const Reference<T>& node) {
+    mutate_children_node_(node.template borrow_as<Node>());
+  }
+  // Called after the children of a node traversed by default are mutated.
+  virtual void post_mutate_(const NodeRef& node) {}
+  // Overrides that write the fields of a node in place rather than
+  // returning a new node must call this.
+  inline void mark_changed() { is_changed_ = true; }
+  // Whether anything has been changed since the mutator was created.
+  inline bool is_changed() const { return is_changed_; }
+
   template<typename T>
   NodeRef mutate(const Reference<T>& node) {
-    switch (node->nova) {
-    case L_NODE_VARIANT_MEMORY: return mutate_mem(node.as<Memory>()).as<Node>();
-    case L_NODE_VARIANT_TYPE: return mutate_ty(node.as<Type>()).as<Node>();
-    case L_NODE_VARIANT_EXPR: return mutate_expr(node.as<Expr>()).as<Node>();
-    case L_NODE_VARIANT_STMT: return mutate_stmt(node.as<Stmt>()).as<Node>();
-    default: liong::unimplemented();
-    }
+    return drive_(node.template borrow_as<Node>());
   }
   inline MemoryRef mutate(const MemoryRef& mem) { return mutate_mem(mem); }
   inline TypeRef mutate(const TypeRef& ty) { return mutate_ty(ty); }
@@ -156,117 +219,130 @@ struct Mutator {
   inline StmtRef mutate(const StmtRef& stmt) { return mutate_stmt(stmt); }
 
   inline MemoryRef mutate_mem(const MemoryRef& mem) {
+    return drive_(mem.borrow_as<Node>()).as<Memory>();
+  }
+  inline TypeRef mutate_ty(const TypeRef& ty) {
+    return drive_(ty.borrow_as<Node>()).as<Type>();
+  }
+  inline ExprRef mutate_expr(const ExprRef& expr) {
+    return drive_(expr.borrow_as<Node>()).as<Expr>();
+  }
+  inline StmtRef mutate_stmt(const StmtRef& stmt) {
+    return drive_(stmt.borrow_as<Node>()).as<Stmt>();
+  }
+
+  inline MemoryRef dispatch_mem_(const MemoryRef& mem) {
     switch (mem->cls) {
-    case L_MEMORY_CLASS_PATTERN_CAPTURE: return mutate_mem_(mem.as<MemoryPatternCapture>());
-    case L_MEMORY_CLASS_FUNCTION_VARIABLE: return mutate_mem_(mem.as<MemoryFunctionVariable>());
-    case L_MEMORY_CLASS_ITERATION_VARIABLE: return mutate_mem_(mem.as<MemoryIterationVariable>());
-    case L_MEMORY_CLASS_UNIFORM_BUFFER: return mutate_mem_(mem.as<MemoryUniformBuffer>());
-    case L_MEMORY_CLASS_STORAGE_BUFFER: return mutate_mem_(mem.as<MemoryStorageBuffer>());
-    case L_MEMORY_CLASS_SAMPLED_IMAGE: return mutate_mem_(mem.as<MemorySampledImage>());
-    case L_MEMORY_CLASS_STORAGE_IMAGE: return mutate_mem_(mem.as<MemoryStorageImage>());
+    case L_MEMORY_CLASS_PATTERN_CAPTURE: return mutate_mem_(mem.borrow_as<MemoryPatternCapture>());
+    case L_MEMORY_CLASS_FUNCTION_VARIABLE: return mutate_mem_(mem.borrow_as<MemoryFunctionVariable>());
+    case L_MEMORY_CLASS_ITERATION_VARIABLE: return mutate_mem_(mem.borrow_as<MemoryIterationVariable>());
+    case L_MEMORY_CLASS_UNIFORM_BUFFER: return mutate_mem_(mem.borrow_as<MemoryUniformBuffer>());
+    case L_MEMORY_CLASS_STORAGE_BUFFER: return mutate_mem_(mem.borrow_as<MemoryStorageBuffer>());
+    case L_MEMORY_CLASS_SAMPLED_IMAGE: return mutate_mem_(mem.borrow_as<MemorySampledImage>());
+    case L_MEMORY_CLASS_STORAGE_IMAGE: return mutate_mem_(mem.borrow_as<MemoryStorageImage>());
     default: liong::unreachable();
     }
   }
-  inline TypeRef mutate_ty(const TypeRef& ty) {
+  inline TypeRef dispatch_ty_(const TypeRef& ty) {
     switch (ty->cls) {
-    case L_TYPE_CLASS_PATTERN_CAPTURE: return mutate_ty_(ty.as<TypePatternCapture>());
-    case L_TYPE_CLASS_VOID: return mutate_ty_(ty.as<TypeVoid>());
-    case L_TYPE_CLASS_BOOL: return mutate_ty_(ty.as<TypeBool>());
-    case L_TYPE_CLASS_INT: return mutate_ty_(ty.as<TypeInt>());
-    case L_TYPE_CLASS_FLOAT: return mutate_ty_(ty.as<TypeFloat>());
-    case L_TYPE_CLASS_STRUCT: return mutate_ty_(ty.as<TypeStruct>());
-    case L_TYPE_CLASS_POINTER: return mutate_ty_(ty.as<TypePointer>());
+    case L_TYPE_CLASS_PATTERN_CAPTURE: return mutate_ty_(ty.borrow_as<TypePatternCapture>());
+    case L_TYPE_CLASS_VOID: return mutate_ty_(ty.borrow_as<TypeVoid>());
+    case L_TYPE_CLASS_BOOL: return mutate_ty_(ty.borrow_as<TypeBool>());
+    case L_TYPE_CLASS_INT: return mutate_ty_(ty.borrow_as<TypeInt>());
+    case L_TYPE_CLASS_FLOAT: return mutate_ty_(ty.borrow_as<TypeFloat>());
+    case L_TYPE_CLASS_STRUCT: return mutate_ty_(ty.borrow_as<TypeStruct>());
+    case L_TYPE_CLASS_POINTER: return mutate_ty_(ty.borrow_as<TypePointer>());
     default: liong::unreachable();
     }
   }
-  inline ExprRef mutate_expr(const ExprRef& expr) {
+  inline ExprRef dispatch_expr_(const ExprRef& expr) {
     switch (expr->op) {
-    case L_EXPR_OP_PATTERN_CAPTURE: return mutate_expr_(expr.as<ExprPatternCapture>());
-    case L_EXPR_OP_PATTERN_BINARY_OP: return mutate_expr_(expr.as<ExprPatternBinaryOp>());
-    case L_EXPR_OP_BOOL_IMM: return mutate_expr_(expr.as<ExprBoolImm>());
-    case L_EXPR_OP_INT_IMM: return mutate_expr_(expr.as<ExprIntImm>());
-    case L_EXPR_OP_FLOAT_IMM: return mutate_expr_(expr.as<ExprFloatImm>());
-    case L_EXPR_OP_LOAD: return mutate_expr_(expr.as<ExprLoad>());
-    case L_EXPR_OP_ADD: return mutate_expr_(expr.as<ExprAdd>());
-    case L_EXPR_OP_SUB: return mutate_expr_(expr.as<ExprSub>());
-    case L_EXPR_OP_MUL: return mutate_expr_(expr.as<ExprMul>());
-    case L_EXPR_OP_DIV: return mutate_expr_(expr.as<ExprDiv>());
-    case L_EXPR_OP_MOD: return mutate_expr_(expr.as<ExprMod>());
-    case L_EXPR_OP_LT: return mutate_expr_(expr.as<ExprLt>());
-    case L_EXPR_OP_EQ: return mutate_expr_(expr.as<ExprEq>());
-    case L_EXPR_OP_NOT: return mutate_expr_(expr.as<ExprNot>());
-    case L_EXPR_OP_TYPE_CAST: return mutate_expr_(expr.as<ExprTypeCast>());
-    case L_EXPR_OP_SELECT: return mutate_expr_(expr.as<ExprSelect>());
+    case L_EXPR_OP_PATTERN_CAPTURE: return mutate_expr_(expr.borrow_as<ExprPatternCapture>());
+    case L_EXPR_OP_PATTERN_BINARY_OP: return mutate_expr_(expr.borrow_as<ExprPatternBinaryOp>());
+    case L_EXPR_OP_BOOL_IMM: return mutate_expr_(expr.borrow_as<ExprBoolImm>());
+    case L_EXPR_OP_INT_IMM: return mutate_expr_(expr.borrow_as<ExprIntImm>());
+    case L_EXPR_OP_FLOAT_IMM: return mutate_expr_(expr.borrow_as<ExprFloatImm>());
+    case L_EXPR_OP_LOAD: return mutate_expr_(expr.borrow_as<ExprLoad>());
+    case L_EXPR_OP_ADD: return mutate_expr_(expr.borrow_as<ExprAdd>());
+    case L_EXPR_OP_SUB: return mutate_expr_(expr.borrow_as<ExprSub>());
+    case L_EXPR_OP_MUL: return mutate_expr_(expr.borrow_as<ExprMul>());
+    case L_EXPR_OP_DIV: return mutate_expr_(expr.borrow_as<ExprDiv>());
+    case L_EXPR_OP_MOD: return mutate_expr_(expr.borrow_as<ExprMod>());
+    case L_EXPR_OP_LT: return mutate_expr_(expr.borrow_as<ExprLt>());
+    case L_EXPR_OP_EQ: return mutate_expr_(expr.borrow_as<ExprEq>());
+    case L_EXPR_OP_NOT: return mutate_expr_(expr.borrow_as<ExprNot>());
+    case L_EXPR_OP_TYPE_CAST: return mutate_expr_(expr.borrow_as<ExprTypeCast>());
+    case L_EXPR_OP_SELECT: return mutate_expr_(expr.borrow_as<ExprSelect>());
     default: liong::unreachable();
     }
   }
-  inline StmtRef mutate_stmt(const StmtRef& stmt) {
+  inline StmtRef dispatch_stmt_(const StmtRef& stmt) {
     switch (stmt->op) {
-    case L_STMT_OP_PATTERN_CAPTURE: return mutate_stmt_(stmt.as<StmtPatternCapture>());
-    case L_STMT_OP_PATTERN_HEAD: return mutate_stmt_(stmt.as<StmtPatternHead>());
-    case L_STMT_OP_PATTERN_TAIL: return mutate_stmt_(stmt.as<StmtPatternTail>());
-    case L_STMT_OP_NOP: return mutate_stmt_(stmt.as<StmtNop>());
-    case L_STMT_OP_BLOCK: return mutate_stmt_(stmt.as<StmtBlock>());
-    case L_STMT_OP_CONDITIONAL_BRANCH: return mutate_stmt_(stmt.as<StmtConditionalBranch>());
-    case L_STMT_OP_LOOP: return mutate_stmt_(stmt.as<StmtLoop>());
-    case L_STMT_OP_CONDITIONAL_LOOP: return mutate_stmt_(stmt.as<StmtConditionalLoop>());
-    case L_STMT_OP_RETURN: return mutate_stmt_(stmt.as<StmtReturn>());
-    case L_STMT_OP_LOOP_MERGE: return mutate_stmt_(stmt.as<StmtLoopMerge>());
-    case L_STMT_OP_LOOP_CONTINUE: return mutate_stmt_(stmt.as<StmtLoopContinue>());
-    case L_STMT_OP_LOOP_BACK_EDGE: return mutate_stmt_(stmt.as<StmtLoopBackEdge>());
-    case L_STMT_OP_RANGED_LOOP: return mutate_stmt_(stmt.as<StmtRangedLoop>());
-    case L_STMT_OP_STORE: return mutate_stmt_(stmt.as<StmtStore>());
+    case L_STMT_OP_PATTERN_CAPTURE: return mutate_stmt_(stmt.borrow_as<StmtPatternCapture>());
+    case L_STMT_OP_PATTERN_HEAD: return mutate_stmt_(stmt.borrow_as<StmtPatternHead>());
+    case L_STMT_OP_PATTERN_TAIL: return mutate_stmt_(stmt.borrow_as<StmtPatternTail>());
+    case L_STMT_OP_NOP: return mutate_stmt_(stmt.borrow_as<StmtNop>());
+    case L_STMT_OP_BLOCK: return mutate_stmt_(stmt.borrow_as<StmtBlock>());
+    case L_STMT_OP_CONDITIONAL_BRANCH: return mutate_stmt_(stmt.borrow_as<StmtConditionalBranch>());
+    case L_STMT_OP_LOOP: return mutate_stmt_(stmt.borrow_as<StmtLoop>());
+    case L_STMT_OP_CONDITIONAL_LOOP: return mutate_stmt_(stmt.borrow_as<StmtConditionalLoop>());
+    case L_STMT_OP_RETURN: return mutate_stmt_(stmt.borrow_as<StmtReturn>());
+    case L_STMT_OP_LOOP_MERGE: return mutate_stmt_(stmt.borrow_as<StmtLoopMerge>());
+    case L_STMT_OP_LOOP_CONTINUE: return mutate_stmt_(stmt.borrow_as<StmtLoopContinue>());
+    case L_STMT_OP_LOOP_BACK_EDGE: return mutate_stmt_(stmt.borrow_as<StmtLoopBackEdge>());
+    case L_STMT_OP_RANGED_LOOP: return mutate_stmt_(stmt.borrow_as<StmtRangedLoop>());
+    case L_STMT_OP_STORE: return mutate_stmt_(stmt.borrow_as<StmtStore>());
     default: liong::unreachable();
     }
   }
 
-  virtual MemoryRef mutate_mem_(MemoryPatternCaptureRef);
-  virtual MemoryRef mutate_mem_(MemoryFunctionVariableRef);
-  virtual MemoryRef mutate_mem_(MemoryIterationVariableRef);
-  virtual MemoryRef mutate_mem_(MemoryUniformBufferRef);
-  virtual MemoryRef mutate_mem_(MemoryStorageBufferRef);
-  virtual MemoryRef mutate_mem_(MemorySampledImageRef);
-  virtual MemoryRef mutate_mem_(MemoryStorageImageRef);
-
-  virtual TypeRef mutate_ty_(TypePatternCaptureRef);
-  virtual TypeRef mutate_ty_(TypeVoidRef);
-  virtual TypeRef mutate_ty_(TypeBoolRef);
-  virtual TypeRef mutate_ty_(TypeIntRef);
-  virtual TypeRef mutate_ty_(TypeFloatRef);
-  virtual TypeRef mutate_ty_(TypeStructRef);
-  virtual TypeRef mutate_ty_(TypePointerRef);
-
-  virtual ExprRef mutate_expr_(ExprPatternCaptureRef);
-  virtual ExprRef mutate_expr_(ExprPatternBinaryOpRef);
-  virtual ExprRef mutate_expr_(ExprBoolImmRef);
-  virtual ExprRef mutate_expr_(ExprIntImmRef);
-  virtual ExprRef mutate_expr_(ExprFloatImmRef);
-  virtual ExprRef mutate_expr_(ExprLoadRef);
-  virtual ExprRef mutate_expr_(ExprAddRef);
-  virtual ExprRef mutate_expr_(ExprSubRef);
-  virtual ExprRef mutate_expr_(ExprMulRef);
-  virtual ExprRef mutate_expr_(ExprDivRef);
-  virtual ExprRef mutate_expr_(ExprModRef);
-  virtual ExprRef mutate_expr_(ExprLtRef);
-  virtual ExprRef mutate_expr_(ExprEqRef);
-  virtual ExprRef mutate_expr_(ExprNotRef);
-  virtual ExprRef mutate_expr_(ExprTypeCastRef);
-  virtual ExprRef mutate_expr_(ExprSelectRef);
-
-  virtual StmtRef mutate_stmt_(StmtPatternCaptureRef);
-  virtual StmtRef mutate_stmt_(StmtPatternHeadRef);
-  virtual StmtRef mutate_stmt_(StmtPatternTailRef);
-  virtual StmtRef mutate_stmt_(StmtNopRef);
-  virtual StmtRef mutate_stmt_(StmtBlockRef);
-  virtual StmtRef mutate_stmt_(StmtConditionalBranchRef);
-  virtual StmtRef mutate_stmt_(StmtLoopRef);
-  virtual StmtRef mutate_stmt_(StmtConditionalLoopRef);
-  virtual StmtRef mutate_stmt_(StmtReturnRef);
-  virtual StmtRef mutate_stmt_(StmtLoopMergeRef);
-  virtual StmtRef mutate_stmt_(StmtLoopContinueRef);
-  virtual StmtRef mutate_stmt_(StmtLoopBackEdgeRef);
-  virtual StmtRef mutate_stmt_(StmtRangedLoopRef);
-  virtual StmtRef mutate_stmt_(StmtStoreRef);
+  virtual MemoryRef mutate_mem_(const MemoryPatternCaptureRef&);
+  virtual MemoryRef mutate_mem_(const MemoryFunctionVariableRef&);
+  virtual MemoryRef mutate_mem_(const MemoryIterationVariableRef&);
+  virtual MemoryRef mutate_mem_(const MemoryUniformBufferRef&);
+  virtual MemoryRef mutate_mem_(const MemoryStorageBufferRef&);
+  virtual MemoryRef mutate_mem_(const MemorySampledImageRef&);
+  virtual MemoryRef mutate_mem_(const MemoryStorageImageRef&);
+
+  virtual TypeRef mutate_ty_(const TypePatternCaptureRef&);
+  virtual TypeRef mutate_ty_(const TypeVoidRef&);
+  virtual TypeRef mutate_ty_(const TypeBoolRef&);
+  virtual TypeRef mutate_ty_(const TypeIntRef&);
+  virtual TypeRef mutate_ty_(const TypeFloatRef&);
+  virtual TypeRef mutate_ty_(const TypeStructRef&);
+  virtual TypeRef mutate_ty_(const TypePointerRef&);
+
+  virtual ExprRef mutate_expr_(const ExprPatternCaptureRef&);
+  virtual ExprRef mutate_expr_(const ExprPatternBinaryOpRef&);
+  virtual ExprRef mutate_expr_(const ExprBoolImmRef&);
+  virtual ExprRef mutate_expr_(const ExprIntImmRef&);
+  virtual ExprRef mutate_expr_(const ExprFloatImmRef&);
+  virtual ExprRef mutate_expr_(const ExprLoadRef&);
+  virtual ExprRef mutate_expr_(const ExprAddRef&);
+  virtual ExprRef mutate_expr_(const ExprSubRef&);
+  virtual ExprRef mutate_expr_(const ExprMulRef&);
+  virtual ExprRef mutate_expr_(const ExprDivRef&);
+  virtual ExprRef mutate_expr_(const ExprModRef&);
+  virtual ExprRef mutate_expr_(const ExprLtRef&);
+  virtual ExprRef mutate_expr_(const ExprEqRef&);
+  virtual ExprRef mutate_expr_(const ExprNotRef&);
+  virtual ExprRef mutate_expr_(const ExprTypeCastRef&);
+  virtual ExprRef mutate_expr_(const ExprSelectRef&);
+
+  virtual StmtRef mutate_stmt_(const StmtPatternCaptureRef&);
+  virtual StmtRef mutate_stmt_(const StmtPatternHeadRef&);
+  virtual StmtRef mutate_stmt_(const StmtPatternTailRef&);
+  virtual StmtRef mutate_stmt_(const StmtNopRef&);
+  virtual StmtRef mutate_stmt_(const StmtBlockRef&);
+  virtual StmtRef mutate_stmt_(const StmtConditionalBranchRef&);
+  virtual StmtRef mutate_stmt_(const StmtLoopRef&);
+  virtual StmtRef mutate_stmt_(const StmtConditionalLoopRef&);
+  virtual StmtRef mutate_stmt_(const StmtReturnRef&);
+  virtual StmtRef mutate_stmt_(const StmtLoopMergeRef&);
+  virtual StmtRef mutate_stmt_(const StmtLoopContinueRef&);
+  virtual StmtRef mutate_stmt_(const StmtLoopBackEdgeRef&);
+  virtual StmtRef mutate_stmt_(const StmtRangedLoopRef&);
+  virtual StmtRef mutate_stmt_(const StmtStoreRef&);
 
 };
 
@@ -276,7 +352,7 @@ struct MemoryFunctorVisitor : public Visitor {
   MemoryFunctorVisitor(std::function<void(Reference<T>)>&& f) :
     f(std::forward<std::function<void(Reference<T>)>>(f)) {}
 
-  virtual void visit_mem_(Reference<T> mem) override final { f(mem); }
+  virtual void visit_mem_(const Reference<T>& mem) override final { f(mem); }
 };
 template<typename T>
 void visit_mem_functor(
@@ -293,7 +369,7 @@ struct TypeFunctorVisitor : public Visitor {
   TypeFunctorVisitor(std::function<void(Reference<T>)>&& f) :
     f(std::forward<std::function<void(Reference<T>)>>(f)) {}
 
-  virtual void visit_ty_(Reference<T> ty) override final { f(ty); }
+  virtual void visit_ty_(const Reference<T>& ty) override final { f(ty); }
 };
 template<typename T>
 void visit_ty_functor(
@@ -310,7 +386,7 @@ struct ExprFunctorVisitor : public Visitor {
   ExprFunctorVisitor(std::function<void(Reference<T>)>&& f) :
     f(std::forward<std::function<void(Reference<T>)>>(f)) {}
 
-  virtual void visit_expr_(Reference<T> expr) override final { f(expr); }
+  virtual void visit_expr_(const Reference<T>& expr) override final { f(expr); }
 };
 template<typename T>
 void visit_expr_functor(
@@ -327,7 +403,7 @@ struct StmtFunctorVisitor : public Visitor {
   StmtFunctorVisitor(std::function<void(Reference<T>)>&& f) :
     f(std::forward<std::function<void(Reference<T>)>>(f)) {}
 
-  virtual void visit_stmt_(Reference<T> stmt) override final { f(stmt); }
+  virtual void visit_stmt_(const Reference<T>& stmt) override final { f(stmt); }
 };
 template<typename T>
 void visit_stmt_functor(
@@ -9,6 +9,8 @@ extern StmtRef flatten_block(const StmtRef& x);
 extern StmtRef& get_head_stmt(StmtRef& stmt);
 extern StmtRef& get_tail_stmt(StmtRef& stmt);
 extern std::vector<NodeRef> collect_children(const NodeRef& node);
+// Number of distinct nodes reachable from `root`, including itself.
+extern size_t count_nodes(const NodeRef& root);
 extern bool match_pattern(const NodeRef& pattern, const NodeRef& target);
 
 enum PredefinedType {
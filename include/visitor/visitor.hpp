@@ -3,3 +3,4 @@
 #pragma once
 #include "node/node.hpp"
 #include "visitor/gen/visitor.hpp"
+#include "visitor/gen/static-visitor.hpp"
@@ -23,15 +23,22 @@ class Name:
         return ''.join(x.title() for x in self.segs)
 
 class NodeFieldType:
-    def __init__(self, ty):
+    def __init__(self, ty, ref_ty_names):
         is_plural = ty.endswith("[]")
-        is_ref_ty = ty[0].isupper()
+        is_ref_ty = (ty[:-2] if is_plural else ty) in ref_ty_names
+        # Access chains are persistent lists of `Expr`s; see
+        # `node/access-chain.hpp`.
+        is_access_chain = ty == "AccessChain"
 
-        if is_plural:
+        if is_access_chain:
+            self.field_ty = "AccessChain"
+            self.param_ty = "AccessChain"
+        elif is_plural:
             ty = ty[:-2]
             if is_ref_ty:
-                self.field_ty = f"std::vector<{ty}Ref>"
-                self.param_ty = f"const std::vector<{ty}Ref>&"
+                # Taken by value and moved into the field.
+                self.field_ty = f"NodeList<{ty}Ref>"
+                self.param_ty = f"NodeList<{ty}Ref>"
             else:
                 self.field_ty = f"std::vector<{ty}>"
                 self.param_ty = f"std::vector<{ty}>"
@@ -46,11 +53,22 @@ class NodeFieldType:
         self.raw_name = ty
         self.is_ref_ty = is_ref_ty
         self.is_plural = is_plural
+        self.is_access_chain = is_access_chain
+        self.is_interned = False
 
 class NodeField:
     def __init__(self, name, ty: NodeFieldType):
         self.name = Name(name)
         self.ty = ty
+    def to_ctor_arg(self):
+        """Pass on the constructor parameter of this field."""
+        name = self.name.to_snake_case()
+        return f"std::move({name})" if self.ty.is_plural or self.ty.is_access_chain else name
+    def to_ctor_member(self):
+        """Refer to the field in a constructor body where the parameter of the
+        same name might have been moved from."""
+        name = self.name.to_snake_case()
+        return f"this->{name}" if self.ty.is_plural else name
 
 class NodeSubtype:
     def __init__(self, name, fields: List[NodeField], categories: List[Name], is_default_constructable: bool):
@@ -60,7 +78,7 @@ class NodeSubtype:
         self.is_default_constructable = is_default_constructable
 
 class NodeVariant:
-    def __init__(self, formal_name, ty_name, ty_abbr, enum_name, enum_abbr, fields: List[NodeField], subtys: List[NodeSubtype]):
+    def __init__(self, formal_name, ty_name, ty_abbr, enum_name, enum_abbr, fields: List[NodeField], subtys: List[NodeSubtype], is_interned: bool):
         self.formal_name = formal_name
         self.ty_name = Name(ty_name)
         self.ty_abbr = Name(ty_abbr)
@@ -68,28 +86,38 @@ class NodeVariant:
         self.enum_abbr = Name(enum_abbr)
         self.fields = fields
         self.subtys = subtys
+        self.is_interned = is_interned
 
 
 
 def json2nova(json) -> Dict[str, NodeVariant]:
     out = {}
+    # Other capitalized field types, like `NodeHandle`, are plain data.
+    ref_ty_names = set(Name(x["ty_name"]).to_pascal_case() for x in json.values())
     for formal_name, nova in json.items():
         ty_name = nova["ty_name"]
         ty_abbr = nova["ty_abbr"]
         enum_name = nova["enum_name"]
         enum_abbr = nova["enum_abbr"]
         variants = nova["variants"]
+        is_interned = "is_interned" in nova and nova["is_interned"]
 
-        common_fields = [NodeField(name, NodeFieldType(ty)) for name, ty in nova["fields"].items()]
+        common_fields = [NodeField(name, NodeFieldType(ty, ref_ty_names)) for name, ty in nova["fields"].items()]
 
         subtys = []
         for name, variant in variants.items():
-            fields = [NodeField(name, NodeFieldType(ty)) for name, ty in variant["fields"].items()]
+            fields = [NodeField(name, NodeFieldType(ty, ref_ty_names)) for name, ty in variant["fields"].items()]
             categories = [Name(x) for x in variant["categories"]] if "categories" in variant else []
             is_default_constructable = "is_default_constructable" in variant and variant["is_default_constructable"]
             subtys += [NodeSubtype(name, fields, categories, is_default_constructable)]
 
-        out[formal_name] = NodeVariant(formal_name, ty_name, ty_abbr, enum_name, enum_abbr, common_fields, subtys)
+        out[formal_name] = NodeVariant(formal_name, ty_name, ty_abbr, enum_name, enum_abbr, common_fields, subtys, is_interned)
+
+    # Fields referring to interned nodes are compared by identity.
+    interned_ty_names = set(x.ty_name.to_pascal_case() for x in out.values() if x.is_interned)
+    for nova in out.values():
+        for field in nova.fields + [field for subty in nova.subtys for field in subty.fields]:
+            field.ty.is_interned = field.ty.raw_name in interned_ty_names
     return out
 
 
@@ -111,31 +139,244 @@ def compose_general_header2(desc: str):
         "#pragma once",
     ]
 
+def indent(lines: List[str], n: int):
+    return [(" " * n + x) if x else x for x in lines]
+
+# Members of the visitor work-stack driver. `qual` qualifies the member names
+# of out-of-class definitions, or is empty for definitions in a class body.
+def compose_visitor_driver(novas: Dict[str, NodeVariant], qual: str, kind_scope: str, post_visit: str):
+    decl = "inline " if qual == "" else ""
+    out = [
+        f"{decl}void {qual}drive_(const NodeRef& root) {{",
+        "  std::vector<Task>* prev_pending = pending_;",
+        "  std::vector<Task> pending;",
+        "  std::vector<Task> stack;",
+        "  pending_ = &pending;",
+        f"  stack.push_back(Task {{ {kind_scope}L_TASK_KIND_VISIT, root, nullptr }});",
+        "  while (!stack.empty()) {",
+        "    Task task = std::move(stack.back());",
+        "    stack.pop_back();",
+        "    switch (task.kind) {",
+        f"    case {kind_scope}L_TASK_KIND_VISIT: dispatch_(task.node); break;",
+        f"    case {kind_scope}L_TASK_KIND_POST_VISIT: {post_visit}(task.node); break;",
+        f"    case {kind_scope}L_TASK_KIND_CALLBACK: task.f(); break;",
+        "    default: liong::unreachable();",
+        "    }",
+        "    // Scheduled tasks run in program order.",
+        "    for (auto it = pending.rbegin(); it != pending.rend(); ++it) {",
+        "      stack.emplace_back(std::move(*it));",
+        "    }",
+        "    pending.clear();",
+        "  }",
+        "  pending_ = prev_pending;",
+        "}",
+        f"{decl}void {qual}dispatch_(const NodeRef& node) {{",
+        "  switch (node->nova) {",
+    ]
+    for _, nova in novas.items():
+        ty_name = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        enum_case_name = "L_NODE_VARIANT_" + nova.ty_name.to_screaming_snake_case()
+        out += [f"  case {enum_case_name}: dispatch_{abbr}_(node.borrow_as<{ty_name}>()); break;"]
+    out += [
+        "  default: liong::unimplemented();",
+        "  }",
+        "}",
+        f"{decl}void {qual}schedule_visit_node_(const NodeRef& node) {{",
+        "  if (pending_ == nullptr) {",
+        "    drive_(node);",
+        "  } else {",
+        f"    pending_->emplace_back(Task {{ {kind_scope}L_TASK_KIND_VISIT, node, nullptr }});",
+        "  }",
+        "}",
+        f"{decl}void {qual}schedule_post_visit_node_(const NodeRef& node) {{",
+        "  if (pending_ == nullptr) {",
+        f"    {post_visit}(node);",
+        "  } else {",
+        f"    pending_->emplace_back(Task {{ {kind_scope}L_TASK_KIND_POST_VISIT, node, nullptr }});",
+        "  }",
+        "}",
+        f"{decl}void {qual}schedule_(std::function<void()>&& f) {{",
+        "  if (pending_ == nullptr) {",
+        "    f();",
+        "  } else {",
+        f"    pending_->emplace_back(Task {{ {kind_scope}L_TASK_KIND_CALLBACK, nullptr, std::move(f) }});",
+        "  }",
+        "}",
+    ]
+    return out
+
+def compose_visit_default_body(nova: NodeVariant, subty: NodeSubtype):
+    ty_name = nova.ty_name.to_pascal_case()
+    out = []
+    for field in subty.fields:
+        if field.ty.raw_name == ty_name:
+            if (field.ty.is_plural):
+                out += [
+                    f"  for (const auto& x : x->{field.name.to_snake_case()}) {{ schedule_visit_(x); }}",
+                ]
+            else:
+                out += [
+                    f"  schedule_visit_(x->{field.name.to_snake_case()});",
+                ]
+    out += [
+        "  schedule_post_visit_(x);",
+    ]
+    return out
+
+# Members of the mutator work-stack driver, see `compose_visitor_driver`.
+def compose_mutator_driver(novas: Dict[str, NodeVariant], qual: str, post_mutate: str):
+    decl = "inline " if qual == "" else ""
+    out = [
+        f"{decl}NodeRef {qual}drive_(const NodeRef& root) {{",
+        "  bool expand = false;",
+        "  NodeRef out = dispatch_(root, expand);",
+        "  if (out != root) { is_changed_ = true; }",
+        "  if (expand) {",
+        "    mutate_children_node_(out);",
+        "  }",
+        "  // Fields might have been written in place.",
+        "  root->invalidate_structured_hash();",
+        "  if (out != nullptr) { out->invalidate_structured_hash(); }",
+        "  return out;",
+        "}",
+        f"{decl}NodeRef {qual}dispatch_(const NodeRef& node, bool& expand) {{",
+        "  expanding_ = node.get();",
+        "  is_expanded_ = false;",
+        "  NodeRef out;",
+        "  switch (node->nova) {",
+    ]
+    for _, nova in novas.items():
+        ty_name = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        enum_case_name = "L_NODE_VARIANT_" + nova.ty_name.to_screaming_snake_case()
+        out += [f"  case {enum_case_name}: out = dispatch_{abbr}_(node.borrow_as<{ty_name}>()); break;"]
+    out += [
+        "  default: liong::unimplemented();",
+        "  }",
+        "  expand = is_expanded_;",
+        "  expanding_ = nullptr;",
+        "  is_expanded_ = false;",
+        "  liong::assert(!expand || out == node,",
+        '    "default mutator implementation must be called as a tail call");',
+        "  return out;",
+        "}",
+        f"{decl}void {qual}mutate_children_node_(const NodeRef& node) {{",
+        '  liong::assert(!node->is_frozen(), "frozen nodes cannot be mutated");',
+        "  // Each frame owns the slots from `islot_beg` to the beginning of the next",
+        "  // frame's slots.",
+        "  struct Frame {",
+        "    NodeRef node;",
+        "    size_t islot_beg;",
+        "    size_t islot;",
+        "  };",
+        "  std::vector<Frame> frames;",
+        "  std::vector<NodeRef*> slots;",
+        "",
+        "  collect_child_slots(node, slots);",
+        "  frames.emplace_back(Frame { node, 0, 0 });",
+        "  while (!frames.empty()) {",
+        "    Frame& frame = frames.back();",
+        "    if (frame.islot < slots.size()) {",
+        "      NodeRef* slot = slots[frame.islot++];",
+        "      NodeRef child = *slot;",
+        "      bool expand = false;",
+        "      NodeRef out = dispatch_(child, expand);",
+        "      if (out != child) { is_changed_ = true; }",
+        "      *slot = out;",
+        "      if (expand) {",
+        "        size_t islot_beg = slots.size();",
+        "        collect_child_slots(out, slots);",
+        "        frames.emplace_back(Frame { out, islot_beg, islot_beg });",
+        "      } else {",
+        "        child->invalidate_structured_hash();",
+        "        if (out != nullptr) { out->invalidate_structured_hash(); }",
+        "      }",
+        "    } else {",
+        "      NodeRef x = std::move(frame.node);",
+        "      slots.resize(frame.islot_beg);",
+        "      frames.pop_back();",
+        "      x->invalidate_structured_hash();",
+        f"      {post_mutate}(x);",
+        "    }",
+        "  }",
+        "}",
+    ]
+    return out
+
+def compose_mutate_default_body(nova: NodeVariant, subty: NodeSubtype):
+    ty_name = nova.ty_name.to_pascal_case()
+    out = []
+    if any(field.ty.is_ref_ty for field in subty.fields):
+        out += [
+            "  if (x->is_frozen()) {",
+            "    // Frozen nodes are shared read-only; keep them as they are.",
+            "  } else if (expanding_ == x.get()) {",
+            "    // Reached from the driver; leave the children to the work stack.",
+            "    is_expanded_ = true;",
+            "  } else {",
+            "    mutate_children_(x);",
+            "  }",
+        ]
+    out += [
+        f"  return x.as<{ty_name}>();",
+    ]
+    return out
+
 def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
     out = compose_general_header2("Node visitor and mutator")
     out += [""]
 
     # Include all novas.
+    out += [ "#include <functional>" ]
     for _, nova in novas.items():
         out += [ f'#include "node/gen/{nova.ty_abbr.to_spinal_case()}.hpp"' ]
     out += [""]
 
     # Visitor base type.
-    out += ["struct Visitor {"]
-    # Node traversal basics.
     out += [
+        "// Nodes are visited with an explicit work stack rather than recursion.",
+        "// An override point `visit_*_` is called when a node is reached; the",
+        "// default implementation schedules the children to be visited after it",
+        "// returns, and `post_visit_` after them. Overrides can schedule work in the",
+        "// same way, or call `visit` to traverse a subtree immediately.",
+        "struct Visitor {",
+        "  enum TaskKind {",
+        "    L_TASK_KIND_VISIT,",
+        "    L_TASK_KIND_POST_VISIT,",
+        "    L_TASK_KIND_CALLBACK,",
+        "  };",
+        "  struct Task {",
+        "    TaskKind kind;",
+        "    NodeRef node;",
+        "    std::function<void()> f;",
+        "  };",
+        "  // Tasks scheduled by the node being dispatched, in program order.",
+        "  std::vector<Task>* pending_ = nullptr;",
+        "",
+        "  void drive_(const NodeRef& root);",
+        "  void dispatch_(const NodeRef& node);",
+        "  void schedule_visit_node_(const NodeRef& node);",
+        "  void schedule_post_visit_node_(const NodeRef& node);",
+        "  // Schedule `f` to run after everything scheduled so far.",
+        "  void schedule_(std::function<void()>&& f);",
         "  template<typename T>",
-        "  void visit(const Reference<T>& node) {",
-        f"    switch (node->nova) {{"
+        "  inline void schedule_visit_(const Reference<T>& node) {",
+        "    schedule_visit_node_(node.template borrow_as<Node>());",
+        "  }",
+        "  template<typename T>",
+        "  inline void schedule_post_visit_(const Reference<T>& node) {",
+        "    schedule_post_visit_node_(node.template borrow_as<Node>());",
+        "  }",
+        "  // Called after the children of a node traversed by default are visited.",
+        "  virtual void post_visit_(const NodeRef& node) {}",
+        "",
     ]
-    for _, nova in novas.items():
-        ty_name = nova.ty_name.to_pascal_case()
-        abbr = nova.ty_abbr.to_snake_case()
-        enum_case_name = "L_NODE_VARIANT_" + nova.ty_name.to_screaming_snake_case()
-        out += [f"    case {enum_case_name}: visit_{abbr}(node.as<{ty_name}>()); break;"]
+    # Node traversal basics.
     out += [
-        "    default: liong::unimplemented();",
-        "    }",
+        "  template<typename T>",
+        "  void visit(const Reference<T>& node) {",
+        "    drive_(node.template borrow_as<Node>());",
         "  }",
     ]
     for _, nova in novas.items():
@@ -145,18 +386,25 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
             f"  inline void visit(const {ty_name}Ref& {abbr}) {{ return visit_{abbr}({abbr}); }}"
         ]
     out += [""]
-    # Typed traversal basics.
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        out += [
+            f"  inline void visit_{abbr}(const {ty_prefix}Ref& {abbr}) {{ drive_({abbr}.borrow_as<Node>()); }}",
+        ]
+    out += [""]
+    # Typed dispatch.
     for _, nova in novas.items():
         ty_prefix = nova.ty_name.to_pascal_case()
         enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
         abbr = nova.ty_abbr.to_snake_case()
         enum_var_name = nova.enum_abbr.to_snake_case()
         out += [
-            f"  inline void visit_{abbr}(const {ty_prefix}Ref& {abbr}) {{",
+            f"  inline void dispatch_{abbr}_(const {ty_prefix}Ref& {abbr}) {{",
             f"    switch ({abbr}->{enum_var_name}) {{",
         ]
         for x in nova.subtys:
-            out += [f"    case {enum_prefix}{x.name.to_screaming_snake_case()}: visit_{abbr}_({abbr}.as<{ty_prefix}{x.name.to_pascal_case()}>()); break;"]
+            out += [f"    case {enum_prefix}{x.name.to_screaming_snake_case()}: visit_{abbr}_({abbr}.borrow_as<{ty_prefix}{x.name.to_pascal_case()}>()); break;"]
         out += [
             "    default: liong::unreachable();",
             "    }",
@@ -166,12 +414,10 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
     # Traversal visitor functions.
     for _, nova in novas.items():
         ty_prefix = nova.ty_name.to_pascal_case()
-        enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
         abbr = nova.ty_abbr.to_snake_case()
-        enum_var_name = nova.enum_abbr.to_snake_case()
         for x in nova.subtys:
             out += [
-                f"  virtual void visit_{abbr}_({ty_prefix}{x.name.to_pascal_case()}Ref);",
+                f"  virtual void visit_{abbr}_(const {ty_prefix}{x.name.to_pascal_case()}Ref&);",
             ]
         out += [""]
     # End of visitor.
@@ -181,21 +427,48 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
     ]
 
     # Mutator base type.
-    out += ["struct Mutator {"]
-    # Node traversal basics.
     out += [
+        "// Nodes are mutated with an explicit work stack rather than recursion.",
+        "// When the driver reaches a node whose override point `mutate_*_` isn't",
+        "// overridden, the children are pushed to the work stack and `post_mutate_`",
+        "// is called once they are all mutated. An override that needs the children",
+        "// mutated before it continues should call `mutate_children_`; calling the",
+        "// base `mutate_*_` is only allowed as a tail call.",
+        "// Collect the fields the default mutator implementations write to.",
+        "extern void collect_child_slots(const NodeRef& node, std::vector<NodeRef*>& slots);",
+        "",
+        "struct Mutator {",
+        "  // The node the driver is dispatching; set until any other node is",
+        "  // dispatched.",
+        "  const Node* expanding_ = nullptr;",
+        "  // Set by a default implementation reached from the driver directly.",
+        "  bool is_expanded_ = false;",
+        "  // Set once any node is replaced or written in place.",
+        "  bool is_changed_ = false;",
+        "",
+        "  NodeRef drive_(const NodeRef& root);",
+        "  NodeRef dispatch_(const NodeRef& node, bool& expand);",
+        "  void mutate_children_node_(const NodeRef& node);",
+        "  // Mutate the children of `node` in place, as the default implementations",
+        "  // do.",
         "  template<typename T>",
-        "  NodeRef mutate(const Reference<T>& node) {",
-        f"    switch (node->nova) {{"
+        "  inline void mutate_children_(const Reference<T>& node) {",
+        "    mutate_children_node_(node.template borrow_as<Node>());",
+        "  }",
+        "  // Called after the children of a node traversed by default are mutated.",
+        "  virtual void post_mutate_(const NodeRef& node) {}",
+        "  // Overrides that write the fields of a node in place rather than",
+        "  // returning a new node must call this.",
+        "  inline void mark_changed() { is_changed_ = true; }",
+        "  // Whether anything has been changed since the mutator was created.",
+        "  inline bool is_changed() const { return is_changed_; }",
+        "",
     ]
-    for _, nova in novas.items():
-        ty_name = nova.ty_name.to_pascal_case()
-        abbr = nova.ty_abbr.to_snake_case()
-        enum_case_name = "L_NODE_VARIANT_" + nova.ty_name.to_screaming_snake_case()
-        out += [f"    case {enum_case_name}: return mutate_{abbr}(node.as<{ty_name}>()).as<Node>();"]
+    # Node traversal basics.
     out += [
-        "    default: liong::unimplemented();",
-        "    }",
+        "  template<typename T>",
+        "  NodeRef mutate(const Reference<T>& node) {",
+        "    return drive_(node.template borrow_as<Node>());",
         "  }",
     ]
     for _, nova in novas.items():
@@ -205,18 +478,27 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
             f"  inline {ty_name}Ref mutate(const {ty_name}Ref& {abbr}) {{ return mutate_{abbr}({abbr}); }}"
         ]
     out += [""]
-    # Typed traversal basics.
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        out += [
+            f"  inline {ty_prefix}Ref mutate_{abbr}(const {ty_prefix}Ref& {abbr}) {{",
+            f"    return drive_({abbr}.borrow_as<Node>()).as<{ty_prefix}>();",
+            "  }",
+        ]
+    out += [""]
+    # Typed dispatch.
     for _, nova in novas.items():
         ty_prefix = nova.ty_name.to_pascal_case()
         enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
         abbr = nova.ty_abbr.to_snake_case()
         enum_var_name = nova.enum_abbr.to_snake_case()
         out += [
-            f"  inline {ty_prefix}Ref mutate_{abbr}(const {ty_prefix}Ref& {abbr}) {{",
+            f"  inline {ty_prefix}Ref dispatch_{abbr}_(const {ty_prefix}Ref& {abbr}) {{",
             f"    switch ({abbr}->{enum_var_name}) {{",
         ]
         for x in nova.subtys:
-            out += [f"    case {enum_prefix}{x.name.to_screaming_snake_case()}: return mutate_{abbr}_({abbr}.as<{ty_prefix}{x.name.to_pascal_case()}>());"]
+            out += [f"    case {enum_prefix}{x.name.to_screaming_snake_case()}: return mutate_{abbr}_({abbr}.borrow_as<{ty_prefix}{x.name.to_pascal_case()}>());"]
         out += [
             "    default: liong::unreachable();",
             "    }",
@@ -226,13 +508,11 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
     # Traversal visitor functions.
     for _, nova in novas.items():
         ty_prefix = nova.ty_name.to_pascal_case()
-        enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
         abbr = nova.ty_abbr.to_snake_case()
-        enum_var_name = nova.enum_abbr.to_snake_case()
         for x in nova.subtys:
             subty_prefix = ty_prefix + x.name.to_pascal_case()
             out += [
-                f"  virtual {ty_prefix}Ref mutate_{abbr}_({subty_prefix}Ref);",
+                f"  virtual {ty_prefix}Ref mutate_{abbr}_(const {subty_prefix}Ref&);",
             ]
         out += [""]
     # End of visitor.
@@ -252,7 +532,7 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
             f"  {ty_prefix}FunctorVisitor(std::function<void(Reference<T>)>&& f) :",
             f"    f(std::forward<std::function<void(Reference<T>)>>(f)) {{}}",
             "",
-            f"  virtual void visit_{abbr}_(Reference<T> {abbr}) override final {{ f({abbr}); }}",
+            f"  virtual void visit_{abbr}_(const Reference<T>& {abbr}) override final {{ f({abbr}); }}",
             "};",
             f"template<typename T>",
             f"void visit_{abbr}_functor(",
@@ -295,6 +575,487 @@ def compose_visitor_hpp(novas: Dict[str, NodeVariant]):
         f.write('\n'.join(out))
 
 
+def compose_static_visitor_hpp(novas: Dict[str, NodeVariant]):
+    out = compose_general_header2("Statically dispatched node visitor and mutator")
+    out += [""]
+    out += [ '#include "visitor/gen/visitor.hpp"' ]
+    out += [""]
+
+    # Static visitor base type.
+    out += [
+        "// Same traversal as `Visitor`, but override points are resolved at compile",
+        "// time through `TDerived` so the default implementations can be inlined.",
+        "// Override points hide the base overloads of the same name; bring them",
+        "// back with `using StaticVisitor::visit_*_;`.",
+        "template<typename TDerived>",
+        "struct StaticVisitor {",
+        "  typedef Visitor::Task Task;",
+        "  // Tasks scheduled by the node being dispatched, in program order.",
+        "  std::vector<Task>* pending_ = nullptr;",
+        "",
+        "  inline TDerived& derived_() { return *static_cast<TDerived*>(this); }",
+        "",
+    ]
+    out += indent(compose_visitor_driver(novas, "", "Visitor::", "derived_().post_visit_"), 2)
+    out += [
+        "  template<typename T>",
+        "  inline void schedule_visit_(const Reference<T>& node) {",
+        "    schedule_visit_node_(node.template borrow_as<Node>());",
+        "  }",
+        "  template<typename T>",
+        "  inline void schedule_post_visit_(const Reference<T>& node) {",
+        "    schedule_post_visit_node_(node.template borrow_as<Node>());",
+        "  }",
+        "  // Called after the children of a node traversed by default are visited.",
+        "  inline void post_visit_(const NodeRef& node) {}",
+        "",
+        "  template<typename T>",
+        "  void visit(const Reference<T>& node) {",
+        "    drive_(node.template borrow_as<Node>());",
+        "  }",
+    ]
+    for _, nova in novas.items():
+        ty_name = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        out += [
+            f"  inline void visit(const {ty_name}Ref& {abbr}) {{ return visit_{abbr}({abbr}); }}"
+        ]
+    out += [""]
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        out += [
+            f"  inline void visit_{abbr}(const {ty_prefix}Ref& {abbr}) {{ drive_({abbr}.template borrow_as<Node>()); }}",
+        ]
+    out += [""]
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
+        abbr = nova.ty_abbr.to_snake_case()
+        enum_var_name = nova.enum_abbr.to_snake_case()
+        out += [
+            f"  inline void dispatch_{abbr}_(const {ty_prefix}Ref& {abbr}) {{",
+            f"    switch ({abbr}->{enum_var_name}) {{",
+        ]
+        for x in nova.subtys:
+            out += [f"    case {enum_prefix}{x.name.to_screaming_snake_case()}: derived_().visit_{abbr}_({abbr}.template borrow_as<{ty_prefix}{x.name.to_pascal_case()}>()); break;"]
+        out += [
+            "    default: liong::unreachable();",
+            "    }",
+            "  }",
+        ]
+    out += [""]
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        for subty in nova.subtys:
+            out += [f"  inline void visit_{abbr}_(const {ty_prefix}{subty.name.to_pascal_case()}Ref& x) {{"]
+            out += indent(compose_visit_default_body(nova, subty), 2)
+            out += ["  }"]
+        out += [""]
+    out += [
+        "};",
+        "",
+    ]
+
+    # Static mutator base type.
+    out += [
+        "// Same traversal as `Mutator`, but override points are resolved at compile",
+        "// time through `TDerived` so the default implementations can be inlined.",
+        "// Override points hide the base overloads of the same name; bring them",
+        "// back with `using StaticMutator::mutate_*_;`.",
+        "template<typename TDerived>",
+        "struct StaticMutator {",
+        "  // The node the driver is dispatching; set until any other node is",
+        "  // dispatched.",
+        "  const Node* expanding_ = nullptr;",
+        "  // Set by a default implementation reached from the driver directly.",
+        "  bool is_expanded_ = false;",
+        "  // Set once any node is replaced or written in place.",
+        "  bool is_changed_ = false;",
+        "",
+        "  inline TDerived& derived_() { return *static_cast<TDerived*>(this); }",
+        "",
+    ]
+    out += indent(compose_mutator_driver(novas, "", "derived_().post_mutate_"), 2)
+    out += [
+        "  // Mutate the children of `node` in place, as the default implementations",
+        "  // do.",
+        "  template<typename T>",
+        "  inline void mutate_children_(const Reference<T>& node) {",
+        "    mutate_children_node_(node.template borrow_as<Node>());",
+        "  }",
+        "  // Called after the children of a node traversed by default are mutated.",
+        "  inline void post_mutate_(const NodeRef& node) {}",
+        "  // Overrides that write the fields of a node in place rather than",
+        "  // returning a new node must call this.",
+        "  inline void mark_changed() { is_changed_ = true; }",
+        "  // Whether anything has been changed since the mutator was created.",
+        "  inline bool is_changed() const { return is_changed_; }",
+        "",
+        "  template<typename T>",
+        "  NodeRef mutate(const Reference<T>& node) {",
+        "    return drive_(node.template borrow_as<Node>());",
+        "  }",
+    ]
+    for _, nova in novas.items():
+        ty_name = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        out += [
+            f"  inline {ty_name}Ref mutate(const {ty_name}Ref& {abbr}) {{ return mutate_{abbr}({abbr}); }}"
+        ]
+    out += [""]
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        out += [
+            f"  inline {ty_prefix}Ref mutate_{abbr}(const {ty_prefix}Ref& {abbr}) {{",
+            f"    return drive_({abbr}.template borrow_as<Node>()).template as<{ty_prefix}>();",
+            "  }",
+        ]
+    out += [""]
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
+        abbr = nova.ty_abbr.to_snake_case()
+        enum_var_name = nova.enum_abbr.to_snake_case()
+        out += [
+            f"  inline {ty_prefix}Ref dispatch_{abbr}_(const {ty_prefix}Ref& {abbr}) {{",
+            f"    switch ({abbr}->{enum_var_name}) {{",
+        ]
+        for x in nova.subtys:
+            out += [f"    case {enum_prefix}{x.name.to_screaming_snake_case()}: return derived_().mutate_{abbr}_({abbr}.template borrow_as<{ty_prefix}{x.name.to_pascal_case()}>());"]
+        out += [
+            "    default: liong::unreachable();",
+            "    }",
+            "  }",
+        ]
+    out += [""]
+    for _, nova in novas.items():
+        ty_prefix = nova.ty_name.to_pascal_case()
+        abbr = nova.ty_abbr.to_snake_case()
+        for subty in nova.subtys:
+            out += [f"  inline {ty_prefix}Ref mutate_{abbr}_(const {ty_prefix}{subty.name.to_pascal_case()}Ref& x) {{"]
+            out += indent(compose_mutate_default_body(nova, subty), 2)
+            out += ["  }"]
+        out += [""]
+    out += [
+        "};",
+        "",
+    ]
+
+    with open(f"./include/visitor/gen/static-visitor.hpp", "w") as f:
+        f.write('\n'.join(out))
+
+
+POOL_LITERAL_TYS = set(["bool", "int32_t", "uint32_t", "int64_t", "uint64_t", "float", "double"])
+
+# Classify the fields of an expression subtype for the flat pool. Returns the
+# operand fields and the payload field (`None` if there is none), or `None` if
+# the subtype can't be pooled. Default constructable subtypes are patterns,
+# their fields might be left empty.
+def classify_pool_fields(subty: NodeSubtype):
+    if subty.is_default_constructable:
+        return None
+    operands = []
+    payloads = []
+    for field in subty.fields:
+        if field.ty.is_plural:
+            return None
+        elif field.ty.is_ref_ty and field.ty.raw_name == "Expr":
+            operands += [field]
+        elif field.ty.is_ref_ty or field.ty.raw_name in POOL_LITERAL_TYS:
+            payloads += [field]
+        else:
+            return None
+    if len(payloads) > 1:
+        return None
+    return (operands, payloads[0] if payloads else None)
+
+def compose_expr_pool(novas: Dict[str, NodeVariant]):
+    nova = novas["Expr"]
+    ty_name = nova.ty_name.to_pascal_case()
+    enum_name = ty_name + nova.enum_name.to_pascal_case()
+    enum_case_prefix = f"L_{nova.ty_name.to_screaming_snake_case()}_{nova.enum_name.to_screaming_snake_case()}_"
+    pool_fields = [(subty, classify_pool_fields(subty)) for subty in nova.subtys]
+
+    out = compose_general_header2("Flat expression pool")
+    out += [
+        "#include <unordered_map>",
+        '#include "node/gen/expr.hpp"',
+        "",
+        "// Index of an expression in an `ExprPool`.",
+        "typedef uint32_t ExprIndex;",
+        "",
+        "enum ExprPayloadKind {",
+        "  L_EXPR_PAYLOAD_KIND_NONE,",
+        "  L_EXPR_PAYLOAD_KIND_LITERAL,",
+        "  L_EXPR_PAYLOAD_KIND_REF,",
+        "};",
+        "",
+        f"inline uint32_t get_expr_noperand({enum_name} op) {{",
+        "  switch (op) {",
+    ]
+    for subty, fields in pool_fields:
+        if fields is not None and len(fields[0]) > 0:
+            out += [f"  case {enum_case_prefix}{subty.name.to_screaming_snake_case()}: return {len(fields[0])};"]
+    out += [
+        "  default: return 0;",
+        "  }",
+        "}",
+        f"inline ExprPayloadKind get_expr_payload_kind({enum_name} op) {{",
+        "  switch (op) {",
+    ]
+    for subty, fields in pool_fields:
+        if fields is not None and fields[1] is not None:
+            kind = "REF" if fields[1].ty.is_ref_ty else "LITERAL"
+            out += [f"  case {enum_case_prefix}{subty.name.to_screaming_snake_case()}: return L_EXPR_PAYLOAD_KIND_{kind};"]
+    out += [
+        "  default: return L_EXPR_PAYLOAD_KIND_NONE;",
+        "  }",
+        "}",
+        "",
+        "// Expressions stored as parallel arrays linked by 32-bit indices instead of",
+        "// pointers. Operands always precede their users so bulk analyses can run",
+        "// bottom-up in a single linear scan. Expressions shared in the source trees",
+        "// are shared in the pool too. Pattern expressions can't be pooled.",
+        "struct ExprPool {",
+        "  // Attributes of each expression, indexed by `ExprIndex`.",
+        f"  std::vector<{enum_name}> op;",
+        "  // Index into `ty_table`.",
+        "  std::vector<uint32_t> ty;",
+        "  // Index of the first operand in `operands`; see `get_expr_noperand`.",
+        "  std::vector<uint32_t> operand_begin;",
+        "  // Bits of the literal, or an index into `ref_table` for a non-operand",
+        "  // node field; see `get_expr_payload_kind`.",
+        "  std::vector<uint64_t> payload;",
+        "",
+        "  std::vector<ExprIndex> operands;",
+        "  std::vector<TypeRef> ty_table;",
+        "  std::vector<NodeRef> ref_table;",
+        "  // Pooled expressions, indexed by `ExprIndex`. Like the tables above, they",
+        "  // are held by the pool so that the address of a pooled node can't be",
+        "  // reused by another node while it's a key of `expr_idx_map`.",
+        "  std::vector<ExprRef> expr_table;",
+        "",
+        "  std::unordered_map<const Node*, ExprIndex> expr_idx_map;",
+        "  std::unordered_map<const Node*, uint32_t> ty_idx_map;",
+        "  std::unordered_map<const Node*, uint32_t> ref_idx_map;",
+        "",
+        "  inline size_t size() const { return op.size(); }",
+        "  inline const ExprIndex* get_operands(ExprIndex i) const {",
+        "    return operands.data() + operand_begin[i];",
+        "  }",
+        "",
+        "  // Append `expr` and its operands if they are not pooled yet. Returns the",
+        "  // index of `expr`.",
+        "  ExprIndex push(const ExprRef& expr);",
+        "  // Rebuild the expression tree rooted at the `i`-th expression.",
+        "  ExprRef to_tree(ExprIndex i) const;",
+        "",
+        "  // Structural hashes of all expressions in a single scan. Equal for",
+        "  // structurally equal expressions of the pool.",
+        "  std::vector<uint64_t> compute_structured_hashes() const;",
+        "",
+        "private:",
+        "  uint32_t intern_ty_(const TypeRef& ty);",
+        "  uint32_t intern_ref_(const NodeRef& ref);",
+        "  void append_(const Expr& expr);",
+        "};",
+        "",
+    ]
+    with open(f"./include/node/gen/expr-pool.hpp", "w") as f:
+        f.write('\n'.join(out))
+
+    max_noperand = max(len(fields[0]) for _, fields in pool_fields if fields is not None)
+    out = compose_general_header2("Flat expression pool implementation")[:-1]
+    out += [
+        "#include <cstring>",
+    ]
+    for _, nova2 in novas.items():
+        out += [ f'#include "node/gen/{nova2.ty_abbr.to_spinal_case()}.hpp"' ]
+    out += [
+        '#include "node/gen/expr-pool.hpp"',
+        "",
+        "template<typename T>",
+        "static uint64_t encode_payload(const T& x) {",
+        "  uint64_t out = 0;",
+        "  std::memcpy(&out, &x, sizeof(T));",
+        "  return out;",
+        "}",
+        "template<typename T>",
+        "static T decode_payload(uint64_t x) {",
+        "  T out;",
+        "  std::memcpy(&out, &x, sizeof(T));",
+        "  return out;",
+        "}",
+        "",
+        "// Operands of `expr` in pool order. Returns the number of operands.",
+        f"static uint32_t collect_operands(const Expr& expr, const Expr* (&out)[{max_noperand}]) {{",
+        "  switch (expr.op) {",
+    ]
+    for subty, fields in pool_fields:
+        subty_name = ty_name + subty.name.to_pascal_case()
+        enum_case = enum_case_prefix + subty.name.to_screaming_snake_case()
+        if fields is None:
+            out += [
+                f"  case {enum_case}:",
+                f'    liong::panic("`{subty_name}` cannot be pooled");',
+            ]
+        elif len(fields[0]) > 0:
+            out += [
+                f"  case {enum_case}:",
+                "  {",
+                f"    const auto& x = expr.as<{subty_name}>();",
+            ]
+            for i, field in enumerate(fields[0]):
+                out += [f"    out[{i}] = x.{field.name.to_snake_case()}.get();"]
+            out += [
+                f"    return {len(fields[0])};",
+                "  }",
+            ]
+    out += [
+        "  default: return 0;",
+        "  }",
+        "}",
+        "",
+        "uint32_t ExprPool::intern_ty_(const TypeRef& ty) {",
+        "  auto it = ty_idx_map.find(ty.get_alloc());",
+        "  if (it != ty_idx_map.end()) { return it->second; }",
+        "  uint32_t i = (uint32_t)ty_table.size();",
+        "  ty_table.emplace_back(ty);",
+        "  ty_idx_map.emplace(ty.get_alloc(), i);",
+        "  return i;",
+        "}",
+        "uint32_t ExprPool::intern_ref_(const NodeRef& ref) {",
+        "  auto it = ref_idx_map.find(ref.get_alloc());",
+        "  if (it != ref_idx_map.end()) { return it->second; }",
+        "  uint32_t i = (uint32_t)ref_table.size();",
+        "  ref_table.emplace_back(ref);",
+        "  ref_idx_map.emplace(ref.get_alloc(), i);",
+        "  return i;",
+        "}",
+        "void ExprPool::append_(const Expr& expr) {",
+        f"  const Expr* x[{max_noperand}];",
+        "  uint32_t noperand = collect_operands(expr, x);",
+        "  ExprIndex i = (ExprIndex)op.size();",
+        "  op.emplace_back(expr.op);",
+        "  ty.emplace_back(intern_ty_(expr.ty));",
+        "  operand_begin.emplace_back((uint32_t)operands.size());",
+        "  for (uint32_t j = 0; j < noperand; ++j) {",
+        "    operands.emplace_back(expr_idx_map.at(x[j]));",
+        "  }",
+        "  switch (expr.op) {",
+    ]
+    for subty, fields in pool_fields:
+        if fields is None or fields[1] is None:
+            continue
+        subty_name = ty_name + subty.name.to_pascal_case()
+        enum_case = enum_case_prefix + subty.name.to_screaming_snake_case()
+        field = fields[1]
+        field_name = field.name.to_snake_case()
+        if field.ty.is_ref_ty:
+            value = f"intern_ref_(expr.as<{subty_name}>().{field_name})"
+        else:
+            value = f"encode_payload(expr.as<{subty_name}>().{field_name})"
+        out += [f"  case {enum_case}: payload.emplace_back({value}); break;"]
+    out += [
+        "  default: payload.emplace_back(0); break;",
+        "  }",
+        "  expr_table.emplace_back((Expr*)&expr);",
+        "  expr_idx_map.emplace(&expr, i);",
+        "}",
+        "",
+        "ExprIndex ExprPool::push(const ExprRef& expr) {",
+        "  // Post-order traversal with an explicit stack; the flag is set once the",
+        "  // operands of the expression have been scheduled.",
+        "  std::vector<std::pair<const Expr*, bool>> stack;",
+        "  stack.emplace_back(expr.get(), false);",
+        "  while (!stack.empty()) {",
+        "    auto& frame = stack.back();",
+        "    const Expr* x = frame.first;",
+        "    if (expr_idx_map.find(x) != expr_idx_map.end()) {",
+        "      stack.pop_back();",
+        "    } else if (frame.second) {",
+        "      stack.pop_back();",
+        "      append_(*x);",
+        "    } else {",
+        "      frame.second = true;",
+        f"      const Expr* x2[{max_noperand}];",
+        "      uint32_t noperand = collect_operands(*x, x2);",
+        "      for (uint32_t j = noperand; j-- > 0;) {",
+        "        stack.emplace_back(x2[j], false);",
+        "      }",
+        "    }",
+        "  }",
+        "  return expr_idx_map.at(expr.get());",
+        "}",
+        "",
+        "ExprRef ExprPool::to_tree(ExprIndex root) const {",
+        "  // Operands precede their users, so reachability can be marked from the",
+        "  // root backwards and the reachable nodes built forwards.",
+        "  std::vector<bool> is_reachable(root + 1, false);",
+        "  is_reachable[root] = true;",
+        "  for (ExprIndex i = root + 1; i-- > 0;) {",
+        "    if (!is_reachable[i]) { continue; }",
+        "    const ExprIndex* x = get_operands(i);",
+        "    for (uint32_t j = 0; j < get_expr_noperand(op[i]); ++j) {",
+        "      is_reachable[x[j]] = true;",
+        "    }",
+        "  }",
+        "",
+        "  std::vector<ExprRef> exprs(root + 1);",
+        "  for (ExprIndex i = 0; i <= root; ++i) {",
+        "    if (!is_reachable[i]) { continue; }",
+        "    const ExprIndex* x = get_operands(i);",
+        "    switch (op[i]) {",
+    ]
+    for subty, fields in pool_fields:
+        if fields is None:
+            continue
+        subty_name = ty_name + subty.name.to_pascal_case()
+        enum_case = enum_case_prefix + subty.name.to_screaming_snake_case()
+        args = ["ty_table[ty[i]]"]
+        ioperand = 0
+        for field in subty.fields:
+            if field in fields[0]:
+                args += [f"exprs[x[{ioperand}]]"]
+                ioperand += 1
+            elif field.ty.is_ref_ty:
+                args += [f"ref_table[payload[i]].as<{field.ty.raw_name}>()"]
+            else:
+                args += [f"decode_payload<{field.ty.field_ty}>(payload[i])"]
+        out += [f"    case {enum_case}: exprs[i] = new {subty_name}({', '.join(args)}); break;"]
+    out += [
+        "    default: liong::unreachable();",
+        "    }",
+        "  }",
+        "  return exprs[root];",
+        "}",
+        "",
+        "std::vector<uint64_t> ExprPool::compute_structured_hashes() const {",
+        "  std::vector<uint64_t> out(size());",
+        "  for (ExprIndex i = 0; i < size(); ++i) {",
+        "    uint64_t hash = hash_combine(hash_node_field(op[i]), hash_node_field(ty_table[ty[i]]));",
+        "    switch (get_expr_payload_kind(op[i])) {",
+        "    case L_EXPR_PAYLOAD_KIND_LITERAL: hash = hash_combine(hash, payload[i]); break;",
+        "    case L_EXPR_PAYLOAD_KIND_REF: hash = hash_combine(hash, ref_table[payload[i]]->structured_hash()); break;",
+        "    default: break;",
+        "    }",
+        "    const ExprIndex* x = get_operands(i);",
+        "    for (uint32_t j = 0; j < get_expr_noperand(op[i]); ++j) {",
+        "      hash = hash_combine(hash, out[x[j]]);",
+        "    }",
+        "    out[i] = hash;",
+        "  }",
+        "  return out;",
+        "}",
+        "",
+    ]
+    with open(f"./src/node/gen/expr-pool.cpp", "w") as f:
+        f.write('\n'.join(out))
+
+
 def compose_enum_reg(nova: NodeVariant):
     enum_name = f"{nova.ty_name.to_pascal_case()}{nova.enum_name.to_pascal_case()}"
     enum_case_prefix = f"L_{nova.ty_name.to_screaming_snake_case()}_{nova.enum_name.to_screaming_snake_case()}_"
@@ -349,7 +1110,7 @@ def compose_node_ty_declr(nova: NodeVariant):
         f"  ) : Node(L_NODE_VARIANT_{nova.ty_name.to_screaming_snake_case()}), {enum_var_name}({enum_var_name})",
     ]
     for field in nova.fields:
-        out[-1] += f", {field.name.to_snake_case()}({field.name.to_snake_case()})"
+        out[-1] += f", {field.name.to_snake_case()}({field.to_ctor_arg()})"
     out += [
         "  {"
     ]
@@ -357,7 +1118,7 @@ def compose_node_ty_declr(nova: NodeVariant):
         if field.ty.is_ref_ty:
             if field.ty.is_plural:
                 out += [
-                    f"    for (const auto& x : {field.name.to_snake_case()}) {{ liong::assert(x != nullptr); }}"
+                    f"    for (const auto& x : {field.to_ctor_member()}) {{ liong::assert(x != nullptr); }}"
                 ]
             else:
                 out += [
@@ -374,8 +1135,11 @@ def compose_node_ty_declr(nova: NodeVariant):
 
 def compose_reg_hpp(novas: Dict[str, NodeVariant]):
     for _, nova in novas.items():
+        includes = [ f'#include "node/node.hpp"' ]
+        if any(field.ty.is_access_chain for field in nova.fields):
+            includes += [ f'#include "node/access-chain.hpp"' ]
         out = compose_general_header(nova, "node registry") + \
-            [ f'#include "node/node.hpp"', "" ] + \
+            includes + [ "" ] + \
             compose_enum_reg(nova) + \
             compose_node_ty_declr(nova)
         with open(f"./include/node/gen/{nova.ty_abbr.to_spinal_case()}-reg.hpp", "w") as f:
@@ -427,17 +1191,17 @@ def compose_hpp(novas: Dict[str, NodeVariant]):
             out += [f"  ) : {ty_name}({enum_case}"]
             for field in nova.fields:
                 field_name = field.name.to_snake_case()
-                out[-1] += f", {field_name}"
+                out[-1] += f", {field.to_ctor_arg()}"
             out[-1] += ")"
             for field in subty.fields:
                 field_name = field.name.to_snake_case()
-                out[-1] += f", {field_name}({field_name})"
+                out[-1] += f", {field_name}({field.to_ctor_arg()})"
             out[-1] += " {"
             for field in subty.fields:
                 field_name = field.name.to_snake_case()
                 if field.ty.is_ref_ty:
                     if field.ty.is_plural:
-                        out += [f"    for (const auto& x : {field_name}) {{ liong::assert(x != nullptr); }}"]
+                        out += [f"    for (const auto& x : {field.to_ctor_member()}) {{ liong::assert(x != nullptr); }}"]
                     else:
                         out += [f"    liong::assert({field_name} != nullptr);"]
             out += [
@@ -450,17 +1214,26 @@ def compose_hpp(novas: Dict[str, NodeVariant]):
                 out[-1] += ', '.join(f"{field.ty.param_ty} {field.name.to_snake_case()}" for field in nova.fields)
                 out[-1] += f") : {ty_name}({enum_case}"
                 for field in nova.fields:
-                    out[-1] += f", {field.name.to_snake_case()}"
+                    out[-1] += f", {field.to_ctor_arg()}"
                 out[-1] += ") {}"
             out += [
                 "",
                 f"  virtual bool structured_eq({ty_name}Ref b_) const override final {{",
                 f"    if (!b_->is<{subty_name}>()) {{ return false; }}",
+            ]
+            if not nova.is_interned:
+                out += [
+                    "    if (this == b_.get()) { return true; }",
+                    "    if (structured_hash() != b_->structured_hash()) { return false; }",
+                ]
+            out += [
                 f"    const auto& b2_ = b_->as<{subty_name}>();",
             ]
             for field in nova.fields + subty.fields:
                 field_name = field.name.to_snake_case()
-                if field.ty.is_ref_ty:
+                if field.ty.is_access_chain:
+                    out += [f"    if (!{field_name}.structured_eq(b2_.{field_name})) {{ return false; }}"]
+                elif field.ty.is_ref_ty and not field.ty.is_interned:
                     if field.ty.is_plural:
                         out += [
                             f"    if ({field_name}.size() != b2_.{field_name}.size()) {{ return false; }}",
@@ -475,11 +1248,39 @@ def compose_hpp(novas: Dict[str, NodeVariant]):
             out += [
                 "    return true;",
                 "  }",
+            ]
+            # Children of interned nodes are interned too, so they are hashed
+            # by identity. `Node::fill_structured_hashes` fills the caches of
+            # the other children ahead in post-order, so the hash combines
+            # cached values and never recurses.
+            out += [
+                "  virtual uint64_t compute_structured_hash() const override final {",
+                f"    uint64_t out = hash_node_field({enum_case});",
+            ]
+            for field in nova.fields + subty.fields:
+                field_name = field.name.to_snake_case()
+                if field.ty.is_ref_ty and not field.ty.is_interned:
+                    hash_fn = "hash_node_structure"
+                else:
+                    hash_fn = "hash_node_field"
+                if field.ty.is_access_chain:
+                    out += [f"    out = hash_combine(out, {field_name}.structured_hash());"]
+                elif field.ty.is_plural:
+                    out += [f"    for (const auto& x : {field_name}) {{ out = hash_combine(out, {hash_fn}(x)); }}"]
+                else:
+                    out += [f"    out = hash_combine(out, {hash_fn}({field_name}));"]
+            out += [
+                "    return out;",
+                "  }",
+            ]
+            out += [
                 "  virtual void collect_children(NodeDrain* drain) const override final {",
             ]
             for field in nova.fields:
                 field_name = field.name.to_snake_case()
-                if field.ty.is_ref_ty:
+                if field.ty.is_access_chain:
+                    out += [f"    {field_name}.collect_indices(drain);"]
+                elif field.ty.is_ref_ty:
                     if field.ty.is_plural:
                         out += [f"    for (const auto& x : {field_name}) {{ drain->push(x); }}"]
                     else:
@@ -498,10 +1299,10 @@ def compose_hpp(novas: Dict[str, NodeVariant]):
             ]
 
         # Category identifier functions.
-        categories = defaultdict(set)
+        categories = defaultdict(list)
         for subty in nova.subtys:
             for category in subty.categories:
-                categories[category.to_snake_case()].add(subty)
+                categories[category.to_snake_case()].append(subty)
         
         for category, category_members in sorted(categories.items(), key=lambda x: x[0]):
             out += [
@@ -529,24 +1330,19 @@ def compose_visitor_cpp(novas: Dict[str, NodeVariant]):
     out = compose_general_header2("Node visitor implementation") + \
         [ f'#include "visitor/gen/visitor.hpp"', "" ]
 
+    # Visitor driver.
+    out += compose_visitor_driver(novas, "Visitor::", "", "post_visit_")
+    out += [""]
+
     # Visitor implementation.
     for _, nova in novas.items():
         ty_name = nova.ty_name.to_pascal_case()
         for subty in nova.subtys:
             subty_name = ty_name + subty.name.to_pascal_case()
             out += [
-                f"void Visitor::visit_{nova.ty_abbr.to_snake_case()}_({subty_name}Ref x) {{",
+                f"void Visitor::visit_{nova.ty_abbr.to_snake_case()}_(const {subty_name}Ref& x) {{",
             ]
-            for field in subty.fields:
-                if field.ty.raw_name == ty_name:
-                    if (field.ty.is_plural):
-                        out += [
-                            f"  for (const auto& x : x->{field.name.to_snake_case()}) {{ visit_{nova.ty_abbr.to_snake_case()}(x); }}",
-                        ]
-                    else:
-                        out += [
-                            f"  visit_{nova.ty_abbr.to_snake_case()}(x->{field.name.to_snake_case()});",
-                        ]
+            out += compose_visit_default_body(nova, subty)
             out += [
                 "}",
             ]
@@ -554,35 +1350,72 @@ def compose_visitor_cpp(novas: Dict[str, NodeVariant]):
             ""
         ]
 
-    # Mutator implementation.
+    # Mutator driver.
+    out += [
+        "void collect_child_slots(const NodeRef& node, std::vector<NodeRef*>& slots) {",
+        "  switch (node->nova) {",
+    ]
     for _, nova in novas.items():
         ty_name = nova.ty_name.to_pascal_case()
+        enum_prefix = "L_" + nova.ty_name.to_screaming_snake_case() + "_" + nova.enum_name.to_screaming_snake_case() + "_"
+        enum_var_name = nova.enum_abbr.to_snake_case()
+        enum_case_name = "L_NODE_VARIANT_" + nova.ty_name.to_screaming_snake_case()
+        out += [
+            f"  case {enum_case_name}:",
+            f"    switch (((const {ty_name}*)node.get())->{enum_var_name}) {{",
+        ]
         for subty in nova.subtys:
             subty_name = ty_name + subty.name.to_pascal_case()
+            ref_fields = [field for field in subty.fields if field.ty.is_ref_ty]
+            if len(ref_fields) == 0:
+                continue
             out += [
-                f"{ty_name}Ref Mutator::mutate_{nova.ty_abbr.to_snake_case()}_({subty_name}Ref x) {{",
+                f"    case {enum_prefix}{subty.name.to_screaming_snake_case()}:",
+                "    {",
+                f"      const auto* x = (const {subty_name}*)node.get();",
             ]
-            for field in subty.fields:
+            for field in ref_fields:
                 field_name = field.name.to_snake_case()
-                if field.ty.is_ref_ty:
-                    if (field.ty.is_plural):
-                        out += [
-                            f"  for (auto& x : x->{field_name}) {{ x = mutate_{novas[field.ty.raw_name].ty_abbr.to_snake_case()}(x); }}",
-                        ]
-                    else:
-                        out += [
-                            f"  x->{field_name} = mutate_{novas[field.ty.raw_name].ty_abbr.to_snake_case()}(x->{field_name});",
-                        ]
+                if field.ty.is_plural:
+                    out += [f"      for (auto& x2 : x->{field_name}) {{ slots.emplace_back((NodeRef*)&x2); }}"]
+                else:
+                    out += [f"      slots.emplace_back((NodeRef*)&x->{field_name});"]
+            out += [
+                "      break;",
+                "    }",
+            ]
+        out += [
+            "    default: break;",
+            "    }",
+            "    break;",
+        ]
+    out += [
+        "  default: liong::unimplemented();",
+        "  }",
+        "}",
+        "",
+    ]
+    out += compose_mutator_driver(novas, "Mutator::", "post_mutate_")
+    out += [""]
+
+    # Mutator implementation.
+    for _, nova in novas.items():
+        ty_name = nova.ty_name.to_pascal_case()
+        for subty in nova.subtys:
+            subty_name = ty_name + subty.name.to_pascal_case()
+            out += [
+                f"{ty_name}Ref Mutator::mutate_{nova.ty_abbr.to_snake_case()}_(const {subty_name}Ref& x) {{",
+            ]
+            out += compose_mutate_default_body(nova, subty)
             out += [
-                f"  return x.as<{ty_name}>();",
                 "}",
             ]
         out += [
             ""
         ]
 
-        with open(f"./src/visitor/gen/visitor.cpp", "w") as f:
-            f.write('\n'.join(out))
+    with open(f"./src/visitor/gen/visitor.cpp", "w") as f:
+        f.write('\n'.join(out))
 
 
 
@@ -594,7 +1427,7 @@ novas = {
         "enum_abbr": "cls",
         "fields": {
             "ty": "Type",
-            "ac": "Expr[]",
+            "ac": "AccessChain",
         },
         "variants": {
             "pattern_capture": {
@@ -605,7 +1438,7 @@ novas = {
             },
             "function_variable": {
                 "fields": {
-                    "handle": "std::shared_ptr<uint8_t>",
+                    "handle": "NodeHandle",
                 }
             },
             "iteration_variable": {
@@ -642,6 +1475,7 @@ novas = {
         },
     },
     "Type": {
+        "is_interned": True,
         "ty_name": "type",
         "ty_abbr": "ty",
         "enum_name": "class",
@@ -842,7 +1676,7 @@ novas = {
                 "fields": {
                     "body_block": "Stmt",
                     "continue_block": "Stmt",
-                    "handle": "std::shared_ptr<uint8_t>",
+                    "handle": "NodeHandle",
                 }
             },
             "conditional_loop": {
@@ -850,7 +1684,7 @@ novas = {
                     "cond": "Expr",
                     "body_block": "Stmt",
                     "continue_block": "Stmt",
-                    "handle": "std::shared_ptr<uint8_t>",
+                    "handle": "NodeHandle",
                 }
             },
             "return": {
@@ -858,17 +1692,17 @@ novas = {
             },
             "loop_merge": {
                 "fields": {
-                    "handle": "std::shared_ptr<uint8_t>",
+                    "handle": "NodeHandle",
                 }
             },
             "loop_continue": {
                 "fields": {
-                    "handle": "std::shared_ptr<uint8_t>",
+                    "handle": "NodeHandle",
                 }
             },
             "loop_back_edge": {
                 "fields": {
-                    "handle": "std::shared_ptr<uint8_t>",
+                    "handle": "NodeHandle",
                 }
             },
             "ranged_loop": {
@@ -889,6 +1723,8 @@ novas = {
 
 mem_nova = json2nova(novas)
 compose_visitor_hpp(mem_nova)
+compose_static_visitor_hpp(mem_nova)
 compose_visitor_cpp(mem_nova)
 compose_reg_hpp(mem_nova)
 compose_hpp(mem_nova)
+compose_expr_pool(mem_nova)
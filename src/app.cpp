@@ -2,15 +2,26 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
 #include "gft/log.hpp"
 #include "gft/args.hpp"
 #include "gft/util.hpp"
 #include "gft/assert.hpp"
+#include "spv/binary.hpp"
 #include "spv/abstr.hpp"
 #include "spv/instr.hpp"
 #include "spv/ast.hpp"
 #include "visitor/util.hpp"
+#include "node/arena.hpp"
 #include "pass/pass.hpp"
+#include "util/task-pool.hpp"
+#include "util/arg-parsers.hpp"
+#include "util/fs.hpp"
+#include "util/log-cb.hpp"
+#include "util/stage-stats.hpp"
+#include "util/trace.hpp"
 
 using namespace liong;
 
@@ -21,88 +32,371 @@ static const char* APP_DESC = "GraphiT project template.";
 
 
 struct AppConfig {
-  std::string entry_name = "main";
+  // Entry points to process; `main` if none is given.
+  std::vector<std::string> entry_names = {};
   std::string in_file_path = "";
   std::string dbg_print_file_path = "";
   std::vector<std::string> passes = {};
+  uint32_t max_pass_niter = 8;
+  std::string batch_path = "";
+  std::string out_dir_path = "";
+  uint32_t nworker = 0;
+  bool time_passes = false;
+  std::string time_passes_json_path = "";
+  std::string trace_file_path = "";
   bool verbose = false;
 } CFG;
 
-struct PassListParser {
-  typedef std::vector<std::string> arg_ty;
-  static const uint32_t narg = 1;
-  static bool parse(const char* lit[], void* dst) {
-    ((std::vector<std::string>*)dst)->emplace_back(lit[0]);
-    return true;
-  }
-  static std::string lit(const void* src) {
-    return util::join(",", *(std::vector<std::string>*)src);
-  }
-};
-
 void initialize(int argc, const char** argv) {
   args::init_arg_parse(APP_NAME, APP_DESC);
   args::reg_arg<args::SwitchParser>("-v", "--verbose", CFG.verbose,
     "Produce extra amount of logs for debugging.");
   args::reg_arg<args::StringParser>("-i", "--in-file", CFG.in_file_path,
     "Path to source SPIR-V.");
-  args::reg_arg<args::StringParser>("-e", "--entry-point", CFG.in_file_path,
-    "Entry-point to process in the source SPIR-V.");
+  args::reg_arg<StringListParser>("-e", "--entry-point", CFG.entry_names,
+    "Entry-point to process in the source SPIR-V. Can be given more than once "
+    "to process multiple entry-points; other function bodies are never "
+    "parsed. Defaults to `main`.");
   args::reg_arg<args::StringParser>("", "--dbg-print-file", CFG.dbg_print_file_path,
     "Path to print human-readable debug representation of the processed IR.");
-  args::reg_arg<PassListParser>("-p", "--pass", CFG.passes,
-    "Passes to applied in order.");
+  args::reg_arg<StringListParser>("-p", "--pass", CFG.passes,
+    "Passes to applied in order. Prerequisites of a pass are applied first "
+    "if they haven't been, and a pass is skipped if nothing has changed since "
+    "it was last applied. Passes joined by `+`, e.g. `-p a+b`, are applied as "
+    "a group repeatedly until none of them changes the IR.");
+  args::reg_arg<CountParser>("", "--max-pass-iter", CFG.max_pass_niter,
+    "Maximal number of iterations applying a pass group. Defaults to 8.");
+  args::reg_arg<args::StringParser>("", "--batch", CFG.batch_path,
+    "Process a batch of SPIR-V modules listed in a manifest file (one path per "
+    "line), or all `.spv` files in a directory. A module is processed with "
+    "the passes listed in the `__pass__` file beside it, one per line, instead "
+    "of `-p` if there is one, and likewise with the entry-points listed in the "
+    "`__entry__` file instead of `-e`. Requires `--out-dir`.");
+  args::reg_arg<args::StringParser>("", "--out-dir", CFG.out_dir_path,
+    "Directory to write the debug representation of each module in batch "
+    "mode to, as `<out-dir>/<module-path>.log` where the module path is "
+    "relative to the batch directory or manifest.");
+  args::reg_arg<args::SwitchParser>("", "--time-passes", CFG.time_passes,
+    "Report wall time, CPU time, IR node counts and node allocations of each "
+    "processing stage and pass.");
+  args::reg_arg<args::StringParser>("", "--time-passes-json", CFG.time_passes_json_path,
+    "Path to write the `--time-passes` report as JSON. Implies "
+    "`--time-passes`.");
+  args::reg_arg<args::StringParser>("", "--trace-file", CFG.trace_file_path,
+    "Path to write a Chrome trace-event JSON of the processing, viewable in "
+    "`chrome://tracing` or Perfetto.");
+  args::reg_arg<CountParser>("-j", "--jobs", CFG.nworker,
+    "Number of worker threads processing modules in batch mode, or "
+    "entry-points otherwise. Defaults to the number of hardware threads.");
   args::parse_args(argc, argv);
+  enable_stage_stats(CFG.time_passes || !CFG.time_passes_json_path.empty());
 
-  extern void log_cb(log::LogLevel lv, const std::string& msg);
   log::set_log_callback(log_cb);
   log::LogLevel level = CFG.verbose ?
     log::LogLevel::L_LOG_LEVEL_DEBUG : log::LogLevel::L_LOG_LEVEL_INFO; 
   log::set_log_filter_level(level);
+
+  if (!CFG.trace_file_path.empty()) {
+#ifndef CSPV_TRACE
+    log::warn("trace spans are compiled out; build with `CSPV_TRACE` to "
+      "trace the processing");
+#endif
+    start_trace();
+  }
+}
+
+SpirvBinary load_spv(const char* path) {
+  // The file is mapped into memory rather than copied; the mapping is released
+  // along with the last `SpirvAbstract` referring to it.
+  return map_spirv_binary(path);
+}
+
+
+
+// Split a pass group like `a+b` into pass names.
+std::vector<std::string> split_pass_group(const std::string& lit) {
+  std::vector<std::string> out;
+  size_t beg = 0;
+  for (;;) {
+    size_t end = lit.find('+', beg);
+    out.emplace_back(lit.substr(beg, end - beg));
+    if (end == std::string::npos) { break; }
+    beg = end + 1;
+  }
+  return out;
+}
+
+// Load and parse a module. Module-scope nodes are allocated from `arena`.
+SpirvModule load_module(const std::string& in_file_path, IrArena& arena) {
+  IrArenaScope arena_scope(arena);
+  SpirvBinary spv;
+  {
+    StageTimer timer("load");
+    spv = load_spv(in_file_path.c_str());
+  }
+  SpirvAbstract abstr;
+  {
+    StageTimer timer("scan");
+    abstr = scan_spirv(spv);
+  }
+  StageTimer timer("parse");
+  return parse_spirv_module(std::move(abstr));
+}
+
+// Load, parse and apply `passes` to entry-points `entry_names` of a single
+// module, or to `main` if none is named. Entry-points are processed
+// concurrently on up to `nworker` threads. Returns the human-readable
+// representation of the processed entry-points. If more than one entry-point
+// is selected, each is headed by a comment line of its name.
+std::string process_module(
+  const std::string& in_file_path,
+  const std::vector<std::string>& passes,
+  const std::vector<std::string>& entry_names_,
+  uint32_t nworker
+) {
+  // Module-scope nodes (types, constants and global variables) are frozen
+  // once the module is parsed, so that entry-points can share them read-only.
+  // All IR nodes of the module are released at once at the end of processing.
+  IrArena mod_arena;
+  SpirvModule mod = load_module(in_file_path, mod_arena);
+  mod_arena.freeze();
+
+  std::vector<std::string> entry_names = entry_names_;
+  if (entry_names.empty()) {
+    entry_names.emplace_back("main");
+  }
+
+  std::vector<std::string> codes(entry_names.size());
+  parallel_for(entry_names.size(), nworker, [&](size_t i) {
+    // Nodes of each entry-point live in an arena of their own, so workers never
+    // allocate from the same arena.
+    IrArena arena(&mod_arena);
+    IrArenaScope arena_scope(arena);
+
+    NodeRef entry_point;
+    {
+      StageTimer timer("extract");
+      entry_point = extract_entry_point(mod, entry_names[i]);
+      timer.stop();
+      if (is_stage_stats_enabled()) {
+        timer.set_node_counts(0, count_nodes(entry_point));
+      }
+    }
+
+    // Apply passes, if any.
+    PassManager pass_mgr(CFG.max_pass_niter);
+    for (const auto& pass : passes) {
+      std::vector<std::string> group = split_pass_group(pass);
+      if (group.size() == 1) {
+        pass_mgr.apply(pass, entry_point);
+      } else {
+        pass_mgr.apply_fixed_point(group, entry_point);
+      }
+    }
+
+    {
+      StageTimer timer("dbg-print");
+      codes[i] = dbg_print(entry_point);
+    }
+    log::debug("allocated ", arena.nnode, " nodes (", arena.nbyte_node,
+      " bytes) in ", arena.blocks.size(), " arena blocks (", arena.nbyte_block,
+      " bytes) for entry point '", entry_names[i], "'");
+  });
+
+  std::string out;
+  for (size_t i = 0; i < entry_names.size(); ++i) {
+    if (entry_names.size() > 1) {
+      out += "// entry point: " + entry_names[i] + "\n";
+    }
+    out += codes[i];
+  }
+  log::debug("allocated ", mod_arena.nnode, " module-scope nodes (",
+    mod_arena.nbyte_node, " bytes) in ", mod_arena.blocks.size(),
+    " arena blocks (", mod_arena.nbyte_block, " bytes)");
+  return out;
+}
+
+// Save the trace, and print the statistics of processing stages and passes,
+// if requested.
+void save_reports() {
+  if (!CFG.trace_file_path.empty()) {
+    save_trace(CFG.trace_file_path);
+  }
+
+  if (!is_stage_stats_enabled()) { return; }
+  std::vector<StageStats> stats = get_stage_stats();
+  log::info("stage statistics:\n", format_stage_stats_table(stats));
+  if (!CFG.time_passes_json_path.empty()) {
+    util::save_text(CFG.time_passes_json_path.c_str(),
+      format_stage_stats_json(stats));
+  }
 }
 
-std::vector<uint32_t> load_spv(const char* path) {
-  std::vector<uint8_t> raw = util::load_file(path);
+// Collect module paths from a directory or a manifest file. Paths in the
+// manifest are relative to the manifest itself. Empty lines and lines started
+// with `#` are ignored.
+std::vector<std::string> collect_batch_paths(const std::string& batch_path) {
+  namespace fs = std::filesystem;
+  std::vector<std::string> out;
 
-  assert(raw.size() % sizeof(uint32_t) == 0,
-    "spirv corrupted: size is not aligned to 4");
+  if (fs::is_directory(batch_path)) {
+    out = collect_spirv_paths(batch_path);
+  } else {
+    std::ifstream manifest(batch_path);
+    assert(manifest.is_open(), "cannot open batch manifest '", batch_path, "'");
+    fs::path base_dir = fs::path(batch_path).parent_path();
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+      size_t beg = line.find_first_not_of(" \t\r");
+      size_t end = line.find_last_not_of(" \t\r");
+      if (beg == std::string::npos || line[beg] == '#') { continue; }
+      fs::path path = line.substr(beg, end - beg + 1);
+      if (path.is_relative()) { path = base_dir / path; }
+      out.emplace_back(path.string());
+    }
+  }
+
+  return out;
+}
+
+// The directory batch module paths are relative to.
+std::filesystem::path get_batch_root(const std::string& batch_path) {
+  namespace fs = std::filesystem;
+  fs::path root = fs::is_directory(batch_path) ?
+    fs::path(batch_path) : fs::path(batch_path).parent_path();
+  if (root.empty()) { root = "."; }
+  return fs::absolute(root).lexically_normal();
+}
+
+// Path to write the output of module `path` to. The module's path relative to
+// the batch root is mirrored under the output directory; modules out of the
+// batch root are mirrored by their absolute paths.
+std::string get_batch_out_path(
+  const std::filesystem::path& batch_root,
+  const std::string& path
+) {
+  namespace fs = std::filesystem;
+  fs::path abs_path = fs::absolute(path).lexically_normal();
+  fs::path rel_path = abs_path.lexically_relative(batch_root);
+  if (rel_path.empty() || *rel_path.begin() == "..") {
+    rel_path = abs_path.relative_path();
+  }
+  fs::path out_path = fs::path(CFG.out_dir_path) / rel_path;
+  out_path += ".log";
+  return out_path.string();
+}
 
-  uint32_t magic = *(const uint32_t*)raw.data();
-  assert(magic == spv::MagicNumber);
+// Non-empty lines of the file `name` in the directory of module `path`, or
+// `fallback` if there is no such file.
+std::vector<std::string> read_batch_list(
+  const std::string& path,
+  const char* name,
+  const std::vector<std::string>& fallback
+) {
+  namespace fs = std::filesystem;
+  std::ifstream list(fs::path(path).parent_path() / name);
+  if (!list.is_open()) { return fallback; }
 
-  const size_t n = raw.size() / sizeof(uint32_t);
-  const uint32_t* beg = (const uint32_t*)raw.data();
-  const uint32_t* end = beg + n;
-  std::vector<uint32_t> spv(beg, end);
-  return spv;
+  std::vector<std::string> out;
+  std::string line;
+  while (std::getline(list, line)) {
+    size_t beg = line.find_first_not_of(" \t\r");
+    size_t end = line.find_last_not_of(" \t\r");
+    if (beg == std::string::npos) { continue; }
+    out.emplace_back(line.substr(beg, end - beg + 1));
+  }
+  return out;
+}
+// Passes listed in the `__pass__` file beside module `path`, one per line, or
+// the passes given on the command line if there is no such file.
+std::vector<std::string> get_batch_passes(const std::string& path) {
+  return read_batch_list(path, "__pass__", CFG.passes);
 }
+// Entry-points listed in the `__entry__` file beside module `path`, one per
+// line, or the entry-points given on the command line if there is no such
+// file.
+std::vector<std::string> get_batch_entry_names(const std::string& path) {
+  return read_batch_list(path, "__entry__", CFG.entry_names);
+}
+
+// Process modules on a worker pool. A failing module doesn't affect any
+// other. Results are reported in the same order as the inputs regardless of
+// the order they finish.
+int batch_main() {
+  if (CFG.out_dir_path.empty()) {
+    panic("output directory not given for batch processing");
+  }
+  std::vector<std::string> paths = collect_batch_paths(CFG.batch_path);
+  std::filesystem::path batch_root = get_batch_root(CFG.batch_path);
+  uint32_t nworker = CFG.nworker == 0 ? get_default_nworker() : CFG.nworker;
+  log::info("processing ", paths.size(), " modules with ", nworker,
+    " workers");
 
+  std::vector<std::string> errs(paths.size());
+  parallel_for(paths.size(), nworker, [&](size_t i) {
+    try {
+      // Modules are already processed in parallel.
+      std::string code = process_module(paths[i], get_batch_passes(paths[i]),
+        get_batch_entry_names(paths[i]), 1);
+      std::string out_path = get_batch_out_path(batch_root, paths[i]);
+      std::filesystem::create_directories(
+        std::filesystem::path(out_path).parent_path());
+      util::save_text(out_path.c_str(), code);
+    } catch (const std::exception& e) {
+      errs[i] = e.what();
+      // Exceptions without message are still failures.
+      if (errs[i].empty()) { errs[i] = "unknown error"; }
+    } catch (...) {
+      errs[i] = "illiterate exception";
+    }
+  });
 
+  size_t nfail = 0;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (errs[i].empty()) {
+      log::info("processed '", paths[i], "'");
+    } else {
+      log::error("failed to process '", paths[i], "': ", errs[i]);
+      ++nfail;
+    }
+  }
+
+  save_reports();
+
+  if (nfail > 0) {
+    log::error(nfail, " of ", paths.size(), " modules failed");
+    return 1;
+  } else {
+    log::info("success");
+    return 0;
+  }
+}
+
+int guarded_main() {
+  if (!CFG.batch_path.empty()) {
+    return batch_main();
+  }
 
-void guarded_main() {
   // Load and parse the input SPIR-V, extract the first entry-point.
   if (CFG.in_file_path.empty()) {
     panic("source file path not given");
   }
-  std::vector<uint32_t> spv = load_spv(CFG.in_file_path.c_str());
-  SpirvAbstract abstr = scan_spirv(spv);
-  SpirvModule mod = parse_spirv_module(std::move(abstr));
-  NodeRef entry_point = extract_entry_points(mod)[CFG.entry_name];
-
-  // Apply passes, if any.
-  for (auto& pass : CFG.passes) {
-    apply_pass(pass, entry_point);
-  }
+  uint32_t nworker = CFG.nworker == 0 ? get_default_nworker() : CFG.nworker;
+  std::string code = process_module(CFG.in_file_path, CFG.passes,
+    CFG.entry_names, nworker);
 
   // Print the human-readable representation for convenience.
-  std::string code = dbg_print(entry_point);
   if (CFG.dbg_print_file_path.empty()) {
     log::info(code);
   } else {
     util::save_text(CFG.dbg_print_file_path.c_str(), code);
   }
 
+  save_reports();
+
   log::info("success");
+  return 0;
 }
 
 
@@ -112,8 +406,9 @@ void guarded_main() {
 
 int main(int argc, const char** argv) {
   initialize(argc, argv);
+  int ret = 0;
   //try {
-    guarded_main();
+    ret = guarded_main();
   //} catch (const std::exception& e) {
   //  liong::log::error("application threw an exception");
   //  liong::log::error(e.what());
@@ -122,23 +417,5 @@ int main(int argc, const char** argv) {
   //  liong::log::error("application threw an illiterate exception");
   //}
 
-  return 0;
-}
-
-void log_cb(log::LogLevel lv, const std::string& msg) {
-  using log::LogLevel;
-  switch (lv) {
-  case LogLevel::L_LOG_LEVEL_DEBUG:
-    printf("[\x1b[90mDEBUG\x1B[0m] %s\n", msg.c_str());
-    break;
-  case LogLevel::L_LOG_LEVEL_INFO:
-    printf("[\x1B[32mINFO\x1B[0m] %s\n", msg.c_str());
-    break;
-  case LogLevel::L_LOG_LEVEL_WARNING:
-    printf("[\x1B[33mWARN\x1B[0m] %s\n", msg.c_str());
-    break;
-  case LogLevel::L_LOG_LEVEL_ERROR:
-    printf("[\x1B[31mERROR\x1B[0m] %s\n", msg.c_str());
-    break;
-  }
+  return ret;
 }
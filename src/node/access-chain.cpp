@@ -0,0 +1,69 @@
+#include <algorithm>
+#include "node/access-chain.hpp"
+#include "node/gen/expr.hpp"
+
+using namespace liong;
+
+AccessChain AccessChain::append(const ExprRef& idx) const {
+  assert(idx != nullptr);
+  inc_ref_();
+  AccessChain out;
+  out.tail = new AccessChainLink { 1, tail, idx, (uint32_t)size() + 1, 0 };
+  return out;
+}
+
+NodeList<ExprRef> AccessChain::to_list() const {
+  NodeList<ExprRef> out;
+  out.reserve(size());
+  for (const AccessChainLink* link = tail; link != nullptr; link = link->parent) {
+    out.emplace_back(link->idx);
+  }
+  std::reverse(out.begin(), out.end());
+  return out;
+}
+void AccessChain::collect_indices(NodeDrain* drain) const {
+  size_t ibeg = drain->nodes.size();
+  for (const AccessChainLink* link = tail; link != nullptr; link = link->parent) {
+    drain->push(link->idx);
+  }
+  std::reverse(drain->nodes.begin() + ibeg, drain->nodes.end());
+}
+
+bool AccessChain::structured_eq(const AccessChain& b) const {
+  if (size() != b.size()) { return false; }
+  if (structured_hash() != b.structured_hash()) { return false; }
+  // Chains of the same depth share links from the same depth on, if any.
+  const AccessChainLink* a_link = tail;
+  const AccessChainLink* b_link = b.tail;
+  while (a_link != b_link) {
+    if (!a_link->idx->structured_eq(b_link->idx)) { return false; }
+    a_link = a_link->parent;
+    b_link = b_link->parent;
+  }
+  return true;
+}
+uint64_t AccessChain::structured_hash() const {
+  // Find the longest suffix of links whose hashes aren't cached yet, and hash
+  // them from the root side so that each link only combines its own index.
+  std::vector<const AccessChainLink*> pending;
+  for (const AccessChainLink* link = tail; link != nullptr; link = link->parent) {
+    if (link->structured_hash_cache != 0) { break; }
+    pending.emplace_back(link);
+  }
+  for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+    const AccessChainLink* link = *it;
+    uint64_t seed = link->parent == nullptr ? 0 : link->parent->structured_hash_cache;
+    uint64_t out = hash_combine(seed, hash_node_structure(link->idx));
+    link->structured_hash_cache = out == 0 ? 1 : out;
+  }
+  return tail == nullptr ? 0 : tail->structured_hash_cache;
+}
+
+void AccessChain::release(const AccessChainLink* link) {
+  // Release iteratively so that dropping a long chain doesn't recurse.
+  while (link != nullptr && dec_ref_count(link->nref)) {
+    const AccessChainLink* parent = link->parent;
+    delete link;
+    link = parent;
+  }
+}
@@ -0,0 +1,142 @@
+#include <new>
+#include "gft/assert.hpp"
+#include "node/node.hpp"
+#include "node/intern.hpp"
+
+using namespace liong;
+
+static thread_local IrArena* CUR_ARENA = nullptr;
+static thread_local uint64_t THREAD_NBYTE_ALLOC = 0;
+
+// Round up to keep every node (and its header) aligned to `max_align_t`.
+static size_t align_node_size(size_t size) {
+  const size_t ALIGN = alignof(std::max_align_t);
+  return (size + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+IrArena::IrArena() : IrArena(nullptr) {}
+IrArena::IrArena(const IrArena* parent) :
+  blocks(),
+  cur(nullptr),
+  nbyte_remain(0),
+  allocs(),
+  ty_interner(),
+  parent(parent),
+  is_frozen(false),
+  nnode(0),
+  nbyte_node(0),
+  nbyte_block(0) {
+  assert(parent == nullptr || parent->is_frozen,
+    "parent arena must be frozen");
+}
+IrArena::~IrArena() {
+  release();
+}
+
+void* IrArena::alloc_node(size_t size) {
+  assert(!is_frozen, "cannot allocate nodes from a frozen arena");
+  size_t nbyte = sizeof(NodeAllocHeader) + align_node_size(size);
+
+  uint8_t* dst;
+  if (nbyte > BLOCK_SIZE) {
+    // Oversized nodes get a block of their own; it's a waste to discard the
+    // remainder of the current block for them.
+    blocks.emplace_back(new uint8_t[nbyte]);
+    nbyte_block += nbyte;
+    dst = blocks.back().get();
+  } else {
+    if (nbyte > nbyte_remain) {
+      blocks.emplace_back(new uint8_t[BLOCK_SIZE]);
+      nbyte_block += BLOCK_SIZE;
+      cur = blocks.back().get();
+      nbyte_remain = BLOCK_SIZE;
+    }
+    dst = cur;
+    cur += nbyte;
+    nbyte_remain -= nbyte;
+  }
+
+  NodeAllocHeader* header = new(dst) NodeAllocHeader {};
+  header->arena = this;
+  header->alive = true;
+  allocs.emplace_back(header);
+  ++nnode;
+  nbyte_node += nbyte;
+  THREAD_NBYTE_ALLOC += nbyte;
+  return header + 1;
+}
+
+void IrArena::freeze() {
+  for (NodeAllocHeader* header : allocs) {
+    if (header->alive) {
+      ((const Node*)(header + 1))->structured_hash();
+    }
+  }
+  is_frozen = true;
+}
+
+void IrArena::release() {
+  ty_interner.reset();
+
+  // Nodes may hold references to heap-allocated nodes so destructors still
+  // have to be run.
+  for (auto it = allocs.rbegin(); it != allocs.rend(); ++it) {
+    NodeAllocHeader* header = *it;
+    if (header->alive) {
+      ((Node*)(header + 1))->~Node();
+    }
+  }
+  allocs.clear();
+  blocks.clear();
+  cur = nullptr;
+  nbyte_remain = 0;
+}
+
+TypeInterner& IrArena::get_ty_interner() {
+  if (ty_interner == nullptr) {
+    const TypeInterner* parent_ty_interner =
+      parent == nullptr ? nullptr : parent->ty_interner.get();
+    ty_interner = std::make_unique<TypeInterner>(parent_ty_interner);
+  }
+  return *ty_interner;
+}
+
+IrArena* IrArena::current() {
+  return CUR_ARENA;
+}
+uint64_t IrArena::nbyte_alloc_by_thread() {
+  return THREAD_NBYTE_ALLOC;
+}
+
+IrArenaScope::IrArenaScope(IrArena& arena) : prev(CUR_ARENA) {
+  CUR_ARENA = &arena;
+}
+IrArenaScope::~IrArenaScope() {
+  CUR_ARENA = prev;
+}
+
+
+
+void* Node::operator new(size_t size) {
+  IrArena* arena = IrArena::current();
+  if (arena != nullptr) {
+    return arena->alloc_node(size);
+  }
+
+  NodeAllocHeader* header =
+    (NodeAllocHeader*)::operator new(sizeof(NodeAllocHeader) + size);
+  header->arena = nullptr;
+  header->alive = true;
+  return header + 1;
+}
+void Node::operator delete(void* ptr) {
+  if (ptr == nullptr) { return; }
+  NodeAllocHeader* header = (NodeAllocHeader*)ptr - 1;
+  if (header->arena != nullptr) {
+    // Arena-backed nodes are only deleted here when their constructors threw.
+    // The memory is reclaimed with the arena.
+    header->alive = false;
+  } else {
+    ::operator delete(header);
+  }
+}
@@ -0,0 +1,220 @@
+// GENERATED BY `scripts/gen-visitor-templates.py`; DO NOT MODIFY.
+// Flat expression pool implementation.
+// @PENGUINLIONG
+#include <cstring>
+#include "node/gen/mem.hpp"
+#include "node/gen/ty.hpp"
+#include "node/gen/expr.hpp"
+#include "node/gen/stmt.hpp"
+#include "node/gen/expr-pool.hpp"
+
+template<typename T>
+static uint64_t encode_payload(const T& x) {
+  uint64_t out = 0;
+  std::memcpy(&out, &x, sizeof(T));
+  return out;
+}
+template<typename T>
+static T decode_payload(uint64_t x) {
+  T out;
+  std::memcpy(&out, &x, sizeof(T));
+  return out;
+}
+
+// Operands of `expr` in pool order. Returns the number of operands.
+static uint32_t collect_operands(const Expr& expr, const Expr* (&out)[3]) {
+  switch (expr.op) {
+  case L_EXPR_OP_PATTERN_CAPTURE:
+    liong::panic("`ExprPatternCapture` cannot be pooled");
+  case L_EXPR_OP_PATTERN_BINARY_OP:
+    liong::panic("`ExprPatternBinaryOp` cannot be pooled");
+  case L_EXPR_OP_ADD:
+  {
+    const auto& x = expr.as<ExprAdd>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_SUB:
+  {
+    const auto& x = expr.as<ExprSub>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_MUL:
+  {
+    const auto& x = expr.as<ExprMul>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_DIV:
+  {
+    const auto& x = expr.as<ExprDiv>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_MOD:
+  {
+    const auto& x = expr.as<ExprMod>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_LT:
+  {
+    const auto& x = expr.as<ExprLt>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_EQ:
+  {
+    const auto& x = expr.as<ExprEq>();
+    out[0] = x.a.get();
+    out[1] = x.b.get();
+    return 2;
+  }
+  case L_EXPR_OP_NOT:
+  {
+    const auto& x = expr.as<ExprNot>();
+    out[0] = x.a.get();
+    return 1;
+  }
+  case L_EXPR_OP_TYPE_CAST:
+  {
+    const auto& x = expr.as<ExprTypeCast>();
+    out[0] = x.src.get();
+    return 1;
+  }
+  case L_EXPR_OP_SELECT:
+  {
+    const auto& x = expr.as<ExprSelect>();
+    out[0] = x.cond.get();
+    out[1] = x.a.get();
+    out[2] = x.b.get();
+    return 3;
+  }
+  default: return 0;
+  }
+}
+
+uint32_t ExprPool::intern_ty_(const TypeRef& ty) {
+  auto it = ty_idx_map.find(ty.get_alloc());
+  if (it != ty_idx_map.end()) { return it->second; }
+  uint32_t i = (uint32_t)ty_table.size();
+  ty_table.emplace_back(ty);
+  ty_idx_map.emplace(ty.get_alloc(), i);
+  return i;
+}
+uint32_t ExprPool::intern_ref_(const NodeRef& ref) {
+  auto it = ref_idx_map.find(ref.get_alloc());
+  if (it != ref_idx_map.end()) { return it->second; }
+  uint32_t i = (uint32_t)ref_table.size();
+  ref_table.emplace_back(ref);
+  ref_idx_map.emplace(ref.get_alloc(), i);
+  return i;
+}
+void ExprPool::append_(const Expr& expr) {
+  const Expr* x[3];
+  uint32_t noperand = collect_operands(expr, x);
+  ExprIndex i = (ExprIndex)op.size();
+  op.emplace_back(expr.op);
+  ty.emplace_back(intern_ty_(expr.ty));
+  operand_begin.emplace_back((uint32_t)operands.size());
+  for (uint32_t j = 0; j < noperand; ++j) {
+    operands.emplace_back(expr_idx_map.at(x[j]));
+  }
+  switch (expr.op) {
+  case L_EXPR_OP_BOOL_IMM: payload.emplace_back(encode_payload(expr.as<ExprBoolImm>().lit)); break;
+  case L_EXPR_OP_INT_IMM: payload.emplace_back(encode_payload(expr.as<ExprIntImm>().lit)); break;
+  case L_EXPR_OP_FLOAT_IMM: payload.emplace_back(encode_payload(expr.as<ExprFloatImm>().lit)); break;
+  case L_EXPR_OP_LOAD: payload.emplace_back(intern_ref_(expr.as<ExprLoad>().src_ptr)); break;
+  default: payload.emplace_back(0); break;
+  }
+  expr_table.emplace_back((Expr*)&expr);
+  expr_idx_map.emplace(&expr, i);
+}
+
+ExprIndex ExprPool::push(const ExprRef& expr) {
+  // Post-order traversal with an explicit stack; the flag is set once the
+  // operands of the expression have been scheduled.
+  std::vector<std::pair<const Expr*, bool>> stack;
+  stack.emplace_back(expr.get(), false);
+  while (!stack.empty()) {
+    auto& frame = stack.back();
+    const Expr* x = frame.first;
+    if (expr_idx_map.find(x) != expr_idx_map.end()) {
+      stack.pop_back();
+    } else if (frame.second) {
+      stack.pop_back();
+      append_(*x);
+    } else {
+      frame.second = true;
+      const Expr* x2[3];
+      uint32_t noperand = collect_operands(*x, x2);
+      for (uint32_t j = noperand; j-- > 0;) {
+        stack.emplace_back(x2[j], false);
+      }
+    }
+  }
+  return expr_idx_map.at(expr.get());
+}
+
+ExprRef ExprPool::to_tree(ExprIndex root) const {
+  // Operands precede their users, so reachability can be marked from the
+  // root backwards and the reachable nodes built forwards.
+  std::vector<bool> is_reachable(root + 1, false);
+  is_reachable[root] = true;
+  for (ExprIndex i = root + 1; i-- > 0;) {
+    if (!is_reachable[i]) { continue; }
+    const ExprIndex* x = get_operands(i);
+    for (uint32_t j = 0; j < get_expr_noperand(op[i]); ++j) {
+      is_reachable[x[j]] = true;
+    }
+  }
+
+  std::vector<ExprRef> exprs(root + 1);
+  for (ExprIndex i = 0; i <= root; ++i) {
+    if (!is_reachable[i]) { continue; }
+    const ExprIndex* x = get_operands(i);
+    switch (op[i]) {
+    case L_EXPR_OP_BOOL_IMM: exprs[i] = new ExprBoolImm(ty_table[ty[i]], decode_payload<bool>(payload[i])); break;
+    case L_EXPR_OP_INT_IMM: exprs[i] = new ExprIntImm(ty_table[ty[i]], decode_payload<int64_t>(payload[i])); break;
+    case L_EXPR_OP_FLOAT_IMM: exprs[i] = new ExprFloatImm(ty_table[ty[i]], decode_payload<double>(payload[i])); break;
+    case L_EXPR_OP_LOAD: exprs[i] = new ExprLoad(ty_table[ty[i]], ref_table[payload[i]].as<Memory>()); break;
+    case L_EXPR_OP_ADD: exprs[i] = new ExprAdd(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_SUB: exprs[i] = new ExprSub(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_MUL: exprs[i] = new ExprMul(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_DIV: exprs[i] = new ExprDiv(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_MOD: exprs[i] = new ExprMod(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_LT: exprs[i] = new ExprLt(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_EQ: exprs[i] = new ExprEq(ty_table[ty[i]], exprs[x[0]], exprs[x[1]]); break;
+    case L_EXPR_OP_NOT: exprs[i] = new ExprNot(ty_table[ty[i]], exprs[x[0]]); break;
+    case L_EXPR_OP_TYPE_CAST: exprs[i] = new ExprTypeCast(ty_table[ty[i]], exprs[x[0]]); break;
+    case L_EXPR_OP_SELECT: exprs[i] = new ExprSelect(ty_table[ty[i]], exprs[x[0]], exprs[x[1]], exprs[x[2]]); break;
+    default: liong::unreachable();
+    }
+  }
+  return exprs[root];
+}
+
+std::vector<uint64_t> ExprPool::compute_structured_hashes() const {
+  std::vector<uint64_t> out(size());
+  for (ExprIndex i = 0; i < size(); ++i) {
+    uint64_t hash = hash_combine(hash_node_field(op[i]), hash_node_field(ty_table[ty[i]]));
+    switch (get_expr_payload_kind(op[i])) {
+    case L_EXPR_PAYLOAD_KIND_LITERAL: hash = hash_combine(hash, payload[i]); break;
+    case L_EXPR_PAYLOAD_KIND_REF: hash = hash_combine(hash, ref_table[payload[i]]->structured_hash()); break;
+    default: break;
+    }
+    const ExprIndex* x = get_operands(i);
+    for (uint32_t j = 0; j < get_expr_noperand(op[i]); ++j) {
+      hash = hash_combine(hash, out[x[j]]);
+    }
+    out[i] = hash;
+  }
+  return out;
+}
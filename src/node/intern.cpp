@@ -0,0 +1,40 @@
+#include "gft/assert.hpp"
+#include "node/gen/ty.hpp"
+#include "node/intern.hpp"
+
+using namespace liong;
+
+TypeRef TypeInterner::find(const TypeRef& ty) const {
+  auto it = buckets.find(ty->structured_hash());
+  if (it != buckets.end()) {
+    for (const auto& x : it->second) {
+      if (ty->structured_eq(x)) { return x; }
+    }
+  }
+  return parent == nullptr ? nullptr : parent->find(ty);
+}
+TypeRef TypeInterner::intern(const TypeRef& ty) {
+  assert(ty != nullptr);
+  assert(!ty->is<TypePatternCapture>(), "type patterns cannot be interned");
+
+  TypeRef out = find(ty);
+  if (out != nullptr) {
+    ++nhit;
+    return out;
+  }
+  buckets[ty->structured_hash()].emplace_back(ty);
+  ++nmiss;
+  return ty;
+}
+
+TypeRef intern_ty(const TypeRef& ty) {
+  IrArena* arena = IrArena::current();
+  if (arena != nullptr) {
+    return arena->get_ty_interner().intern(ty);
+  } else {
+    // Heap-allocated types are kept alive by the interner until the thread
+    // exits. There are only a handful of distinct types so it's fine.
+    static thread_local TypeInterner ty_interner;
+    return ty_interner.intern(ty);
+  }
+}
@@ -0,0 +1,60 @@
+#include <vector>
+#include "node/node.hpp"
+
+using namespace liong;
+
+// Number of nested `compute_structured_hash` calls on the current thread.
+// Shallow trees are hashed by plain recursion, which is the fastest; beyond
+// the limit the rest of the tree is hashed with an explicit stack.
+static thread_local uint32_t HASH_DEPTH = 0;
+static const uint32_t MAX_HASH_DEPTH = 256;
+
+void Node::fill_structured_hashes() const {
+  if (HASH_DEPTH < MAX_HASH_DEPTH) {
+    ++HASH_DEPTH;
+    uint64_t out = compute_structured_hash();
+    --HASH_DEPTH;
+    structured_hash_cache = out == 0 ? 1 : out;
+    return;
+  }
+
+  struct Task {
+    const Node* node;
+    // Children have been scheduled; the node is hashed when it's popped
+    // again.
+    bool is_expanded;
+  };
+  std::vector<Task> stack;
+  NodeDrain drain;
+
+  stack.emplace_back(Task { this, false });
+  while (!stack.empty()) {
+    Task task = stack.back();
+    stack.pop_back();
+    const Node* node = task.node;
+    // Nodes shared in a DAG can be scheduled more than once.
+    if (node->structured_hash_cache != 0) { continue; }
+
+    if (!task.is_expanded) {
+      // Children are kept alive by `node` so the drain can be cleared right
+      // away.
+      size_t ntask = stack.size();
+      node->collect_children(&drain);
+      for (const auto& child : drain.nodes) {
+        if (child != nullptr && child->structured_hash_cache == 0) {
+          stack.emplace_back(Task { child.get(), false });
+        }
+      }
+      drain.nodes.clear();
+      // Hash the node right away if all children are already hashed, which is
+      // the case for all leaves.
+      if (stack.size() != ntask) {
+        stack.insert(stack.begin() + ntask, Task { node, true });
+        continue;
+      }
+    }
+
+    uint64_t out = node->compute_structured_hash();
+    node->structured_hash_cache = out == 0 ? 1 : out;
+  }
+}
@@ -6,11 +6,17 @@
 
 using namespace liong;
 
-struct CtrlflowLinearizationMutator : public Mutator {
+template<typename TBase>
+struct CtrlflowLinearizationMutator : public TBase {
+  using TBase::mutate_expr;
+  using TBase::mutate_stmt;
+  using TBase::mutate_children_;
+  using TBase::mark_changed;
+  using TBase::mutate_stmt_;
 
-  std::shared_ptr<uint8_t> outer_loop_handle;
+  NodeHandle outer_loop_handle = INVALID_NODE_HANDLE;
 
-  virtual StmtRef mutate_stmt_(StmtConditionalBranchRef x) override final {
+  StmtRef mutate_stmt_(const StmtConditionalBranchRef& x) {
     ExprRef cond = mutate_expr(x->cond);
     StmtRef then_block = mutate_stmt(x->then_block);
     StmtRef else_block = mutate_stmt(x->else_block);
@@ -32,27 +38,41 @@ struct CtrlflowLinearizationMutator : public Mutator {
       return out;
     }
 
+    if (cond == x->cond && then_block == x->then_block && else_block == x->else_block) {
+      return x;
+    }
     return new StmtConditionalBranch(cond, then_block, else_block);
   }
-  virtual StmtRef mutate_stmt_(StmtLoopRef x) override final {
+  StmtRef mutate_stmt_(const StmtLoopRef& x_) {
+    StmtLoopRef x = x_;
     x->body_block = mutate_stmt(x->body_block);
     StmtRef& body_tail = get_tail_stmt(x->body_block);
     if (body_tail->is<StmtLoopContinue>()) {
       body_tail = StmtRef(new StmtNop);
+      mark_changed();
+    }
+    StmtRef body_block = flatten_block(x->body_block);
+    if (body_block != x->body_block) {
+      x->body_block = std::move(body_block);
+      mark_changed();
     }
-    x->body_block = flatten_block(x->body_block);
 
     x->continue_block = mutate_stmt(x->continue_block);
     StmtRef& continue_tail = get_tail_stmt(x->continue_block);
     if (continue_tail->is<StmtLoopBackEdge>()) {
       continue_tail = StmtRef(new StmtNop);
+      mark_changed();
+    }
+    StmtRef continue_block = flatten_block(x->continue_block);
+    if (continue_block != x->continue_block) {
+      x->continue_block = std::move(continue_block);
+      mark_changed();
     }
-    x->continue_block = flatten_block(x->continue_block);
 
     return x;
   }
-  virtual StmtRef mutate_stmt_(StmtBlockRef x) override final {
-    x = Mutator::mutate_stmt_(x);
+  StmtRef mutate_stmt_(const StmtBlockRef& x) {
+    mutate_children_(x);
     return flatten_block(x);
   }
 
@@ -60,9 +80,14 @@ struct CtrlflowLinearizationMutator : public Mutator {
 
 struct CtrlflowLinearizationPass : public Pass {
   CtrlflowLinearizationPass() : Pass("ctrlflow-linearization") {}
-  virtual void apply(NodeRef& x) override final {
-    CtrlflowLinearizationMutator v;
-    x = v.mutate(x);
+  virtual bool apply(NodeRef& x) const override final {
+    return apply_with_dispatch(x, L_PASS_DISPATCH_VIRTUAL);
+  }
+  virtual bool apply_with_dispatch(
+    NodeRef& x,
+    PassDispatch dispatch
+  ) const override final {
+    return apply_mutator<CtrlflowLinearizationMutator>(x, dispatch);
   }
 };
 static Pass* PASS = reg_pass<CtrlflowLinearizationPass>();
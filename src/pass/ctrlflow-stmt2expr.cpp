@@ -21,7 +21,7 @@ struct FunctionVariableRecord {
 };
 struct ScopeRecord {
   uint32_t scope_lv;
-  std::vector<StmtRef> prelude;
+  NodeList<StmtRef> prelude;
   std::vector<FunctionVariableRecord> func_vars;
   bool is_within_loop;
   
@@ -71,7 +71,14 @@ struct ScopeRecord {
   }
 };
 
-struct CtrlflowStmt2ExprMutator : public Mutator {
+template<typename TBase>
+struct CtrlflowStmt2ExprMutator : public TBase {
+  using TBase::mutate_expr;
+  using TBase::mutate_stmt;
+  using TBase::mutate_children_;
+  using TBase::mutate_expr_;
+
+  using TBase::mutate_stmt_;
 
   std::vector<ScopeRecord> scope_stack { {} };
   ScopeRecord& get_scope() {
@@ -94,7 +101,7 @@ struct CtrlflowStmt2ExprMutator : public Mutator {
 
 
 
-  virtual ExprRef mutate_expr_(ExprLoadRef x) override final {
+  ExprRef mutate_expr_(const ExprLoadRef& x) {
     if (x->src_ptr->is<MemoryFunctionVariable>()) {
       MemoryFunctionVariableRef src_ptr = x->src_ptr;
       FunctionVariableRecord* func_var_record = nullptr;
@@ -121,9 +128,9 @@ struct CtrlflowStmt2ExprMutator : public Mutator {
     }
   }
 
-  virtual StmtRef mutate_stmt_(StmtConditionalLoopRef x) override final {
+  StmtRef mutate_stmt_(const StmtConditionalLoopRef& x) {
     push_scope(true);
-    x = Mutator::mutate_stmt_(x);
+    mutate_children_(x);
     ScopeRecord scope = pop_scope();
     if (scope.prelude.empty()) {
       return x;
@@ -133,8 +140,8 @@ struct CtrlflowStmt2ExprMutator : public Mutator {
     }
   }
 
-  virtual StmtRef mutate_stmt_(StmtBlockRef x) override final {
-    std::vector<StmtRef> out_stmts;
+  StmtRef mutate_stmt_(const StmtBlockRef& x) {
+    NodeList<StmtRef> out_stmts;
     for (StmtRef stmt : x->stmts) {
       if (stmt->is<StmtStore>()) {
         StmtStoreRef stmt2 = mutate_stmt(stmt);
@@ -176,7 +183,10 @@ struct CtrlflowStmt2ExprMutator : public Mutator {
         }
 
         if (!then_block->is<StmtNop>() || !else_block->is<StmtNop>()) {
-          StmtRef branch = new StmtConditionalBranch(cond, then_block, else_block);
+          StmtRef branch = stmt;
+          if (cond != stmt2->cond || then_block != stmt2->then_block || else_block != stmt2->else_block) {
+            branch = new StmtConditionalBranch(cond, then_block, else_block);
+          }
           out_stmts.emplace_back(mutate_stmt(branch));
         }
 
@@ -187,6 +197,9 @@ struct CtrlflowStmt2ExprMutator : public Mutator {
 
     if (out_stmts.empty()) {
       return new StmtNop;
+    } else if (out_stmts.size() == x->stmts.size() &&
+      std::equal(out_stmts.begin(), out_stmts.end(), x->stmts.begin())) {
+      return x;
     } else {
       return new StmtBlock(std::move(out_stmts));
     }
@@ -195,10 +208,15 @@ struct CtrlflowStmt2ExprMutator : public Mutator {
 };
 
 struct CtrlflowStmt2ExprPass : public Pass {
-  CtrlflowStmt2ExprPass() : Pass("ctrlflow-stmt2expr") {}
-  virtual void apply(NodeRef& x) override final {
-    CtrlflowStmt2ExprMutator v;
-    x = v.mutate(x);
+  CtrlflowStmt2ExprPass() : Pass("ctrlflow-stmt2expr", { "ctrlflow-linearization" }) {}
+  virtual bool apply(NodeRef& x) const override final {
+    return apply_with_dispatch(x, L_PASS_DISPATCH_STATIC);
+  }
+  virtual bool apply_with_dispatch(
+    NodeRef& x,
+    PassDispatch dispatch
+  ) const override final {
+    return apply_mutator<CtrlflowStmt2ExprMutator>(x, dispatch);
   }
 };
 static Pass* PASS = reg_pass<CtrlflowStmt2ExprPass>();
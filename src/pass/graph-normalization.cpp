@@ -6,35 +6,35 @@
 #include "pass/pass.hpp"
 #include "visitor/util.hpp"
 
-struct GraphNormalizationMutator : Mutator {
-  void prioritize_binary_op_var(ExprRef& a, ExprRef& b) {
-    auto a2 = mutate_expr(a);
-    auto b2 = mutate_expr(b);
-    if (is_expr_constant(a2->op) && !(is_expr_constant(b2->op))) {
-      a2 = std::exchange(b2, std::move(a2));
+template<typename TBase>
+struct GraphNormalizationMutator : public TBase {
+  using TBase::mutate_children_;
+  using TBase::mark_changed;
+  using TBase::mutate_stmt_;
+
+  template<typename T>
+  void prioritize_binary_op_var(const NodeRef& node) {
+    Reference<T> x = node.as<T>();
+    if (is_expr_constant(x->a->op) && !(is_expr_constant(x->b->op))) {
+      std::swap(x->a, x->b);
+      mark_changed();
     }
-    a = std::move(a2);
-    b = std::move(b2);
-  }
-  virtual ExprRef mutate_expr_(ExprAddRef x) override final {
-    prioritize_binary_op_var(x->a, x->b);
-    return x;
-  }
-  virtual ExprRef mutate_expr_(ExprMulRef x) override final {
-    prioritize_binary_op_var(x->a, x->b);
-    return x;
   }
-  virtual ExprRef mutate_expr_(ExprEqRef x) override final {
-    prioritize_binary_op_var(x->a, x->b);
-    return x;
-  }
-  virtual ExprRef mutate_expr_(ExprLtRef x) override final {
-    prioritize_binary_op_var(x->a, x->b);
-    return x;
+  // Binary operations are normalized once their operands are, after the work
+  // stack has mutated them, so that long chains of operations don't recurse.
+  void post_mutate_(const NodeRef& node) {
+    if (node->nova != L_NODE_VARIANT_EXPR) { return; }
+    switch (node.as<Expr>()->op) {
+    case L_EXPR_OP_ADD: prioritize_binary_op_var<ExprAdd>(node); break;
+    case L_EXPR_OP_MUL: prioritize_binary_op_var<ExprMul>(node); break;
+    case L_EXPR_OP_EQ: prioritize_binary_op_var<ExprEq>(node); break;
+    case L_EXPR_OP_LT: prioritize_binary_op_var<ExprLt>(node); break;
+    default: break;
+    }
   }
 
-  virtual StmtRef mutate_stmt_(StmtBlockRef x) override final {
-    x = Mutator::mutate_stmt_(x);
+  StmtRef mutate_stmt_(const StmtBlockRef& x) {
+    mutate_children_(x);
     return flatten_block(x);
   }
 
@@ -43,9 +43,14 @@ struct GraphNormalizationMutator : Mutator {
 
 struct GraphNormalizationPass : public Pass {
   GraphNormalizationPass() : Pass("graph-normalization") {}
-  virtual void apply(NodeRef& x) override final {
-    GraphNormalizationMutator v;
-    x = v.mutate(x);
+  virtual bool apply(NodeRef& x) const override final {
+    return apply_with_dispatch(x, L_PASS_DISPATCH_STATIC);
+  }
+  virtual bool apply_with_dispatch(
+    NodeRef& x,
+    PassDispatch dispatch
+  ) const override final {
+    return apply_mutator<GraphNormalizationMutator>(x, dispatch);
   }
 };
 static Pass* PASS = reg_pass<GraphNormalizationPass>();
@@ -1,14 +1,31 @@
 // Simplify integer expressions.
 // Depends on `graph-normalization` to ensure the constants are always on the
-// right (`b`).
+// right (`b`), which is declared as a prerequisite of this pass.
 // @PENGUINLIONG
 #include "pass/pass.hpp"
 #include "visitor/util.hpp"
 
 using namespace liong;
 
-struct IntExprSimplificationMutator : public Mutator {
-  virtual ExprRef mutate_expr_(ExprAddRef x) override final {
+template<typename TBase>
+struct IntExprSimplificationMutator : public TBase {
+  using TBase::mutate_expr;
+  using TBase::mutate_ty;
+  using TBase::mutate_expr_;
+
+  // Mutate the operands of binary operation `x`. A new node is made only if
+  // any of them is changed.
+  template<typename T>
+  Reference<T> mutate_operands(const Reference<T>& x) {
+    TypeRef ty = mutate_ty(x->ty);
+    ExprRef a = mutate_expr(x->a);
+    ExprRef b = mutate_expr(x->b);
+    if (ty == x->ty && a == x->a && b == x->b) { return x; }
+    return new T(ty, a, b);
+  }
+
+  ExprRef mutate_expr_(const ExprAddRef& x_) {
+    ExprAddRef x = x_;
     // Rotate to make a leftist tree.
     // ```
     //   expr1 const    expr0 expr1
@@ -31,11 +48,7 @@ struct IntExprSimplificationMutator : public Mutator {
     }
 
     // Recursively reduce the tree complexity.
-    x = new ExprAdd(
-      mutate_ty(x->ty),
-      mutate_expr(x->a),
-      mutate_expr(x->b)
-    );
+    x = mutate_operands(x);
 
     if (x->a->is<ExprAdd>()) {
       ExprAddRef xa = x->a;
@@ -77,7 +90,8 @@ struct IntExprSimplificationMutator : public Mutator {
 
     return x;
   }
-  virtual ExprRef mutate_expr_(ExprMulRef x) override final {
+  ExprRef mutate_expr_(const ExprMulRef& x_) {
+    ExprMulRef x = x_;
     while (x->b->is<ExprMul>()) {
       ExprMulRef xb = x->b;
       x = new ExprMul(
@@ -92,11 +106,7 @@ struct IntExprSimplificationMutator : public Mutator {
     }
 
     // Recursively reduce the tree complexity.
-    x = new ExprMul(
-      mutate_ty(x->ty),
-      mutate_expr(x->a),
-      mutate_expr(x->b)
-    );
+    x = mutate_operands(x);
 
     if (x->a->is<ExprAdd>()) {
       ExprAddRef xa = x->a;
@@ -229,7 +239,8 @@ struct IntExprSimplificationMutator : public Mutator {
       return solve_gcd(gcd, divisor);
     }
   };
-  virtual ExprRef mutate_expr_(ExprDivRef x) override final {
+  ExprRef mutate_expr_(const ExprDivRef& x_) {
+    ExprDivRef x = x_;
     if (!x->b->is<ExprIntImm>()) { return x; }
     ExprIntImmRef xb = x->b;
 
@@ -300,14 +311,11 @@ struct IntExprSimplificationMutator : public Mutator {
       }
     }
 
-    x = new ExprDiv(
-      mutate_ty(x->ty),
-      mutate_expr(x->a),
-      mutate_expr(x->b)
-    );
+    x = mutate_operands(x);
     return x;
   }
-  virtual ExprRef mutate_expr_(ExprModRef x) override final {
+  ExprRef mutate_expr_(const ExprModRef& x_) {
+    ExprModRef x = x_;
     if (!x->b->is<ExprIntImm>()) { return x; }
     ExprIntImmRef xb = x->b;
 
@@ -344,20 +352,21 @@ struct IntExprSimplificationMutator : public Mutator {
       }
     }
 
-    x = new ExprMod(
-      mutate_ty(x->ty),
-      mutate_expr(x->a),
-      mutate_expr(x->b)
-    );
+    x = mutate_operands(x);
     return x;
   }
 };
 
 struct IntExprSimplificationPass : public Pass {
-  IntExprSimplificationPass() : Pass("int-expr-simplification") {}
-  virtual void apply(NodeRef& x) override final {
-    IntExprSimplificationMutator v;
-    x = v.mutate(x);
+  IntExprSimplificationPass() : Pass("int-expr-simplification", { "graph-normalization" }) {}
+  virtual bool apply(NodeRef& x) const override final {
+    return apply_with_dispatch(x, L_PASS_DISPATCH_STATIC);
+  }
+  virtual bool apply_with_dispatch(
+    NodeRef& x,
+    PassDispatch dispatch
+  ) const override final {
+    return apply_mutator<IntExprSimplificationMutator>(x, dispatch);
   }
 };
 static Pass* PASS = reg_pass<IntExprSimplificationPass>();
@@ -1,26 +1,122 @@
+#include <algorithm>
 #include <memory>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <string>
+#include "gft/log.hpp"
+#include "gft/util.hpp"
 #include "pass/pass.hpp"
+#include "visitor/util.hpp"
+#include "util/stage-stats.hpp"
+#include "util/trace.hpp"
 
 using namespace liong;
 
 struct PassRegistry {
+  std::mutex sync;
   std::map<std::string, std::unique_ptr<Pass>> inner;
 };
 std::unique_ptr<PassRegistry> PASS_REG;
 
 Pass* reg_pass(std::unique_ptr<Pass>&& pass) {
+  // Passes are registered during static initialization, before any thread is
+  // spawned, so the creation of the registry itself needs no guard.
   if (PASS_REG == nullptr) {
     PASS_REG = std::make_unique<PassRegistry>();
   }
+  std::lock_guard<std::mutex> guard(PASS_REG->sync);
   return (*PASS_REG).inner
     .emplace(pass->name, std::forward<std::unique_ptr<Pass>>(pass))
     .first->second.get();
 }
-void apply_pass(const std::string& name, NodeRef& node) {
+const Pass* get_pass(const std::string& name) {
+  std::lock_guard<std::mutex> guard(PASS_REG->sync);
   auto it = PASS_REG->inner.find(name);
   assert(it != PASS_REG->inner.end(), "'", name, "' is not a registered pass");
-  it->second->apply(node);
+  return it->second.get();
+}
+std::vector<std::string> list_passes() {
+  std::lock_guard<std::mutex> guard(PASS_REG->sync);
+  std::vector<std::string> out;
+  out.reserve(PASS_REG->inner.size());
+  for (const auto& pair : PASS_REG->inner) {
+    out.emplace_back(pair.first);
+  }
+  return out;
+}
+
+// Apply `pass`, measured if stage statistics are enabled.
+static bool apply_measured(const Pass* pass, NodeRef& node) {
+  // Pass names live as long as the registry.
+  CSPV_TRACE_SCOPE(pass->name.c_str());
+  if (!is_stage_stats_enabled()) {
+    return pass->apply(node);
+  }
+  size_t nnode_before = count_nodes(node);
+  StageTimer timer(pass->name, "pass");
+  bool changed = pass->apply(node);
+  timer.stop();
+  timer.set_changed(changed);
+  timer.set_node_counts(nnode_before, count_nodes(node));
+  return changed;
+}
+
+bool apply_pass(const std::string& name, NodeRef& node) {
+  // Registered passes are never removed, and they are stateless. So it's safe
+  // to apply them without holding the lock.
+  return apply_measured(get_pass(name), node);
+}
+
+bool PassManager::apply_(
+  const Pass* pass,
+  NodeRef& node,
+  std::vector<const Pass*>& stack
+) {
+  if (valid.find(pass) != valid.end()) { return false; }
+  assert(std::find(stack.begin(), stack.end(), pass) == stack.end(),
+    "pass '", pass->name, "' depends on itself");
+
+  // Prerequisites are only scheduled if they have never been applied. A pass
+  // applied earlier might have been undone by later passes but re-applying
+  // it is the caller's call.
+  bool changed = false;
+  stack.emplace_back(pass);
+  for (const auto& dep_name : pass->deps) {
+    const Pass* dep = get_pass(dep_name);
+    if (applied.find(dep) == applied.end()) {
+      changed |= apply_(dep, node, stack);
+    }
+  }
+  stack.pop_back();
+
+  applied.emplace(pass);
+  if (apply_measured(pass, node)) {
+    // Every other pass has to be applied again to take effect.
+    valid.clear();
+    changed = true;
+  }
+  valid.emplace(pass);
+  return changed;
+}
+bool PassManager::apply(const std::string& name, NodeRef& node) {
+  std::vector<const Pass*> stack;
+  return apply_(get_pass(name), node, stack);
+}
+bool PassManager::apply_fixed_point(
+  const std::vector<std::string>& names,
+  NodeRef& node
+) {
+  bool changed = false;
+  for (uint32_t i = 0; i < max_niter; ++i) {
+    bool changed_this_iter = false;
+    for (const auto& name : names) {
+      changed_this_iter |= apply(name, node);
+    }
+    if (!changed_this_iter) { return changed; }
+    changed = true;
+  }
+  log::warn("pass group '", util::join("+", names), "' didn't converge in ",
+    max_niter, " iterations");
+  return changed;
 }
@@ -3,10 +3,17 @@
 #include "pass/pass.hpp"
 #include "visitor/visitor.hpp"
 #include "visitor/util.hpp"
+#include "node/intern.hpp"
 
 using namespace liong;
 
-struct RangedLoopElevationMutator : public Mutator {
+template<typename TBase>
+struct RangedLoopElevationMutator : public TBase {
+  using TBase::mutate_stmt;
+  using TBase::mark_changed;
+  using TBase::mutate_expr_;
+  using TBase::mutate_stmt_;
+
   struct Candidate {
     MemoryRef func_var;
     ExprRef begin_expr;
@@ -17,25 +24,28 @@ struct RangedLoopElevationMutator : public Mutator {
   std::map<MemoryRef, ExprRef> mem_value_map;
   std::map<MemoryFunctionVariableRef, MemoryIterationVariableRef> itervar_map;
 
-  virtual ExprRef mutate_expr_(ExprLoadRef x) override final {
+  ExprRef mutate_expr_(const ExprLoadRef& x_) {
+    ExprLoadRef x = x_;
     if (x->src_ptr->is<MemoryFunctionVariable>()) {
       mem_value_map.erase(x->src_ptr);
 
       auto it = itervar_map.find(x->src_ptr);
       if (it != itervar_map.end()) {
         x->src_ptr = it->second;
+        mark_changed();
       }
     }
-    return Mutator::mutate_expr_(x);
+    return TBase::mutate_expr_(x);
   }
 
-  virtual StmtRef mutate_stmt_(StmtStoreRef x) override final {
+  StmtRef mutate_stmt_(const StmtStoreRef& x) {
     if (x->dst_ptr->is<MemoryFunctionVariable>()) {
       mem_value_map.emplace(x->dst_ptr, x->value);
     }
-    return Mutator::mutate_stmt_(x);
+    return TBase::mutate_stmt_(x);
   }
-  virtual StmtRef mutate_stmt_(StmtConditionalBranchRef x) override final {
+  StmtRef mutate_stmt_(const StmtConditionalBranchRef& x_) {
+    StmtConditionalBranchRef x = x_;
     auto mem_value_map2 = mem_value_map;
     x->then_block = mutate_stmt(x->then_block);
     mem_value_map = std::exchange(mem_value_map2, std::move(mem_value_map));
@@ -51,7 +61,8 @@ struct RangedLoopElevationMutator : public Mutator {
     }
     return x;
   }
-  virtual StmtRef mutate_stmt_(StmtConditionalLoopRef x) override final {
+  StmtRef mutate_stmt_(const StmtConditionalLoopRef& x_) {
+    StmtConditionalLoopRef x = x_;
 
     // Ranged loop has an only itervar mutated in the continue block.
     TypePatternCaptureRef func_var_ty_pat = new TypePatternCapture;
@@ -71,9 +82,9 @@ struct RangedLoopElevationMutator : public Mutator {
     StmtRef cond_pat = new StmtPatternHead(
       new StmtConditionalBranch(
         new ExprNot(
-          new TypeBool,
+          intern_ty(new TypeBool),
           new ExprPatternBinaryOp(
-            new TypeBool,
+            intern_ty(new TypeBool),
             {},
             new ExprLoad(func_var_ty_pat, func_var_pat),
             end_pat
@@ -117,10 +128,15 @@ struct RangedLoopElevationMutator : public Mutator {
 };
 
 struct RangedLoopElevationPass : public Pass {
-  RangedLoopElevationPass() : Pass("ranged-loop-elevation") {}
-  virtual void apply(NodeRef& x) override final {
-    RangedLoopElevationMutator v;
-    x = v.mutate(x);
+  RangedLoopElevationPass() : Pass("ranged-loop-elevation", { "graph-normalization", "ctrlflow-linearization" }) {}
+  virtual bool apply(NodeRef& x) const override final {
+    return apply_with_dispatch(x, L_PASS_DISPATCH_VIRTUAL);
+  }
+  virtual bool apply_with_dispatch(
+    NodeRef& x,
+    PassDispatch dispatch
+  ) const override final {
+    return apply_mutator<RangedLoopElevationMutator>(x, dispatch);
   }
 };
 static Pass* PASS = reg_pass<RangedLoopElevationPass>();
@@ -1,20 +1,27 @@
 #include "gft/assert.hpp"
+#include "gft/log.hpp"
 #include "spv/abstr.hpp"
+#include "util/trace.hpp"
 
 using namespace liong;
 
-SpirvAbstract scan_spirv(const std::vector<uint32_t>& spv) {
+SpirvAbstract scan_spirv(const SpirvBinary& binary) {
+  CSPV_TRACE_SCOPE("scan_spirv");
   SpirvAbstract out {};
+  out.binary = binary;
+  const uint32_t* spv = binary.beg;
   out.head.magic = spv[0];
   out.head.version = spv[1];
   out.head.generator_magic = spv[2];
   out.head.bound = spv[3];
   out.head.reserved = spv[4];
 
-  out.beg = spv.data() + 5;
-  out.end = spv.data() + spv.size();
-  InstructionRef cur = out.beg;
-  while (cur < out.end) {
+  out.beg = binary.beg + 5;
+  out.end = binary.end;
+  out.id2instr_map.resize(out.head.bound);
+  out.nid_occupied = 0;
+  InstructionRef cur = out.beg < out.end ? out.beg : nullptr;
+  while (cur != nullptr) {
     const InstructionRef instr(cur);
     spv::Op op = instr.op();
 
@@ -25,9 +32,12 @@ SpirvAbstract scan_spirv(const std::vector<uint32_t>& spv) {
 
     spv::Id result_id = instr.result_id();
     if (result_id) {
-      auto it = out.id2instr_map.find(result_id);
-      if (it == out.id2instr_map.end()) {
-        out.id2instr_map.emplace(std::make_pair(result_id, cur));
+      assert(result_id < out.head.bound, "result id #", result_id,
+        " exceeds the id bound ", out.head.bound);
+      InstructionRef& slot = out.id2instr_map[result_id];
+      if (slot == nullptr) {
+        slot = cur;
+        ++out.nid_occupied;
       } else {
         panic("result id #", result_id, " is assigned by more than one "
           "instructions");
@@ -35,8 +45,10 @@ SpirvAbstract scan_spirv(const std::vector<uint32_t>& spv) {
     }
 
   done:
-    cur = cur.next();
+    cur = cur.next(out.end);
   }
 
+  log::debug("scanned spirv: ", out.nid_occupied, " of ", out.head.bound,
+    " id slots are occupied");
   return out;
 }
@@ -1,4 +1,6 @@
+#include "gft/util.hpp"
 #include "spv/ast.hpp"
+#include "util/trace.hpp"
 
 using namespace liong;
 
@@ -45,30 +47,54 @@ struct ParserState {
   InstructionRef cur;
   InstructionRef cur_block_label;
 
-  std::shared_ptr<uint8_t> loop_handle;
+  NodeHandle loop_handle = INVALID_NODE_HANDLE;
   InstructionRef loop_continue_target;
   InstructionRef loop_merge_target;
   InstructionRef loop_back_edge_target;
-  std::shared_ptr<uint8_t> sel_handle;
+  NodeHandle sel_handle = INVALID_NODE_HANDLE;
   InstructionRef sel_merge_target;
 
   bool is_inside_block = false;
   bool is_first_block = true;
 };
 
+// Objects local to the function being parsed. The module is shared by all the
+// entry points parsed concurrently, so it's never written while parsing
+// function bodies.
+struct FunctionScope {
+  const SpirvModule& mod;
+  SpirvIdMap<MemoryRef> mem_map;
+  SpirvIdMap<ExprRef> expr_map;
+  NodeHandleAllocator handle_alloc;
+
+  FunctionScope(const SpirvModule& mod) :
+    mod(mod),
+    mem_map("memory", mod.abstr.head.bound),
+    expr_map("expression", mod.abstr.head.bound),
+    handle_alloc() {}
+
+  inline const MemoryRef& get_mem(spv::Id id) const {
+    return mem_map.has(id) ? mem_map.at(id) : mod.mem_map.at(id);
+  }
+  inline const ExprRef& get_expr(spv::Id id) const {
+    return expr_map.has(id) ? expr_map.at(id) : mod.expr_map.at(id);
+  }
+};
+
 struct ControlFlowParser {
-  SpirvModule& mod;
+  const SpirvModule& mod;
+  FunctionScope& scope;
   ParserState parser_state;
 
-  std::vector<StmtRef> stmts;
+  NodeList<StmtRef> stmts;
 
 
 
 
   ControlFlowParser(
-    SpirvModule& mod,
+    FunctionScope& scope,
     ParserState&& parser_state
-  ) : mod(mod), parser_state(std::forward<ParserState>(parser_state)), stmts() {}
+  ) : mod(scope.mod), scope(scope), parser_state(std::forward<ParserState>(parser_state)), stmts() {}
 
 
 
@@ -111,8 +137,8 @@ struct ControlFlowParser {
     spv::StorageClass store_cls = e.read_u32_as<spv::StorageClass>();
     // Merely function vairables.
     assert(store_cls == spv::StorageClass::Function);
-    auto mem = MemoryRef(new MemoryFunctionVariable(var_ty, {}, std::make_shared<uint8_t>()));
-    mod.mem_map.emplace(instr, mem);
+    auto mem = MemoryRef(new MemoryFunctionVariable(var_ty, {}, scope.handle_alloc.alloc()));
+    scope.mem_map.emplace(instr, mem);
 
     parser_state.cur = instr.next();
   }
@@ -125,10 +151,11 @@ struct ControlFlowParser {
     auto ty = ((const TypePointer*)ptr_ty.get())->inner;
 
     auto e = instr.extract_params();
-    auto base = mod.mem_map.at(e.read_id());
-    auto ac = base->ac;
+    auto base = scope.get_mem(e.read_id());
+    // Derived chains share the links of the base chain.
+    AccessChain ac = base->ac;
     while (e) {
-      ac.emplace_back(mod.expr_map.at(e.read_id()));
+      ac = ac.append(scope.get_expr(e.read_id()));
     }
 
     MemoryRef mem = nullptr;
@@ -153,7 +180,7 @@ struct ControlFlowParser {
     }
     default: unimplemented();
     }
-    mod.mem_map.emplace(instr, std::move(mem));
+    scope.mem_map.emplace(instr, std::move(mem));
 
     parser_state.cur = instr.next();
     return true;
@@ -167,7 +194,7 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto src_ptr = mod.mem_map.at(e.read_id());
+      auto src_ptr = scope.get_mem(e.read_id());
       expr = ExprRef(new ExprLoad(ty, src_ptr));
       break;
     }
@@ -176,8 +203,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprAdd(ty, a, b));
       break;
     }
@@ -186,8 +213,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprMul(ty, a, b));
       break;
     }
@@ -197,8 +224,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprDiv(ty, a, b));
       break;
     }
@@ -207,8 +234,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprMod(ty, a, b));
       break;
     }
@@ -218,8 +245,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprLt(ty, a, b));
       break;
     }
@@ -229,8 +256,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprLt(ty, b, a));
       break;
     }
@@ -241,7 +268,7 @@ struct ControlFlowParser {
     {
       auto dst_ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto src = mod.expr_map.at(e.read_id());
+      auto src = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprTypeCast(dst_ty, src));
       break;
     }
@@ -250,8 +277,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprEq(ty, a, b));
       break;
     }
@@ -260,8 +287,8 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_ty_id());
       auto e = instr.extract_params();
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprNot(ty, new ExprEq(ty, a, b)));
       break;
     }
@@ -269,16 +296,16 @@ struct ControlFlowParser {
     {
       auto ty = mod.ty_map.at(instr.result_id());
       auto e = instr.extract_params();
-      auto cond = mod.expr_map.at(e.read_id());
+      auto cond = scope.get_expr(e.read_id());
       assert(cond->ty->is<TypeBool>());
-      auto a = mod.expr_map.at(e.read_id());
-      auto b = mod.expr_map.at(e.read_id());
+      auto a = scope.get_expr(e.read_id());
+      auto b = scope.get_expr(e.read_id());
       expr = ExprRef(new ExprSelect(ty, cond, a, b));
     }
     default:
       return false;
     }
-    mod.expr_map.emplace(instr, expr);
+    scope.expr_map.emplace(instr, expr);
 
     parser_state.cur = instr.next();
     return true;
@@ -292,13 +319,13 @@ struct ControlFlowParser {
     {
       SelectionMerge sr(instr);
       merge_target = mod.lookup_instr(sr.merge_target);
-      std::shared_ptr<uint8_t> handle = std::make_shared<uint8_t>();
+      NodeHandle handle = scope.handle_alloc.alloc();
 
       ParserState parser_state2 = parser_state;
       parser_state2.cur = instr.next();
       parser_state2.sel_handle = handle;
       parser_state2.sel_merge_target = merge_target;
-      auto body_stmt = parse(mod, std::move(parser_state2));
+      auto body_stmt = parse(scope, std::move(parser_state2));
 
       auto stmt = body_stmt;
       stmts.emplace_back(std::move(stmt));
@@ -309,7 +336,7 @@ struct ControlFlowParser {
       LoopMerge sr(instr);
       merge_target = mod.lookup_instr(sr.merge_target);
       auto continue_target = mod.lookup_instr(sr.continue_target);
-      std::shared_ptr<uint8_t> handle = std::make_shared<uint8_t>();
+      NodeHandle handle = scope.handle_alloc.alloc();
 
       ParserState body_parser_state2 = parser_state;
       body_parser_state2.cur = instr.next();
@@ -317,7 +344,7 @@ struct ControlFlowParser {
       body_parser_state2.loop_merge_target = merge_target;
       body_parser_state2.loop_continue_target = continue_target;
       body_parser_state2.loop_back_edge_target = parser_state.cur_block_label;
-      auto body_stmt = parse(mod, std::move(body_parser_state2));
+      auto body_stmt = parse(scope, std::move(body_parser_state2));
 
       ParserState continue_parser_state2 = parser_state;
       continue_parser_state2.cur = continue_target.next();
@@ -325,7 +352,7 @@ struct ControlFlowParser {
       continue_parser_state2.loop_merge_target = merge_target;
       continue_parser_state2.loop_continue_target = continue_target;
       continue_parser_state2.loop_back_edge_target = parser_state.cur_block_label;
-      auto continue_stmt = parse(mod, std::move(continue_parser_state2));
+      auto continue_stmt = parse(scope, std::move(continue_parser_state2));
 
       ExprRef cond;
       if (body_stmt->is<StmtConditionalBranch>()) {
@@ -371,15 +398,15 @@ struct ControlFlowParser {
       parser_state.is_inside_block = false;
       BranchConditional sr(instr);
 
-      auto cond_expr = mod.expr_map.at(sr.cond);
+      auto cond_expr = scope.get_expr(sr.cond);
 
       ParserState then_parser_state2 = parser_state;
       then_parser_state2.cur = mod.lookup_instr(sr.then_label);
-      auto then_stmt = parse(mod, std::move(then_parser_state2));
+      auto then_stmt = parse(scope, std::move(then_parser_state2));
 
       ParserState else_parser_state2 = parser_state;
       else_parser_state2.cur = mod.lookup_instr(sr.else_label);
-      auto else_stmt = parse(mod, std::move(else_parser_state2));
+      auto else_stmt = parse(scope, std::move(else_parser_state2));
 
       auto stmt = StmtRef(new StmtConditionalBranch(cond_expr, then_stmt, else_stmt));
       stmts.emplace_back(std::move(stmt));
@@ -421,8 +448,8 @@ struct ControlFlowParser {
     case spv::Op::OpStore:
     {
       auto e = instr.extract_params();
-      auto dst_ptr = mod.mem_map.at(e.read_id());
-      auto value = mod.expr_map.at(e.read_id());
+      auto dst_ptr = scope.get_mem(e.read_id());
+      auto value = scope.get_expr(e.read_id());
       assert(dst_ptr != nullptr);
       assert(value != nullptr);
       stmt = StmtRef(new StmtStore(dst_ptr, value));
@@ -470,10 +497,11 @@ struct ControlFlowParser {
   }
 
   static StmtRef parse(
-    SpirvModule& mod,
+    FunctionScope& scope,
     ParserState&& parser_state
   ) {
-    ControlFlowParser parser(mod, std::forward<ParserState>(parser_state));
+    CSPV_TRACE_SCOPE("ControlFlowParser::parse");
+    ControlFlowParser parser(scope, std::forward<ParserState>(parser_state));
     parser.parse();
 
     StmtBlockRef stmt = new StmtBlock(std::move(parser.stmts));
@@ -484,24 +512,44 @@ struct ControlFlowParser {
     }
   }
   static StmtRef parse(
-    SpirvModule& mod,
+    const SpirvModule& mod,
     InstructionRef cur
   ) {
+    FunctionScope scope(mod);
     ParserState parser_state {};
     parser_state.cur = cur;
-    return parse(mod, std::move(parser_state));
+    return parse(scope, std::move(parser_state));
   }
 };
 
-std::map<std::string, StmtRef> extract_entry_points(SpirvModule& mod) {
+std::vector<std::string> list_entry_points(const SpirvModule& mod) {
+  std::vector<std::string> out;
+  out.reserve(mod.entry_points.size());
+  for (const auto& pair : mod.entry_points) {
+    out.emplace_back(pair.second.name);
+  }
+  return out;
+}
+
+StmtRef extract_entry_point(const SpirvModule& mod, const std::string& name) {
+  CSPV_TRACE_SCOPE("extract_entry_point");
+  for (const auto& pair : mod.entry_points) {
+    if (pair.second.name != name) { continue; }
+    const auto& func = mod.funcs.at(pair.second.func);
+    return ControlFlowParser::parse(mod, func.entry_label);
+  }
+  panic("entry point '", name, "' is not declared; available entry points "
+    "are: ", util::join(", ", list_entry_points(mod)));
+  return nullptr;
+}
+
+std::map<std::string, StmtRef> extract_entry_points(const SpirvModule& mod) {
   std::map<std::string, StmtRef> out {};
 
   for (const auto& pair : mod.entry_points) {
-    const auto& entry_point = mod.funcs.at(pair.second.func);
-    StmtRef root = ControlFlowParser::parse(mod, entry_point.entry_label);
-    out.emplace(pair.second.name, std::move(root));
+    const std::string& name = pair.second.name;
+    out.emplace(name, extract_entry_point(mod, name));
   }
 
   return out;
 }
-
@@ -0,0 +1,123 @@
+#include "gft/assert.hpp"
+#include "spv/instr.hpp"
+#include "spv/binary.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace liong;
+
+// Number of words in the SPIR-V module header.
+static const size_t NWORD_HEADER = 5;
+
+static void validate_spirv_words(const void* data, size_t size) {
+  assert(size % sizeof(uint32_t) == 0,
+    "spirv corrupted: size is not aligned to 4");
+  assert((uintptr_t)data % alignof(uint32_t) == 0,
+    "spirv corrupted: data is not aligned to 4");
+  assert(size >= NWORD_HEADER * sizeof(uint32_t),
+    "spirv corrupted: header is truncated");
+
+  uint32_t magic = *(const uint32_t*)data;
+  assert(magic == spv::MagicNumber, "spirv corrupted: magic number mismatched");
+}
+
+#ifdef _WIN32
+struct MappedFile {
+  HANDLE file;
+  HANDLE mapping;
+  const void* data;
+  size_t size;
+
+  ~MappedFile() {
+    if (data != nullptr) { UnmapViewOfFile(data); }
+    if (mapping != NULL) { CloseHandle(mapping); }
+    if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+  }
+};
+
+static std::shared_ptr<MappedFile> map_file(const char* path) {
+  auto out = std::make_shared<MappedFile>();
+  out->file = INVALID_HANDLE_VALUE;
+  out->mapping = NULL;
+  out->data = nullptr;
+  out->size = 0;
+
+  out->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  assert(out->file != INVALID_HANDLE_VALUE, "cannot open file '", path, "'");
+
+  LARGE_INTEGER size;
+  assert(GetFileSizeEx(out->file, &size), "cannot query size of '", path, "'");
+  out->size = (size_t)size.QuadPart;
+  if (out->size == 0) { return out; }
+
+  out->mapping = CreateFileMappingA(out->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  assert(out->mapping != NULL, "cannot map file '", path, "'");
+  out->data = MapViewOfFile(out->mapping, FILE_MAP_READ, 0, 0, 0);
+  assert(out->data != nullptr, "cannot map file '", path, "'");
+  return out;
+}
+#else
+struct MappedFile {
+  int fd;
+  const void* data;
+  size_t size;
+
+  ~MappedFile() {
+    if (data != nullptr) { munmap((void*)data, size); }
+    if (fd >= 0) { close(fd); }
+  }
+};
+
+static std::shared_ptr<MappedFile> map_file(const char* path) {
+  auto out = std::make_shared<MappedFile>();
+  out->fd = -1;
+  out->data = nullptr;
+  out->size = 0;
+
+  out->fd = open(path, O_RDONLY);
+  assert(out->fd >= 0, "cannot open file '", path, "'");
+
+  struct stat st;
+  assert(fstat(out->fd, &st) == 0, "cannot query size of '", path, "'");
+  out->size = (size_t)st.st_size;
+  if (out->size == 0) { return out; }
+
+  void* data = mmap(nullptr, out->size, PROT_READ, MAP_PRIVATE, out->fd, 0);
+  assert(data != MAP_FAILED, "cannot map file '", path, "'");
+  out->data = data;
+  return out;
+}
+#endif
+
+SpirvBinary map_spirv_binary(const char* path) {
+  std::shared_ptr<MappedFile> file = map_file(path);
+  validate_spirv_words(file->data, file->size);
+
+  SpirvBinary out {};
+  out.beg = (const uint32_t*)file->data;
+  out.end = out.beg + file->size / sizeof(uint32_t);
+  out.storage = std::move(file);
+  return out;
+}
+
+SpirvBinary make_spirv_binary(std::vector<uint32_t>&& words) {
+  auto storage = std::make_shared<std::vector<uint32_t>>(
+    std::forward<std::vector<uint32_t>>(words));
+  validate_spirv_words(storage->data(), storage->size() * sizeof(uint32_t));
+
+  SpirvBinary out {};
+  out.beg = storage->data();
+  out.end = storage->data() + storage->size();
+  out.storage = std::move(storage);
+  return out;
+}
@@ -0,0 +1,27 @@
+#include "spv/instr.hpp"
+
+OpPropertyTable OP_PROPERTY_TABLE;
+// Static initialization is single-threaded, so a plain flag suffices.
+static bool IS_OP_PROPERTY_TABLE_FILLED = false;
+
+OpPropertyTableInit::OpPropertyTableInit() {
+  if (IS_OP_PROPERTY_TABLE_FILLED) { return; }
+  for (uint32_t i = 0; i < 0x10000; ++i) {
+    bool has_result_id, has_result_ty_id;
+    spv::HasResultAndType((spv::Op)i, &has_result_id, &has_result_ty_id);
+
+    uint8_t param_offset = 1;
+    uint8_t prop = 0;
+    if (has_result_id) {
+      prop |= L_OP_PROPERTY_HAS_RESULT_ID_BIT;
+      ++param_offset;
+    }
+    if (has_result_ty_id) {
+      prop |= L_OP_PROPERTY_HAS_RESULT_TY_ID_BIT;
+      ++param_offset;
+    }
+    prop |= param_offset << L_OP_PROPERTY_PARAM_OFFSET_SHIFT;
+    OP_PROPERTY_TABLE.props[i] = prop;
+  }
+  IS_OP_PROPERTY_TABLE_FILLED = true;
+}
@@ -1,25 +1,127 @@
+#include <algorithm>
+#include <iterator>
 #include "gft/assert.hpp"
 #include "gft/log.hpp"
 #include "spv/mod.hpp"
 #include "spv/ast.hpp"
+#include "node/intern.hpp"
+#include "util/trace.hpp"
 
 using namespace liong;
 
+// Logical sections of a SPIR-V module, in the order they must appear.
+enum SpirvSection {
+  // Instructions not expected at module scope.
+  L_SPIRV_SECTION_UNKNOWN,
+  // Instructions cspv recognizes but doesn't support.
+  L_SPIRV_SECTION_UNSUPPORTED,
+  // Instructions allowed anywhere, like source line debug info.
+  L_SPIRV_SECTION_IGNORED,
+  L_SPIRV_SECTION_CAPABILITY,
+  L_SPIRV_SECTION_EXTENSION,
+  L_SPIRV_SECTION_EXT_INST_IMPORT,
+  L_SPIRV_SECTION_MEMORY_MODEL,
+  L_SPIRV_SECTION_ENTRY_POINT,
+  L_SPIRV_SECTION_EXECUTION_MODE,
+  L_SPIRV_SECTION_DEBUG,
+  L_SPIRV_SECTION_ANNOTATION,
+  // Types, constants and global variables can interleave with each other, so
+  // they share the same order.
+  L_SPIRV_SECTION_TYPE_DECLR,
+  L_SPIRV_SECTION_CONST_DECLR,
+  L_SPIRV_SECTION_GLOBAL_VAR_DECLR,
+  L_SPIRV_SECTION_FUNCTION,
+};
+static uint32_t get_section_order(SpirvSection section) {
+  switch (section) {
+  case L_SPIRV_SECTION_CONST_DECLR:
+  case L_SPIRV_SECTION_GLOBAL_VAR_DECLR:
+    return L_SPIRV_SECTION_TYPE_DECLR;
+  default:
+    return section;
+  }
+}
+
+// Classify any module-scope instruction into its section with one lookup.
+struct SpirvSectionTable {
+  uint8_t sections[0x10000];
+
+  void reg(SpirvSection section, std::initializer_list<spv::Op> ops) {
+    for (spv::Op op : ops) {
+      sections[(uint32_t)op & 0xffff] = section;
+    }
+  }
+  SpirvSectionTable() {
+    std::fill(std::begin(sections), std::end(sections), L_SPIRV_SECTION_UNKNOWN);
+    reg(L_SPIRV_SECTION_IGNORED, {
+      spv::Op::OpNop, spv::Op::OpLine, spv::Op::OpNoLine
+    });
+    reg(L_SPIRV_SECTION_CAPABILITY, { spv::Op::OpCapability });
+    reg(L_SPIRV_SECTION_EXTENSION, { spv::Op::OpExtension });
+    reg(L_SPIRV_SECTION_EXT_INST_IMPORT, { spv::Op::OpExtInstImport });
+    reg(L_SPIRV_SECTION_MEMORY_MODEL, { spv::Op::OpMemoryModel });
+    reg(L_SPIRV_SECTION_ENTRY_POINT, { spv::Op::OpEntryPoint });
+    reg(L_SPIRV_SECTION_EXECUTION_MODE, {
+      spv::Op::OpExecutionMode, spv::Op::OpExecutionModeId
+    });
+    reg(L_SPIRV_SECTION_DEBUG, {
+      spv::Op::OpString, spv::Op::OpSourceExtension, spv::Op::OpSource,
+      spv::Op::OpSourceContinued, spv::Op::OpName, spv::Op::OpMemberName,
+      spv::Op::OpModuleProcessed
+    });
+    reg(L_SPIRV_SECTION_ANNOTATION, {
+      spv::Op::OpDecorate, spv::Op::OpMemberDecorate, spv::Op::OpDecorateId
+    });
+    reg(L_SPIRV_SECTION_TYPE_DECLR, {
+      spv::Op::OpTypeVoid, spv::Op::OpTypeBool, spv::Op::OpTypeInt,
+      spv::Op::OpTypeFloat, spv::Op::OpTypeVector, spv::Op::OpTypeMatrix,
+      spv::Op::OpTypeImage, spv::Op::OpTypeSampler, spv::Op::OpTypeSampledImage,
+      spv::Op::OpTypeArray, spv::Op::OpTypeRuntimeArray, spv::Op::OpTypeStruct,
+      spv::Op::OpTypePointer, spv::Op::OpTypeFunction
+    });
+    reg(L_SPIRV_SECTION_CONST_DECLR, {
+      spv::Op::OpConstantTrue, spv::Op::OpConstantFalse, spv::Op::OpConstant,
+      spv::Op::OpConstantComposite, spv::Op::OpConstantSampler,
+      spv::Op::OpConstantNull, spv::Op::OpSpecConstantTrue,
+      spv::Op::OpSpecConstantFalse, spv::Op::OpSpecConstant,
+      spv::Op::OpSpecConstantComposite, spv::Op::OpSpecConstantOp
+    });
+    reg(L_SPIRV_SECTION_GLOBAL_VAR_DECLR, { spv::Op::OpVariable });
+    reg(L_SPIRV_SECTION_FUNCTION, { spv::Op::OpFunction });
+    // Group and string decorations, and these types are not supported.
+    reg(L_SPIRV_SECTION_UNSUPPORTED, {
+      spv::Op::OpDecorationGroup, spv::Op::OpGroupDecorate,
+      spv::Op::OpGroupMemberDecorate, spv::Op::OpDecorateString,
+      spv::Op::OpMemberDecorateString,
+      spv::Op::OpTypeOpaque, spv::Op::OpTypeEvent, spv::Op::OpTypeDeviceEvent,
+      spv::Op::OpTypeReserveId, spv::Op::OpTypeQueue, spv::Op::OpTypePipe,
+      spv::Op::OpTypeForwardPointer, spv::Op::OpTypePipeStorage,
+      spv::Op::OpTypeNamedBarrier
+    });
+  }
+
+  inline SpirvSection operator[](spv::Op op) const {
+    return (SpirvSection)sections[(uint32_t)op & 0xffff];
+  }
+};
+static const SpirvSectionTable SECTION_TABLE;
+
 struct SpirvVisitor {
   SpirvModule out;
   InstructionRef cur;
 
   SpirvVisitor(SpirvAbstract&& abstr) :
-    out(std::forward<SpirvAbstract>(abstr)), cur(abstr.beg) {}
+    out(std::forward<SpirvAbstract>(abstr)),
+    cur(out.abstr.beg < out.abstr.end ? out.abstr.beg : nullptr) {}
 
   constexpr bool ate() const {
-    return cur.inner >= out.abstr.end;
+    return cur == nullptr;
   }
 
   inline InstructionRef fetch_any_instr() {
     if (!ate()) {
       InstructionRef out = cur;
-      cur = cur.next();
+      cur = cur.next(this->out.abstr.end);
       return out;
     } else {
       return nullptr;
@@ -30,7 +132,7 @@ struct SpirvVisitor {
       InstructionRef out(cur);
       if (cur.op() == expected_op) {
         InstructionRef out = cur;
-        cur = cur.next();
+        cur = cur.next(this->out.abstr.end);
         return out;
       } else {
         return nullptr;
@@ -39,20 +141,9 @@ struct SpirvVisitor {
       return nullptr;
     }
   }
-  inline InstructionRef fetch_instr(
-    std::initializer_list<spv::Op> expected_ops
-  ) {
-    InstructionRef out;
-    for (spv::Op expected_op : expected_ops) {
-      if (out = fetch_instr(expected_op)) {
-        break;
-      }
-    }
-    return out;
-  }
 
   inline InstructionRef lookup_instr(spv::Id id) const {
-    return out.abstr.id2instr_map.at(id);
+    return out.abstr.lookup_instr(id);
   }
 
   inline uint32_t get_deco_u32(spv::Decoration deco, const InstructionRef& instr) const {
@@ -67,134 +158,87 @@ struct SpirvVisitor {
 
 
 
-  void visit_caps() {
-    InstructionRef instr;
-    while (instr = fetch_instr(spv::Op::OpCapability)) {
-      auto e = instr.extract_params();
-      spv::Capability cap = e.read_u32_as<spv::Capability>();
+  void visit_cap(const InstructionRef& instr) {
+    auto e = instr.extract_params();
+    spv::Capability cap = e.read_u32_as<spv::Capability>();
 
-      log::debug("required capability ", (uint32_t)cap);
-      out.caps.emplace_back(cap);
-    }
+    log::debug("required capability ", (uint32_t)cap);
+    out.caps.emplace_back(cap);
   }
-  void visit_exts() {
-    InstructionRef instr;
-    while (instr = fetch_instr(spv::Op::OpExtension)) {
-      auto e = instr.extract_params();
-      const char* ext = e.read_str();
+  void visit_ext(const InstructionRef& instr) {
+    auto e = instr.extract_params();
+    const char* ext = e.read_str();
 
-      log::debug("required extension ", ext);
-      out.exts.emplace_back(ext);
-    }
+    log::debug("required extension ", ext);
+    out.exts.emplace_back(ext);
   }
-  void visit_ext_instrs() {
-    InstructionRef instr;
-    while (instr = fetch_instr(spv::Op::OpExtInstImport)) {
-      auto e = instr.extract_params();
-      const char* ext_instr_name = e.read_str();
+  void visit_ext_instr(const InstructionRef& instr) {
+    auto e = instr.extract_params();
+    const char* ext_instr_name = e.read_str();
 
-      log::debug("imported extension instruction '", ext_instr_name, "'");
-      out.ext_instrs[instr] = ext_instr_name;
-    }
+    log::debug("imported extension instruction '", ext_instr_name, "'");
+    out.ext_instrs[instr] = ext_instr_name;
   }
-  void visit_mem_model() {
-    InstructionRef instr = fetch_instr(spv::Op::OpMemoryModel);
-    assert(instr, "memory model instruction missing");
-
+  void visit_mem_model(const InstructionRef& instr) {
     auto e = instr.extract_params();
     out.addr_model = e.read_u32_as<spv::AddressingModel>();
     out.mem_model = e.read_u32_as<spv::MemoryModel>();
   }
-  void visit_entry_points() {
-    InstructionRef instr;
-    while (instr = fetch_instr(spv::Op::OpEntryPoint)) {
-      auto e = instr.extract_params();
+  void visit_entry_point(const InstructionRef& instr) {
+    auto e = instr.extract_params();
 
-      SpirvEntryPoint entry_point {};
-      entry_point.exec_model = e.read_u32_as<spv::ExecutionModel>();
-      entry_point.func = lookup_instr(e.read_id());
-      const char* name = e.read_str();
-      entry_point.name = name;
-      while (e.cur < e.end) {
-        InstructionRef interface = lookup_instr(e.read_id());
-        entry_point.interfaces.emplace_back(interface);
-      }
-      auto old = out.entry_points.emplace(
-        std::make_pair(entry_point.func, std::move(entry_point)));
-      assert(old.second, "entry point '", name, "' is already declared");
-    }
+    SpirvEntryPoint entry_point {};
+    entry_point.exec_model = e.read_u32_as<spv::ExecutionModel>();
+    entry_point.func = lookup_instr(e.read_id());
+    const char* name = e.read_str();
+    entry_point.name = name;
+    while (e.cur < e.end) {
+      InstructionRef interface = lookup_instr(e.read_id());
+      entry_point.interfaces.emplace_back(interface);
+    }
+    auto old = out.entry_points.emplace(
+      std::make_pair(entry_point.func, std::move(entry_point)));
+    assert(old.second, "entry point '", name, "' is already declared");
   }
-  void visit_exec_modes() {
-    InstructionRef instr;
-    while (instr = fetch_instr({
-      spv::Op::OpExecutionMode, spv::Op::OpExecutionModeId
-      })) {
-      auto e = instr.extract_params();
+  void visit_exec_mode(const InstructionRef& instr) {
+    auto e = instr.extract_params();
 
-      spv::Id id = e.read_id();
-      spv::ExecutionMode exec_mode = e.read_u32_as<spv::ExecutionMode>();
-
-      SpirvEntryPoint& exec_point = out.entry_points.at(lookup_instr(id));
-      if (exec_mode == spv::ExecutionMode::LocalSize) {
-        assert(exec_point.exec_model == spv::ExecutionModel::GLCompute);
-        exec_point.exec_mode_comp.local_size_x = e.read_u32();
-        exec_point.exec_mode_comp.local_size_y = e.read_u32();
-        exec_point.exec_mode_comp.local_size_z = e.read_u32();
-      } else if (exec_mode == spv::ExecutionMode::LocalSize) {
-        assert(exec_point.exec_model == spv::ExecutionModel::GLCompute);
-        exec_point.exec_mode_comp.local_size_x_id = e.read_id();
-        exec_point.exec_mode_comp.local_size_y_id = e.read_id();
-        exec_point.exec_mode_comp.local_size_z_id = e.read_id();
-      } else {
-        assert("unsupported execution model ", (uint32_t)exec_mode);
-      }
+    spv::Id id = e.read_id();
+    spv::ExecutionMode exec_mode = e.read_u32_as<spv::ExecutionMode>();
+
+    SpirvEntryPoint& exec_point = out.entry_points.at(lookup_instr(id));
+    if (exec_mode == spv::ExecutionMode::LocalSize) {
+      assert(exec_point.exec_model == spv::ExecutionModel::GLCompute);
+      exec_point.exec_mode_comp.local_size_x = e.read_u32();
+      exec_point.exec_mode_comp.local_size_y = e.read_u32();
+      exec_point.exec_mode_comp.local_size_z = e.read_u32();
+    } else if (exec_mode == spv::ExecutionMode::LocalSize) {
+      assert(exec_point.exec_model == spv::ExecutionModel::GLCompute);
+      exec_point.exec_mode_comp.local_size_x_id = e.read_id();
+      exec_point.exec_mode_comp.local_size_y_id = e.read_id();
+      exec_point.exec_mode_comp.local_size_z_id = e.read_id();
+    } else {
+      assert("unsupported execution model ", (uint32_t)exec_mode);
     }
   }
-  void visit_debug_instrs() {
-    InstructionRef instr;
-    while (instr = fetch_instr({
-      spv::Op::OpString, spv::Op::OpSourceExtension, spv::Op::OpSource,
-      spv::Op::OpSourceContinued, spv::Op::OpName, spv::Op::OpMemberName,
-      spv::Op::OpModuleProcessed
-      })) {
-      spv::Op op = instr.op();
-      // TODO: (penguinliong) Not necessarily processing these.
-    }
+  void visit_debug_instr(const InstructionRef& instr) {
+    // TODO: (penguinliong) Not necessarily processing these.
   }
-  void visit_annotations() {
-    InstructionRef instr;
-    while (instr = fetch_instr({
-      spv::Op::OpDecorate, spv::Op::OpMemberDecorate, spv::Op::OpDecorateId
-      })) {
-      spv::Op op = instr.op();
-      if (op == spv::Op::OpMemberDecorate) {
-        auto e = instr.extract_params();
-        InstructionRef target = lookup_instr(e.read_id());
-        uint32_t imember = e.read_u32();
-        spv::Decoration deco = e.read_u32_as<spv::Decoration>();
-        MemberDecoration record {};
-        record.deco = deco;
-        record.imember = imember;
-        record.instr = instr;
-        out.instr2member_deco_map[target].emplace_back(std::move(record));
-      } else {
-        auto e = instr.extract_params();
-        InstructionRef target = lookup_instr(e.read_id());
-        spv::Decoration deco = e.read_u32_as<spv::Decoration>();
-        Decoration record {};
-        record.deco = deco;
-        record.instr = instr;
-        out.instr2deco_map[target].emplace_back(std::move(record));
+  void visit_annotation(const InstructionRef& instr) {
+    spv::Op op = instr.op();
+    auto e = instr.extract_params();
+    SpirvIdDecorations& record = out.deco_index.get_or_create(e.read_id());
+    if (op == spv::Op::OpMemberDecorate) {
+      uint32_t imember = e.read_u32();
+      if (imember >= record.member_decos.size()) {
+        record.member_decos.resize(imember + 1);
       }
-
+      spv::Decoration deco = e.read_u32_as<spv::Decoration>();
+      record.member_decos[imember].reg(deco, instr, e);
+    } else {
+      spv::Decoration deco = e.read_u32_as<spv::Decoration>();
+      record.decos.reg(deco, instr, e);
     }
-
-    // Group and string decorations are unsupported.
-    assert(!fetch_instr({
-      spv::Op::OpDecorationGroup, spv::Op::OpGroupDecorate,
-      spv::Op::OpGroupMemberDecorate, spv::Op::OpDecorateString,
-      spv::Op::OpMemberDecorateString
-      }), "group and string decorations are not supported");
   }
 
 
@@ -202,34 +246,34 @@ struct SpirvVisitor {
     switch (instr.op()) {
     case spv::Op::OpTypeVoid:
     {
-      return TypeRef(new TypeVoid);
+      return intern_ty(new TypeVoid);
     }
     case spv::Op::OpTypeBool:
     {
-      return TypeRef(new TypeBool);
+      return intern_ty(new TypeBool);
     }
     case spv::Op::OpTypeInt:
     {
       auto e = instr.extract_params();
       uint32_t nbit = e.read_u32();
       bool is_signed = e.read_bool();
-      return TypeRef(new TypeInt(nbit, is_signed));
+      return intern_ty(new TypeInt(nbit, is_signed));
     }
     case spv::Op::OpTypeFloat:
     {
       auto e = instr.extract_params();
       uint32_t nbit = e.read_u32();
-      return TypeRef(new TypeFloat(nbit));
+      return intern_ty(new TypeFloat(nbit));
     }
     case spv::Op::OpTypeStruct:
     {
       auto e = instr.extract_params();
-      std::vector<TypeRef> members;
+      NodeList<TypeRef> members;
       while (e) {
         auto member_ty = out.ty_map.at(e.read_id());
         members.emplace_back(member_ty);
       }
-      return TypeRef(new TypeStruct(std::move(members)));
+      return intern_ty(new TypeStruct(std::move(members)));
     }
     case spv::Op::OpTypePointer:
     {
@@ -240,11 +284,11 @@ struct SpirvVisitor {
       if (
         storage_cls == spv::StorageClass::Uniform &&
         inner->is<TypeStruct>() &&
-        has_deco(spv::Decoration::BufferBlock, out.abstr.id2instr_map.at(inner_id))
+        out.deco_index.get_decos(inner_id).is_buffer_block
       ) {
         storage_cls = spv::StorageClass::StorageBuffer;
       }
-      return TypeRef(new TypePointer(inner, storage_cls));
+      return intern_ty(new TypePointer(inner, storage_cls));
     }
     case spv::Op::OpTypeFunction:
     {
@@ -256,30 +300,14 @@ struct SpirvVisitor {
   }
 
   // Type, constants, global variable declaration.
-  bool visit_ty_declrs() {
-    InstructionRef instr;
-    if (instr = fetch_instr({
-      spv::Op::OpTypeVoid, spv::Op::OpTypeBool, spv::Op::OpTypeInt,
-      spv::Op::OpTypeFloat, spv::Op::OpTypeVector, spv::Op::OpTypeMatrix,
-      spv::Op::OpTypeImage, spv::Op::OpTypeSampler, spv::Op::OpTypeSampledImage,
-      spv::Op::OpTypeArray, spv::Op::OpTypeRuntimeArray, spv::Op::OpTypeStruct,
-      spv::Op::OpTypePointer, spv::Op::OpTypeFunction
-      })) {
-      auto id = instr.result_id();
-      assert(id != L_INVALID_ID);
-      auto ty = parse_ty(instr);
+  void visit_ty_declr(const InstructionRef& instr) {
+    auto id = instr.result_id();
+    assert(id != L_INVALID_ID);
+    auto ty = parse_ty(instr);
+    // Function types aren't represented as nodes.
+    if (ty != nullptr) {
       out.ty_map.emplace(id, std::move(ty));
-      return true;
     }
-
-    // These types are not supported.
-    assert(!fetch_instr({
-      spv::Op::OpTypeOpaque, spv::Op::OpTypeEvent, spv::Op::OpTypeDeviceEvent,
-      spv::Op::OpTypeReserveId, spv::Op::OpTypeQueue, spv::Op::OpTypePipe,
-      spv::Op::OpTypeForwardPointer, spv::Op::OpTypePipeStorage,
-      spv::Op::OpTypeNamedBarrier
-      }));
-    return false;
   }
 
   ExprRef parse_const(const InstructionRef& instr) {
@@ -347,23 +375,11 @@ struct SpirvVisitor {
     return nullptr;
   }
 
-  bool visit_const_declrs() {
-    InstructionRef instr;
-    if (instr = fetch_instr({
-      spv::Op::OpConstantTrue, spv::Op::OpConstantFalse, spv::Op::OpConstant,
-      spv::Op::OpConstantComposite, spv::Op::OpConstantSampler,
-      spv::Op::OpConstantNull, spv::Op::OpSpecConstantTrue,
-      spv::Op::OpSpecConstantFalse, spv::Op::OpSpecConstant,
-      spv::Op::OpSpecConstantComposite, spv::Op::OpSpecConstantOp
-      })) {
-      spv::Id id = instr.result_id();
-      assert(id != L_INVALID_ID);
-      auto constant = parse_const(instr);
-      out.expr_map.emplace(id, std::move(constant));
-      return true;
-    }
-
-    return false;
+  void visit_const_declr(const InstructionRef& instr) {
+    spv::Id id = instr.result_id();
+    assert(id != L_INVALID_ID);
+    auto constant = parse_const(instr);
+    out.expr_map.emplace(id, std::move(constant));
   }
 
   MemoryRef parse_global_mem(const InstructionRef& ptr) {
@@ -377,8 +393,11 @@ struct SpirvVisitor {
         "function variables are parsed within functions");
 
       // Descriptor resources.
-      uint32_t binding = get_deco_u32(spv::Decoration::Binding, ptr);
-      uint32_t set = get_deco_u32(spv::Decoration::DescriptorSet, ptr);
+      const SpirvDecorationSet& decos = out.get_decos(ptr);
+      assert(decos.has_binding && decos.has_set, "descriptor resource #",
+        ptr.result_id(), " is not decorated with binding and set");
+      uint32_t binding = decos.binding;
+      uint32_t set = decos.set;
       if (store_cls == spv::StorageClass::Uniform) {
         return MemoryRef(new MemoryUniformBuffer(var_ty, {}, binding, set));
       } else if (store_cls == spv::StorageClass::StorageBuffer) {
@@ -394,27 +413,11 @@ struct SpirvVisitor {
     return nullptr;
   }
 
-  bool visit_global_var_declrs() {
-    InstructionRef instr {};
-    if (instr = fetch_instr(spv::Op::OpVariable)) {
-      spv::Id id = instr.result_id();
-      assert(id != L_INVALID_ID);
-      auto mem = parse_global_mem(instr);
-      out.mem_map.emplace(id, std::move(mem));
-      return true;
-    }
-
-    return false;
-  }
-  void visit_global_declrs() {
-    // TODO: (penguinliong) Deal with non-semantic instructions.
-    for (;;) {
-      bool success =
-        visit_ty_declrs() ||
-        visit_const_declrs() ||
-        visit_global_var_declrs();
-      if (!success) { break; }
-    }
+  void visit_global_var_declr(const InstructionRef& instr) {
+    spv::Id id = instr.result_id();
+    assert(id != L_INVALID_ID);
+    auto mem = parse_global_mem(instr);
+    out.mem_map.emplace(id, std::move(mem));
   }
 
 
@@ -446,46 +449,71 @@ struct SpirvVisitor {
     }
   }
 
-  void visit_func() {
-    InstructionRef instr {};
-    if (instr = fetch_instr(spv::Op::OpFunction)) {
-      auto e = instr.extract_params();
+  void visit_func(const InstructionRef& instr) {
+    CSPV_TRACE_SCOPE("SpirvVisitor::visit_func");
+    auto e = instr.extract_params();
 
-      SpirvFunction func {};
-      func.func_ctrl = e.read_u32_as<spv::FunctionControlMask>();
-      func.return_ty = lookup_instr(instr.result_ty_id());
-      func.func_ty = lookup_instr(e.read_id());
+    SpirvFunction func {};
+    func.func_ctrl = e.read_u32_as<spv::FunctionControlMask>();
+    func.return_ty = lookup_instr(instr.result_ty_id());
+    func.func_ty = lookup_instr(e.read_id());
 
-      visit_func_params(func);
-      visit_func_body(func);
+    visit_func_params(func);
+    visit_func_body(func);
 
-      out.funcs.emplace(instr, std::move(func));
-    }
-  }
-  void visit_funcs() {
-    InstructionRef instr {};
-    while (!ate()) {
-      visit_func();
-    }
+    out.funcs.emplace(instr, std::move(func));
   }
 
 
+  // Classify each module-scope instruction into its section with a single
+  // table lookup and route it to the section handler. Sections must appear in
+  // the order defined by `SpirvSection`.
   void visit() {
-    visit_caps();
-    visit_exts();
-    visit_ext_instrs();
-    visit_mem_model();
-    visit_entry_points();
-    visit_exec_modes();
-    visit_debug_instrs();
-    visit_annotations();
-    visit_global_declrs();
-    visit_funcs();
+    uint32_t last_order = L_SPIRV_SECTION_CAPABILITY;
+    bool has_mem_model = false;
+    InstructionRef instr;
+    while (instr = fetch_any_instr()) {
+      SpirvSection section = SECTION_TABLE[instr.op()];
+      if (section == L_SPIRV_SECTION_IGNORED) { continue; }
+
+      assert(section != L_SPIRV_SECTION_UNKNOWN,
+        "unexpected instruction (op=", (uint32_t)instr.op(), ") at module "
+        "scope");
+      assert(section != L_SPIRV_SECTION_UNSUPPORTED,
+        "unsupported instruction (op=", (uint32_t)instr.op(), ")");
+
+      uint32_t order = get_section_order(section);
+      assert(order >= last_order, "instruction (op=", (uint32_t)instr.op(),
+        ") is out of the module section order");
+      last_order = order;
+
+      switch (section) {
+      case L_SPIRV_SECTION_CAPABILITY: visit_cap(instr); break;
+      case L_SPIRV_SECTION_EXTENSION: visit_ext(instr); break;
+      case L_SPIRV_SECTION_EXT_INST_IMPORT: visit_ext_instr(instr); break;
+      case L_SPIRV_SECTION_MEMORY_MODEL:
+        assert(!has_mem_model, "memory model is declared more than once");
+        visit_mem_model(instr);
+        has_mem_model = true;
+        break;
+      case L_SPIRV_SECTION_ENTRY_POINT: visit_entry_point(instr); break;
+      case L_SPIRV_SECTION_EXECUTION_MODE: visit_exec_mode(instr); break;
+      case L_SPIRV_SECTION_DEBUG: visit_debug_instr(instr); break;
+      case L_SPIRV_SECTION_ANNOTATION: visit_annotation(instr); break;
+      case L_SPIRV_SECTION_TYPE_DECLR: visit_ty_declr(instr); break;
+      case L_SPIRV_SECTION_CONST_DECLR: visit_const_declr(instr); break;
+      case L_SPIRV_SECTION_GLOBAL_VAR_DECLR: visit_global_var_declr(instr); break;
+      case L_SPIRV_SECTION_FUNCTION: visit_func(instr); break;
+      default: unreachable();
+      }
+    }
+    assert(has_mem_model, "memory model instruction missing");
     assert(ate(), "spirv is not exhausted");
   }
 };
 
 SpirvModule parse_spirv_module(SpirvAbstract&& abstr) {
+  CSPV_TRACE_SCOPE("parse_spirv_module");
   SpirvVisitor visitor(std::forward<SpirvAbstract>(abstr));
   visitor.visit();
   return visitor.out;
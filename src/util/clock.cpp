@@ -0,0 +1,7 @@
+#include <chrono>
+#include "util/clock.hpp"
+
+uint64_t get_wall_ns() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
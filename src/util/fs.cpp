@@ -0,0 +1,16 @@
+#include <algorithm>
+#include <filesystem>
+#include "util/fs.hpp"
+
+std::vector<std::string> collect_spirv_paths(const std::string& dir) {
+  namespace fs = std::filesystem;
+  std::vector<std::string> out;
+  for (const auto& entry : fs::recursive_directory_iterator(dir)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".spv") {
+      out.emplace_back(entry.path().generic_string());
+    }
+  }
+  // Directory iteration order is unspecified.
+  std::sort(out.begin(), out.end());
+  return out;
+}
@@ -0,0 +1,19 @@
+#include <cstdio>
+#include "util/json.hpp"
+
+std::string escape_json(const std::string& x) {
+  std::string out;
+  for (char c : x) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)(unsigned char)c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
@@ -0,0 +1,26 @@
+#include <cstdio>
+#include <mutex>
+#include "util/log-cb.hpp"
+
+using namespace liong;
+
+void log_cb(log::LogLevel lv, const std::string& msg) {
+  using log::LogLevel;
+  // Workers in batch mode log concurrently; don't let lines interleave.
+  static std::mutex sync;
+  std::lock_guard<std::mutex> guard(sync);
+  switch (lv) {
+  case LogLevel::L_LOG_LEVEL_DEBUG:
+    printf("[\x1b[90mDEBUG\x1B[0m] %s\n", msg.c_str());
+    break;
+  case LogLevel::L_LOG_LEVEL_INFO:
+    printf("[\x1B[32mINFO\x1B[0m] %s\n", msg.c_str());
+    break;
+  case LogLevel::L_LOG_LEVEL_WARNING:
+    printf("[\x1B[33mWARN\x1B[0m] %s\n", msg.c_str());
+    break;
+  case LogLevel::L_LOG_LEVEL_ERROR:
+    printf("[\x1B[31mERROR\x1B[0m] %s\n", msg.c_str());
+    break;
+  }
+}
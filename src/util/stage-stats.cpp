@@ -0,0 +1,198 @@
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include "util/stage-stats.hpp"
+#include "util/clock.hpp"
+#include "util/json.hpp"
+#include "node/arena.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+static std::atomic<bool> IS_ENABLED { false };
+
+struct StageStatsRegistry {
+  std::mutex sync;
+  std::vector<StageStats> stats;
+  std::map<std::string, size_t> name2istat;
+};
+static StageStatsRegistry STAGE_STATS_REG;
+
+static uint64_t get_thread_cpu_ns() {
+#ifdef _WIN32
+  FILETIME creation, exit, kernel, user;
+  if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+    return 0;
+  }
+  auto to_u64 = [](const FILETIME& t) {
+    return ((uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime;
+  };
+  // `FILETIME` counts 100ns intervals.
+  return (to_u64(kernel) + to_u64(user)) * 100;
+#else
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void get_arena_alloc(uint64_t& nnode, uint64_t& nbyte) {
+  const IrArena* arena = IrArena::current();
+  nnode = arena == nullptr ? 0 : arena->nnode;
+  nbyte = arena == nullptr ? 0 : arena->nbyte_node;
+}
+
+void enable_stage_stats(bool enable) {
+  IS_ENABLED = enable;
+}
+bool is_stage_stats_enabled() {
+  return IS_ENABLED;
+}
+
+StageTimer::StageTimer(const std::string& name, const char* category) :
+  enabled(IS_ENABLED),
+  is_stopped(false),
+  changed(false),
+  has_nnode(false),
+  nnode_before(0),
+  nnode_after(0),
+  beg_wall_ns(0),
+  beg_cpu_ns(0),
+  beg_nnode_alloc(0),
+  beg_nbyte_alloc(0),
+  wall_ns(0),
+  cpu_ns(0),
+  nnode_alloc(0),
+  nbyte_alloc(0)
+{
+  if (!enabled) { return; }
+  this->name = name;
+  this->category = category;
+  get_arena_alloc(beg_nnode_alloc, beg_nbyte_alloc);
+  beg_cpu_ns = get_thread_cpu_ns();
+  beg_wall_ns = get_wall_ns();
+}
+void StageTimer::stop() {
+  if (!enabled || is_stopped) { return; }
+  wall_ns = get_wall_ns() - beg_wall_ns;
+  cpu_ns = get_thread_cpu_ns() - beg_cpu_ns;
+  get_arena_alloc(nnode_alloc, nbyte_alloc);
+  // The arena might have been released by the stage.
+  nnode_alloc = nnode_alloc < beg_nnode_alloc ? 0 : nnode_alloc - beg_nnode_alloc;
+  nbyte_alloc = nbyte_alloc < beg_nbyte_alloc ? 0 : nbyte_alloc - beg_nbyte_alloc;
+  is_stopped = true;
+}
+StageTimer::~StageTimer() {
+  if (!enabled) { return; }
+  stop();
+
+  std::lock_guard<std::mutex> guard(STAGE_STATS_REG.sync);
+  auto it = STAGE_STATS_REG.name2istat.find(name);
+  if (it == STAGE_STATS_REG.name2istat.end()) {
+    StageStats stat {};
+    stat.name = name;
+    stat.category = category;
+    it = STAGE_STATS_REG.name2istat
+      .emplace(name, STAGE_STATS_REG.stats.size())
+      .first;
+    STAGE_STATS_REG.stats.emplace_back(std::move(stat));
+  }
+  StageStats& stat = STAGE_STATS_REG.stats[it->second];
+  stat.ninvoke += 1;
+  stat.nchanged += changed ? 1 : 0;
+  stat.wall_ms += wall_ns * 1e-6;
+  stat.cpu_ms += cpu_ns * 1e-6;
+  if (has_nnode) {
+    stat.has_nnode = true;
+    stat.nnode_before += nnode_before;
+    stat.nnode_after += nnode_after;
+  }
+  stat.nnode_alloc += nnode_alloc;
+  stat.nbyte_alloc += nbyte_alloc;
+}
+
+std::vector<StageStats> get_stage_stats() {
+  std::lock_guard<std::mutex> guard(STAGE_STATS_REG.sync);
+  return STAGE_STATS_REG.stats;
+}
+
+std::string format_stage_stats_table(const std::vector<StageStats>& stats) {
+  std::stringstream ss;
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "%-28s %8s %8s %12s %12s %12s %12s %12s %14s\n",
+    "stage", "calls", "changed", "wall (ms)", "cpu (ms)", "nodes in",
+    "nodes out", "alloc nodes", "alloc bytes");
+  ss << buf;
+
+  double total_wall_ms = 0.0;
+  double total_cpu_ms = 0.0;
+  for (const auto& stat : stats) {
+    std::string name = stat.category == "pass" ? "pass " + stat.name : stat.name;
+    std::string nnode_before = "-";
+    std::string nnode_after = "-";
+    if (stat.has_nnode) {
+      nnode_before = std::to_string(stat.nnode_before);
+      nnode_after = std::to_string(stat.nnode_after);
+    }
+    std::snprintf(buf, sizeof(buf),
+      "%-28s %8llu %8llu %12.3f %12.3f %12s %12s %12llu %14llu\n",
+      name.c_str(),
+      (unsigned long long)stat.ninvoke,
+      (unsigned long long)stat.nchanged,
+      stat.wall_ms,
+      stat.cpu_ms,
+      nnode_before.c_str(),
+      nnode_after.c_str(),
+      (unsigned long long)stat.nnode_alloc,
+      (unsigned long long)stat.nbyte_alloc);
+    ss << buf;
+    total_wall_ms += stat.wall_ms;
+    total_cpu_ms += stat.cpu_ms;
+  }
+
+  // Stages measured on different threads overlap in wall time, so the total is
+  // the sum of thread-time rather than the elapsed time.
+  std::snprintf(buf, sizeof(buf), "%-28s %8s %8s %12.3f %12.3f\n",
+    "total", "", "", total_wall_ms, total_cpu_ms);
+  ss << buf;
+  return ss.str();
+}
+
+std::string format_stage_stats_json(const std::vector<StageStats>& stats) {
+  std::stringstream ss;
+  ss << "{\n  \"stages\": [";
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const StageStats& stat = stats[i];
+    char buf[64];
+    ss << (i == 0 ? "\n" : ",\n");
+    ss << "    {";
+    ss << "\"name\": \"" << escape_json(stat.name) << "\", ";
+    ss << "\"category\": \"" << escape_json(stat.category) << "\", ";
+    ss << "\"invocations\": " << stat.ninvoke << ", ";
+    ss << "\"changed\": " << stat.nchanged << ", ";
+    std::snprintf(buf, sizeof(buf), "%.6f", stat.wall_ms);
+    ss << "\"wall_ms\": " << buf << ", ";
+    std::snprintf(buf, sizeof(buf), "%.6f", stat.cpu_ms);
+    ss << "\"cpu_ms\": " << buf << ", ";
+    if (stat.has_nnode) {
+      ss << "\"nodes_before\": " << stat.nnode_before << ", ";
+      ss << "\"nodes_after\": " << stat.nnode_after << ", ";
+    } else {
+      ss << "\"nodes_before\": null, ";
+      ss << "\"nodes_after\": null, ";
+    }
+    ss << "\"alloc_nodes\": " << stat.nnode_alloc << ", ";
+    ss << "\"alloc_bytes\": " << stat.nbyte_alloc;
+    ss << "}";
+  }
+  ss << "\n  ]\n}\n";
+  return ss.str();
+}
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "util/task-pool.hpp"
+
+uint32_t get_default_nworker() {
+  uint32_t n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+void parallel_for(
+  size_t n,
+  uint32_t nworker,
+  const std::function<void(size_t)>& f
+) {
+  if (nworker <= 1 || n <= 1) {
+    for (size_t i = 0; i < n; ++i) { f(i); }
+    return;
+  }
+
+  std::atomic<size_t> next_task { 0 };
+  std::mutex err_mutex;
+  std::exception_ptr err = nullptr;
+
+  auto work = [&]() {
+    for (;;) {
+      size_t i = next_task.fetch_add(1);
+      if (i >= n) { break; }
+      try {
+        f(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> guard(err_mutex);
+        if (err == nullptr) { err = std::current_exception(); }
+        // Stop handing out new tasks.
+        next_task = n;
+      }
+    }
+  };
+
+  size_t nthread = std::min<size_t>(nworker, n);
+  std::vector<std::thread> threads;
+  threads.reserve(nthread - 1);
+  for (size_t i = 1; i < nthread; ++i) {
+    threads.emplace_back(work);
+  }
+  // The calling thread is also a worker.
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  if (err != nullptr) {
+    std::rethrow_exception(err);
+  }
+}
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "gft/log.hpp"
+#include "gft/util.hpp"
+#include "util/trace.hpp"
+#include "util/clock.hpp"
+#include "util/json.hpp"
+
+using namespace liong;
+
+std::atomic<bool> IS_TRACING { false };
+
+struct TraceEvent {
+  const char* name;
+  uint64_t beg_ns;
+  uint64_t dur_ns;
+};
+// Spans of a single thread. Only the owning thread appends to it, so
+// recording a span takes no lock.
+struct TraceBuffer {
+  uint32_t tid;
+  std::vector<TraceEvent> events;
+};
+// Buffers are kept after their threads exit so that spans of short-lived
+// workers are still saved.
+struct TraceRegistry {
+  std::mutex sync;
+  // `get_wall_ns` when the trace started.
+  uint64_t epoch_ns;
+  std::vector<std::unique_ptr<TraceBuffer>> bufs;
+};
+static TraceRegistry TRACE_REG;
+static thread_local TraceBuffer* CUR_TRACE_BUF = nullptr;
+
+static TraceBuffer& get_trace_buf() {
+  if (CUR_TRACE_BUF == nullptr) {
+    std::lock_guard<std::mutex> guard(TRACE_REG.sync);
+    auto buf = std::make_unique<TraceBuffer>();
+    buf->tid = (uint32_t)TRACE_REG.bufs.size() + 1;
+    CUR_TRACE_BUF = buf.get();
+    TRACE_REG.bufs.emplace_back(std::move(buf));
+  }
+  return *CUR_TRACE_BUF;
+}
+
+void start_trace() {
+  {
+    std::lock_guard<std::mutex> guard(TRACE_REG.sync);
+    TRACE_REG.epoch_ns = get_wall_ns();
+  }
+  IS_TRACING = true;
+}
+uint64_t get_trace_time_ns() {
+  return get_wall_ns() - TRACE_REG.epoch_ns;
+}
+void record_trace_span(const char* name, uint64_t beg_ns) {
+  uint64_t end_ns = get_trace_time_ns();
+  TraceBuffer& buf = get_trace_buf();
+  buf.events.emplace_back(TraceEvent { name, beg_ns, end_ns - beg_ns });
+}
+
+void save_trace(const std::string& path) {
+  std::stringstream ss;
+  ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto sep = [&]() {
+    ss << (first ? "\n" : ",\n");
+    first = false;
+  };
+
+  std::lock_guard<std::mutex> guard(TRACE_REG.sync);
+  size_t nevent = 0;
+  for (const auto& buf : TRACE_REG.bufs) {
+    sep();
+    ss << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" <<
+      buf->tid << ",\"args\":{\"name\":\"thread " << buf->tid << "\"}}";
+    for (const auto& event : buf->events) {
+      // Timestamps are in microseconds.
+      char ts[64];
+      std::snprintf(ts, sizeof(ts), "\"ts\":%.3f,\"dur\":%.3f",
+        event.beg_ns * 1e-3, event.dur_ns * 1e-3);
+      sep();
+      ss << "{\"name\":";
+      ss << '"' << escape_json(event.name) << '"';
+      ss << ",\"cat\":\"cspv\",\"ph\":\"X\"," << ts << ",\"pid\":1,\"tid\":" <<
+        buf->tid << "}";
+    }
+    nevent += buf->events.size();
+  }
+  ss << "\n]}\n";
+
+  util::save_text(path.c_str(), ss.str());
+  log::info("saved ", nevent, " trace spans to '", path, "'");
+}
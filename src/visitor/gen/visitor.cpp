@@ -4,313 +4,859 @@
 #pragma once
 #include "visitor/gen/visitor.hpp"
 
-void Visitor::visit_mem_(MemoryPatternCaptureRef x) {
-  visit_mem(x->captured);
-}
-void Visitor::visit_mem_(MemoryFunctionVariableRef x) {
-}
-void Visitor::visit_mem_(MemoryIterationVariableRef x) {
-}
-void Visitor::visit_mem_(MemoryUniformBufferRef x) {
-}
-void Visitor::visit_mem_(MemoryStorageBufferRef x) {
-}
-void Visitor::visit_mem_(MemorySampledImageRef x) {
-}
-void Visitor::visit_mem_(MemoryStorageImageRef x) {
+void Visitor::drive_(const NodeRef& root) {
+  std::vector<Task>* prev_pending = pending_;
+  std::vector<Task> pending;
+  std::vector<Task> stack;
+  pending_ = &pending;
+  stack.push_back(Task { L_TASK_KIND_VISIT, root, nullptr });
+  while (!stack.empty()) {
+    Task task = std::move(stack.back());
+    stack.pop_back();
+    switch (task.kind) {
+    case L_TASK_KIND_VISIT: dispatch_(task.node); break;
+    case L_TASK_KIND_POST_VISIT: post_visit_(task.node); break;
+    case L_TASK_KIND_CALLBACK: task.f(); break;
+    default: liong::unreachable();
+    }
+    // Scheduled tasks run in program order.
+    for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+      stack.emplace_back(std::move(*it));
+    }
+    pending.clear();
+  }
+  pending_ = prev_pending;
+}
+void Visitor::dispatch_(const NodeRef& node) {
+  switch (node->nova) {
+  case L_NODE_VARIANT_MEMORY: dispatch_mem_(node.borrow_as<Memory>()); break;
+  case L_NODE_VARIANT_TYPE: dispatch_ty_(node.borrow_as<Type>()); break;
+  case L_NODE_VARIANT_EXPR: dispatch_expr_(node.borrow_as<Expr>()); break;
+  case L_NODE_VARIANT_STMT: dispatch_stmt_(node.borrow_as<Stmt>()); break;
+  default: liong::unimplemented();
+  }
+}
+void Visitor::schedule_visit_node_(const NodeRef& node) {
+  if (pending_ == nullptr) {
+    drive_(node);
+  } else {
+    pending_->emplace_back(Task { L_TASK_KIND_VISIT, node, nullptr });
+  }
+}
+void Visitor::schedule_post_visit_node_(const NodeRef& node) {
+  if (pending_ == nullptr) {
+    post_visit_(node);
+  } else {
+    pending_->emplace_back(Task { L_TASK_KIND_POST_VISIT, node, nullptr });
+  }
+}
+void Visitor::schedule_(std::function<void()>&& f) {
+  if (pending_ == nullptr) {
+    f();
+  } else {
+    pending_->emplace_back(Task { L_TASK_KIND_CALLBACK, nullptr, std::move(f) });
+  }
 }
 
-void Visitor::visit_ty_(TypePatternCaptureRef x) {
-  visit_ty(x->captured);
+void Visitor::visit_mem_(const MemoryPatternCaptureRef& x) {
+  schedule_visit_(x->captured);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_ty_(TypeVoidRef x) {
+void Visitor::visit_mem_(const MemoryFunctionVariableRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_ty_(TypeBoolRef x) {
+void Visitor::visit_mem_(const MemoryIterationVariableRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_ty_(TypeIntRef x) {
+void Visitor::visit_mem_(const MemoryUniformBufferRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_ty_(TypeFloatRef x) {
+void Visitor::visit_mem_(const MemoryStorageBufferRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_ty_(TypeStructRef x) {
-  for (const auto& x : x->members) { visit_ty(x); }
+void Visitor::visit_mem_(const MemorySampledImageRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_ty_(TypePointerRef x) {
-  visit_ty(x->inner);
+void Visitor::visit_mem_(const MemoryStorageImageRef& x) {
+  schedule_post_visit_(x);
 }
 
-void Visitor::visit_expr_(ExprPatternCaptureRef x) {
-  visit_expr(x->captured);
-}
-void Visitor::visit_expr_(ExprPatternBinaryOpRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
-}
-void Visitor::visit_expr_(ExprBoolImmRef x) {
-}
-void Visitor::visit_expr_(ExprIntImmRef x) {
+void Visitor::visit_ty_(const TypePatternCaptureRef& x) {
+  schedule_visit_(x->captured);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprFloatImmRef x) {
+void Visitor::visit_ty_(const TypeVoidRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprLoadRef x) {
+void Visitor::visit_ty_(const TypeBoolRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprAddRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
+void Visitor::visit_ty_(const TypeIntRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprSubRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
+void Visitor::visit_ty_(const TypeFloatRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprMulRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
+void Visitor::visit_ty_(const TypeStructRef& x) {
+  for (const auto& x : x->members) { schedule_visit_(x); }
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprDivRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
+void Visitor::visit_ty_(const TypePointerRef& x) {
+  schedule_visit_(x->inner);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprModRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
-}
-void Visitor::visit_expr_(ExprLtRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
-}
-void Visitor::visit_expr_(ExprEqRef x) {
-  visit_expr(x->a);
-  visit_expr(x->b);
+
+void Visitor::visit_expr_(const ExprPatternCaptureRef& x) {
+  schedule_visit_(x->captured);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprPatternBinaryOpRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprBoolImmRef& x) {
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprIntImmRef& x) {
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprFloatImmRef& x) {
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprLoadRef& x) {
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprAddRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprSubRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprMulRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprDivRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprModRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprLtRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprEqRef& x) {
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprNotRef& x) {
+  schedule_visit_(x->a);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprTypeCastRef& x) {
+  schedule_visit_(x->src);
+  schedule_post_visit_(x);
+}
+void Visitor::visit_expr_(const ExprSelectRef& x) {
+  schedule_visit_(x->cond);
+  schedule_visit_(x->a);
+  schedule_visit_(x->b);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprNotRef x) {
-  visit_expr(x->a);
+
+void Visitor::visit_stmt_(const StmtPatternCaptureRef& x) {
+  schedule_visit_(x->captured);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprTypeCastRef x) {
-  visit_expr(x->src);
+void Visitor::visit_stmt_(const StmtPatternHeadRef& x) {
+  schedule_visit_(x->inner);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_expr_(ExprSelectRef x) {
-  visit_expr(x->cond);
-  visit_expr(x->a);
-  visit_expr(x->b);
+void Visitor::visit_stmt_(const StmtPatternTailRef& x) {
+  schedule_visit_(x->inner);
+  schedule_post_visit_(x);
 }
-
-void Visitor::visit_stmt_(StmtPatternCaptureRef x) {
-  visit_stmt(x->captured);
+void Visitor::visit_stmt_(const StmtNopRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtPatternHeadRef x) {
-  visit_stmt(x->inner);
+void Visitor::visit_stmt_(const StmtBlockRef& x) {
+  for (const auto& x : x->stmts) { schedule_visit_(x); }
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtPatternTailRef x) {
-  visit_stmt(x->inner);
+void Visitor::visit_stmt_(const StmtConditionalBranchRef& x) {
+  schedule_visit_(x->then_block);
+  schedule_visit_(x->else_block);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtNopRef x) {
+void Visitor::visit_stmt_(const StmtLoopRef& x) {
+  schedule_visit_(x->body_block);
+  schedule_visit_(x->continue_block);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtBlockRef x) {
-  for (const auto& x : x->stmts) { visit_stmt(x); }
+void Visitor::visit_stmt_(const StmtConditionalLoopRef& x) {
+  schedule_visit_(x->body_block);
+  schedule_visit_(x->continue_block);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtConditionalBranchRef x) {
-  visit_stmt(x->then_block);
-  visit_stmt(x->else_block);
+void Visitor::visit_stmt_(const StmtReturnRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtLoopRef x) {
-  visit_stmt(x->body_block);
-  visit_stmt(x->continue_block);
+void Visitor::visit_stmt_(const StmtLoopMergeRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtConditionalLoopRef x) {
-  visit_stmt(x->body_block);
-  visit_stmt(x->continue_block);
+void Visitor::visit_stmt_(const StmtLoopContinueRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtReturnRef x) {
+void Visitor::visit_stmt_(const StmtLoopBackEdgeRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtLoopMergeRef x) {
+void Visitor::visit_stmt_(const StmtRangedLoopRef& x) {
+  schedule_visit_(x->body_block);
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtLoopContinueRef x) {
+void Visitor::visit_stmt_(const StmtStoreRef& x) {
+  schedule_post_visit_(x);
 }
-void Visitor::visit_stmt_(StmtLoopBackEdgeRef x) {
-}
-void Visitor::visit_stmt_(StmtRangedLoopRef x) {
-  visit_stmt(x->body_block);
+
+void collect_child_slots(const NodeRef& node, std::vector<NodeRef*>& slots) {
+  switch (node->nova) {
+  case L_NODE_VARIANT_MEMORY:
+    switch (((const Memory*)node.get())->cls) {
+    case L_MEMORY_CLASS_PATTERN_CAPTURE:
+    {
+      const auto* x = (const MemoryPatternCapture*)node.get();
+      slots.emplace_back((NodeRef*)&x->captured);
+      break;
+    }
+    case L_MEMORY_CLASS_ITERATION_VARIABLE:
+    {
+      const auto* x = (const MemoryIterationVariable*)node.get();
+      slots.emplace_back((NodeRef*)&x->begin);
+      slots.emplace_back((NodeRef*)&x->end);
+      slots.emplace_back((NodeRef*)&x->stride);
+      break;
+    }
+    default: break;
+    }
+    break;
+  case L_NODE_VARIANT_TYPE:
+    switch (((const Type*)node.get())->cls) {
+    case L_TYPE_CLASS_PATTERN_CAPTURE:
+    {
+      const auto* x = (const TypePatternCapture*)node.get();
+      slots.emplace_back((NodeRef*)&x->captured);
+      break;
+    }
+    case L_TYPE_CLASS_STRUCT:
+    {
+      const auto* x = (const TypeStruct*)node.get();
+      for (auto& x2 : x->members) { slots.emplace_back((NodeRef*)&x2); }
+      break;
+    }
+    case L_TYPE_CLASS_POINTER:
+    {
+      const auto* x = (const TypePointer*)node.get();
+      slots.emplace_back((NodeRef*)&x->inner);
+      break;
+    }
+    default: break;
+    }
+    break;
+  case L_NODE_VARIANT_EXPR:
+    switch (((const Expr*)node.get())->op) {
+    case L_EXPR_OP_PATTERN_CAPTURE:
+    {
+      const auto* x = (const ExprPatternCapture*)node.get();
+      slots.emplace_back((NodeRef*)&x->captured);
+      break;
+    }
+    case L_EXPR_OP_PATTERN_BINARY_OP:
+    {
+      const auto* x = (const ExprPatternBinaryOp*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_LOAD:
+    {
+      const auto* x = (const ExprLoad*)node.get();
+      slots.emplace_back((NodeRef*)&x->src_ptr);
+      break;
+    }
+    case L_EXPR_OP_ADD:
+    {
+      const auto* x = (const ExprAdd*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_SUB:
+    {
+      const auto* x = (const ExprSub*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_MUL:
+    {
+      const auto* x = (const ExprMul*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_DIV:
+    {
+      const auto* x = (const ExprDiv*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_MOD:
+    {
+      const auto* x = (const ExprMod*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_LT:
+    {
+      const auto* x = (const ExprLt*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_EQ:
+    {
+      const auto* x = (const ExprEq*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    case L_EXPR_OP_NOT:
+    {
+      const auto* x = (const ExprNot*)node.get();
+      slots.emplace_back((NodeRef*)&x->a);
+      break;
+    }
+    case L_EXPR_OP_TYPE_CAST:
+    {
+      const auto* x = (const ExprTypeCast*)node.get();
+      slots.emplace_back((NodeRef*)&x->src);
+      break;
+    }
+    case L_EXPR_OP_SELECT:
+    {
+      const auto* x = (const ExprSelect*)node.get();
+      slots.emplace_back((NodeRef*)&x->cond);
+      slots.emplace_back((NodeRef*)&x->a);
+      slots.emplace_back((NodeRef*)&x->b);
+      break;
+    }
+    default: break;
+    }
+    break;
+  case L_NODE_VARIANT_STMT:
+    switch (((const Stmt*)node.get())->op) {
+    case L_STMT_OP_PATTERN_CAPTURE:
+    {
+      const auto* x = (const StmtPatternCapture*)node.get();
+      slots.emplace_back((NodeRef*)&x->captured);
+      break;
+    }
+    case L_STMT_OP_PATTERN_HEAD:
+    {
+      const auto* x = (const StmtPatternHead*)node.get();
+      slots.emplace_back((NodeRef*)&x->inner);
+      break;
+    }
+    case L_STMT_OP_PATTERN_TAIL:
+    {
+      const auto* x = (const StmtPatternTail*)node.get();
+      slots.emplace_back((NodeRef*)&x->inner);
+      break;
+    }
+    case L_STMT_OP_BLOCK:
+    {
+      const auto* x = (const StmtBlock*)node.get();
+      for (auto& x2 : x->stmts) { slots.emplace_back((NodeRef*)&x2); }
+      break;
+    }
+    case L_STMT_OP_CONDITIONAL_BRANCH:
+    {
+      const auto* x = (const StmtConditionalBranch*)node.get();
+      slots.emplace_back((NodeRef*)&x->cond);
+      slots.emplace_back((NodeRef*)&x->then_block);
+      slots.emplace_back((NodeRef*)&x->else_block);
+      break;
+    }
+    case L_STMT_OP_LOOP:
+    {
+      const auto* x = (const StmtLoop*)node.get();
+      slots.emplace_back((NodeRef*)&x->body_block);
+      slots.emplace_back((NodeRef*)&x->continue_block);
+      break;
+    }
+    case L_STMT_OP_CONDITIONAL_LOOP:
+    {
+      const auto* x = (const StmtConditionalLoop*)node.get();
+      slots.emplace_back((NodeRef*)&x->cond);
+      slots.emplace_back((NodeRef*)&x->body_block);
+      slots.emplace_back((NodeRef*)&x->continue_block);
+      break;
+    }
+    case L_STMT_OP_RANGED_LOOP:
+    {
+      const auto* x = (const StmtRangedLoop*)node.get();
+      slots.emplace_back((NodeRef*)&x->body_block);
+      slots.emplace_back((NodeRef*)&x->itervar);
+      break;
+    }
+    case L_STMT_OP_STORE:
+    {
+      const auto* x = (const StmtStore*)node.get();
+      slots.emplace_back((NodeRef*)&x->dst_ptr);
+      slots.emplace_back((NodeRef*)&x->value);
+      break;
+    }
+    default: break;
+    }
+    break;
+  default: liong::unimplemented();
+  }
 }
-void Visitor::visit_stmt_(StmtStoreRef x) {
+
+NodeRef Mutator::drive_(const NodeRef& root) {
+  bool expand = false;
+  NodeRef out = dispatch_(root, expand);
+  if (out != root) { is_changed_ = true; }
+  if (expand) {
+    mutate_children_node_(out);
+  }
+  // Fields might have been written in place.
+  root->invalidate_structured_hash();
+  if (out != nullptr) { out->invalidate_structured_hash(); }
+  return out;
+}
+NodeRef Mutator::dispatch_(const NodeRef& node, bool& expand) {
+  expanding_ = node.get();
+  is_expanded_ = false;
+  NodeRef out;
+  switch (node->nova) {
+  case L_NODE_VARIANT_MEMORY: out = dispatch_mem_(node.borrow_as<Memory>()); break;
+  case L_NODE_VARIANT_TYPE: out = dispatch_ty_(node.borrow_as<Type>()); break;
+  case L_NODE_VARIANT_EXPR: out = dispatch_expr_(node.borrow_as<Expr>()); break;
+  case L_NODE_VARIANT_STMT: out = dispatch_stmt_(node.borrow_as<Stmt>()); break;
+  default: liong::unimplemented();
+  }
+  expand = is_expanded_;
+  expanding_ = nullptr;
+  is_expanded_ = false;
+  liong::assert(!expand || out == node,
+    "default mutator implementation must be called as a tail call");
+  return out;
+}
+void Mutator::mutate_children_node_(const NodeRef& node) {
+  liong::assert(!node->is_frozen(), "frozen nodes cannot be mutated");
+  // Each frame owns the slots from `islot_beg` to the beginning of the next
+  // frame's slots.
+  struct Frame {
+    NodeRef node;
+    size_t islot_beg;
+    size_t islot;
+  };
+  std::vector<Frame> frames;
+  std::vector<NodeRef*> slots;
+
+  collect_child_slots(node, slots);
+  frames.emplace_back(Frame { node, 0, 0 });
+  while (!frames.empty()) {
+    Frame& frame = frames.back();
+    if (frame.islot < slots.size()) {
+      NodeRef* slot = slots[frame.islot++];
+      NodeRef child = *slot;
+      bool expand = false;
+      NodeRef out = dispatch_(child, expand);
+      if (out != child) { is_changed_ = true; }
+      *slot = out;
+      if (expand) {
+        size_t islot_beg = slots.size();
+        collect_child_slots(out, slots);
+        frames.emplace_back(Frame { out, islot_beg, islot_beg });
+      } else {
+        child->invalidate_structured_hash();
+        if (out != nullptr) { out->invalidate_structured_hash(); }
+      }
+    } else {
+      NodeRef x = std::move(frame.node);
+      slots.resize(frame.islot_beg);
+      frames.pop_back();
+      x->invalidate_structured_hash();
+      post_mutate_(x);
+    }
+  }
 }
 
-MemoryRef Mutator::mutate_mem_(MemoryPatternCaptureRef x) {
-  x->captured = mutate_mem(x->captured);
+MemoryRef Mutator::mutate_mem_(const MemoryPatternCaptureRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Memory>();
 }
-MemoryRef Mutator::mutate_mem_(MemoryFunctionVariableRef x) {
+MemoryRef Mutator::mutate_mem_(const MemoryFunctionVariableRef& x) {
   return x.as<Memory>();
 }
-MemoryRef Mutator::mutate_mem_(MemoryIterationVariableRef x) {
-  x->begin = mutate_expr(x->begin);
-  x->end = mutate_expr(x->end);
-  x->stride = mutate_expr(x->stride);
+MemoryRef Mutator::mutate_mem_(const MemoryIterationVariableRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Memory>();
 }
-MemoryRef Mutator::mutate_mem_(MemoryUniformBufferRef x) {
+MemoryRef Mutator::mutate_mem_(const MemoryUniformBufferRef& x) {
   return x.as<Memory>();
 }
-MemoryRef Mutator::mutate_mem_(MemoryStorageBufferRef x) {
+MemoryRef Mutator::mutate_mem_(const MemoryStorageBufferRef& x) {
   return x.as<Memory>();
 }
-MemoryRef Mutator::mutate_mem_(MemorySampledImageRef x) {
+MemoryRef Mutator::mutate_mem_(const MemorySampledImageRef& x) {
   return x.as<Memory>();
 }
-MemoryRef Mutator::mutate_mem_(MemoryStorageImageRef x) {
+MemoryRef Mutator::mutate_mem_(const MemoryStorageImageRef& x) {
   return x.as<Memory>();
 }
 
-TypeRef Mutator::mutate_ty_(TypePatternCaptureRef x) {
-  x->captured = mutate_ty(x->captured);
+TypeRef Mutator::mutate_ty_(const TypePatternCaptureRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Type>();
 }
-TypeRef Mutator::mutate_ty_(TypeVoidRef x) {
+TypeRef Mutator::mutate_ty_(const TypeVoidRef& x) {
   return x.as<Type>();
 }
-TypeRef Mutator::mutate_ty_(TypeBoolRef x) {
+TypeRef Mutator::mutate_ty_(const TypeBoolRef& x) {
   return x.as<Type>();
 }
-TypeRef Mutator::mutate_ty_(TypeIntRef x) {
+TypeRef Mutator::mutate_ty_(const TypeIntRef& x) {
   return x.as<Type>();
 }
-TypeRef Mutator::mutate_ty_(TypeFloatRef x) {
+TypeRef Mutator::mutate_ty_(const TypeFloatRef& x) {
   return x.as<Type>();
 }
-TypeRef Mutator::mutate_ty_(TypeStructRef x) {
-  for (auto& x : x->members) { x = mutate_ty(x); }
+TypeRef Mutator::mutate_ty_(const TypeStructRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Type>();
 }
-TypeRef Mutator::mutate_ty_(TypePointerRef x) {
-  x->inner = mutate_ty(x->inner);
+TypeRef Mutator::mutate_ty_(const TypePointerRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Type>();
 }
 
-ExprRef Mutator::mutate_expr_(ExprPatternCaptureRef x) {
-  x->captured = mutate_expr(x->captured);
+ExprRef Mutator::mutate_expr_(const ExprPatternCaptureRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprPatternBinaryOpRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprPatternBinaryOpRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprBoolImmRef x) {
+ExprRef Mutator::mutate_expr_(const ExprBoolImmRef& x) {
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprIntImmRef x) {
+ExprRef Mutator::mutate_expr_(const ExprIntImmRef& x) {
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprFloatImmRef x) {
+ExprRef Mutator::mutate_expr_(const ExprFloatImmRef& x) {
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprLoadRef x) {
-  x->src_ptr = mutate_mem(x->src_ptr);
+ExprRef Mutator::mutate_expr_(const ExprLoadRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprAddRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprAddRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprSubRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprSubRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprMulRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprMulRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprDivRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprDivRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprModRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprModRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprLtRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprLtRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprEqRef x) {
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprEqRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprNotRef x) {
-  x->a = mutate_expr(x->a);
+ExprRef Mutator::mutate_expr_(const ExprNotRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprTypeCastRef x) {
-  x->src = mutate_expr(x->src);
+ExprRef Mutator::mutate_expr_(const ExprTypeCastRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
-ExprRef Mutator::mutate_expr_(ExprSelectRef x) {
-  x->cond = mutate_expr(x->cond);
-  x->a = mutate_expr(x->a);
-  x->b = mutate_expr(x->b);
+ExprRef Mutator::mutate_expr_(const ExprSelectRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Expr>();
 }
 
-StmtRef Mutator::mutate_stmt_(StmtPatternCaptureRef x) {
-  x->captured = mutate_stmt(x->captured);
+StmtRef Mutator::mutate_stmt_(const StmtPatternCaptureRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtPatternHeadRef x) {
-  x->inner = mutate_stmt(x->inner);
+StmtRef Mutator::mutate_stmt_(const StmtPatternHeadRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtPatternTailRef x) {
-  x->inner = mutate_stmt(x->inner);
+StmtRef Mutator::mutate_stmt_(const StmtPatternTailRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtNopRef x) {
+StmtRef Mutator::mutate_stmt_(const StmtNopRef& x) {
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtBlockRef x) {
-  for (auto& x : x->stmts) { x = mutate_stmt(x); }
+StmtRef Mutator::mutate_stmt_(const StmtBlockRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtConditionalBranchRef x) {
-  x->cond = mutate_expr(x->cond);
-  x->then_block = mutate_stmt(x->then_block);
-  x->else_block = mutate_stmt(x->else_block);
+StmtRef Mutator::mutate_stmt_(const StmtConditionalBranchRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtLoopRef x) {
-  x->body_block = mutate_stmt(x->body_block);
-  x->continue_block = mutate_stmt(x->continue_block);
+StmtRef Mutator::mutate_stmt_(const StmtLoopRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtConditionalLoopRef x) {
-  x->cond = mutate_expr(x->cond);
-  x->body_block = mutate_stmt(x->body_block);
-  x->continue_block = mutate_stmt(x->continue_block);
+StmtRef Mutator::mutate_stmt_(const StmtConditionalLoopRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtReturnRef x) {
+StmtRef Mutator::mutate_stmt_(const StmtReturnRef& x) {
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtLoopMergeRef x) {
+StmtRef Mutator::mutate_stmt_(const StmtLoopMergeRef& x) {
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtLoopContinueRef x) {
+StmtRef Mutator::mutate_stmt_(const StmtLoopContinueRef& x) {
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtLoopBackEdgeRef x) {
+StmtRef Mutator::mutate_stmt_(const StmtLoopBackEdgeRef& x) {
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtRangedLoopRef x) {
-  x->body_block = mutate_stmt(x->body_block);
-  x->itervar = mutate_mem(x->itervar);
+StmtRef Mutator::mutate_stmt_(const StmtRangedLoopRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
-StmtRef Mutator::mutate_stmt_(StmtStoreRef x) {
-  x->dst_ptr = mutate_mem(x->dst_ptr);
-  x->value = mutate_expr(x->value);
+StmtRef Mutator::mutate_stmt_(const StmtStoreRef& x) {
+  if (x->is_frozen()) {
+    // Frozen nodes are shared read-only; keep them as they are.
+  } else if (expanding_ == x.get()) {
+    // Reached from the driver; leave the children to the work stack.
+    is_expanded_ = true;
+  } else {
+    mutate_children_(x);
+  }
   return x.as<Stmt>();
 }
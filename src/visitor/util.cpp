@@ -1,6 +1,8 @@
+#include <set>
 #include <sstream>
 #include "visitor/visitor.hpp"
 #include "visitor/util.hpp"
+#include "util/trace.hpp"
 
 using namespace liong;
 
@@ -9,16 +11,20 @@ struct Debug {
   std::stringstream s;
   std::string indent;
 
-  std::map<const void*, std::string> var_handle2name_map;
+  // Names are numbered in order of appearance; empty if not named yet.
+  std::vector<std::string> var_handle2name_map;
+  uint32_t nvar_name = 0;
 
-  inline const std::string& get_var_name_by_handle(const std::shared_ptr<uint8_t>& handle) {
-    auto it = var_handle2name_map.find(handle.get());
-    if (it == var_handle2name_map.end()) {
-      std::string name = "_";
-      name += std::to_string(var_handle2name_map.size());
-      var_handle2name_map.emplace(handle.get(), std::move(name));
+  inline const std::string& get_var_name_by_handle(NodeHandle handle) {
+    if (handle >= var_handle2name_map.size()) {
+      var_handle2name_map.resize(handle + 1);
     }
-    return var_handle2name_map.at(handle.get());
+    std::string& name = var_handle2name_map[handle];
+    if (name.empty()) {
+      name = "_";
+      name += std::to_string(nvar_name++);
+    }
+    return name;
   }
 
   inline void push_indent() { indent += "  "; }
@@ -46,250 +52,242 @@ struct Debug {
   inline std::string str() const { return s.str(); }
 };
 
-struct DebugPrintVisitor : public Visitor {
+// Children are scheduled on the visitor's work stack rather than visited
+// recursively, so that arbitrarily deep trees can be printed. Text following a
+// child is scheduled with `later` to be printed after the child.
+struct DebugPrintVisitor : public StaticVisitor<DebugPrintVisitor> {
+  using StaticVisitor::visit_mem_;
+  using StaticVisitor::visit_ty_;
+  using StaticVisitor::visit_expr_;
+  using StaticVisitor::visit_stmt_;
+
   Debug& s;
   inline DebugPrintVisitor(Debug& s) : s(s) {}
 
-  void visit_access_chain(const std::vector<ExprRef>& ac) {
+  template<typename TFunc>
+  inline void later(TFunc&& f) {
+    schedule_(std::function<void()>(std::forward<TFunc>(f)));
+  }
+  inline void later(const char* lit) {
+    later([this, lit]() { s << lit; });
+  }
+
+  void visit_access_chain(const AccessChain& ac) {
     bool first = true;
-    for (const auto& idx : ac) {
+    for (const auto& idx : ac.to_list()) {
       if (first) {
         first = false;
       } else {
-        s << ",";
+        later(",");
       }
-      visit(idx);
+      schedule_visit_(idx);
     }
   }
-  virtual void visit_mem_(MemoryFunctionVariableRef x) override final {
+  void visit_binary_op(const ExprRef& a, const char* op, const ExprRef& b) {
+    s << "(";
+    schedule_visit_(a);
+    later(op);
+    schedule_visit_(b);
+    later(")");
+  }
+  void visit_indented_block(const StmtRef& x) {
+    later([this]() { s.push_indent(); });
+    schedule_visit_(x);
+    later([this]() { s.pop_indent(); });
+  }
+
+  void visit_mem_(const MemoryFunctionVariableRef& x) {
     s << "$" << s.get_var_name_by_handle(x->handle) << ":";
-    visit(x->ty);
+    schedule_visit_(x->ty);
   }
-  virtual void visit_mem_(MemoryIterationVariableRef x) override final {
+  void visit_mem_(const MemoryIterationVariableRef& x) {
     s << "IterVar(";
-    visit(x->begin);
-    s << ",";
-    visit(x->end);
-    s << ",";
-    visit(x->stride);
-    s << "):";
-    visit(x->ty);
-  }
-  virtual void visit_mem_(MemoryUniformBufferRef x) override final {
+    schedule_visit_(x->begin);
+    later(",");
+    schedule_visit_(x->end);
+    later(",");
+    schedule_visit_(x->stride);
+    later("):");
+    schedule_visit_(x->ty);
+  }
+  void visit_mem_(const MemoryUniformBufferRef& x) {
     s << "UniformBuffer@" << x->binding << "," << x->set << "[";
     visit_access_chain(x->ac);
-    s << "]:";
-    visit(x->ty);
+    later("]:");
+    schedule_visit_(x->ty);
   }
-  virtual void visit_mem_(MemoryStorageBufferRef x) override final {
+  void visit_mem_(const MemoryStorageBufferRef& x) {
     s << "StorageBuffer@" << x->binding << "," << x->set << "[";
     visit_access_chain(x->ac);
-    s << "]:";
-    visit(x->ty);
+    later("]:");
+    schedule_visit_(x->ty);
   }
 
 
 
-  virtual void visit_ty_(TypeVoidRef x) override final {
+  void visit_ty_(const TypeVoidRef& x) {
     s << "void";
   }
-  virtual void visit_ty_(TypeBoolRef x) override final {
+  void visit_ty_(const TypeBoolRef& x) {
     s << "bool";
   }
-  virtual void visit_ty_(TypeIntRef x) override final {
+  void visit_ty_(const TypeIntRef& x) {
     s << (x->is_signed ? "i" : "u") << x->nbit;
   }
-  virtual void visit_ty_(TypeFloatRef x) override final {
+  void visit_ty_(const TypeFloatRef& x) {
     s << "f" << x->nbit;
   }
-  virtual void visit_ty_(TypeStructRef x) override final {
+  void visit_ty_(const TypeStructRef& x) {
     s << "Struct<";
     bool first = true;
     for (const auto& member : x->members) {
       if (first) {
         first = false;
       } else {
-        s << ",";
+        later(",");
       }
-      visit(member);
+      schedule_visit_(member);
     }
-    s << ">";
+    later(">");
   }
-  virtual void visit_ty_(TypePointerRef x) override final {
+  void visit_ty_(const TypePointerRef& x) {
     s << "Pointer<";
-    visit(x->inner);
-    s << ">";
+    schedule_visit_(x->inner);
+    later(">");
   }
 
 
 
-  virtual void visit_expr_(ExprBoolImmRef x) override final {
+  void visit_expr_(const ExprBoolImmRef& x) {
     s << (x->lit ? "true" : "false");
   }
-  virtual void visit_expr_(ExprIntImmRef x) override final {
+  void visit_expr_(const ExprIntImmRef& x) {
     s << x->lit;
   }
-  virtual void visit_expr_(ExprFloatImmRef x) override final {
+  void visit_expr_(const ExprFloatImmRef& x) {
     s << x->lit;
   }
-  virtual void visit_expr_(ExprLoadRef x) override final {
+  void visit_expr_(const ExprLoadRef& x) {
     s << "Load(";
-    visit(x->src_ptr);
-    s << ")";
+    schedule_visit_(x->src_ptr);
+    later(")");
   }
-  virtual void visit_expr_(ExprAddRef x) override final {
-    s << "(";
-    visit(x->a);
-    s << " + ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprAddRef& x) {
+    visit_binary_op(x->a, " + ", x->b);
   }
-  virtual void visit_expr_(ExprSubRef x) override final {
-    s << "(";
-    visit(x->a);
-    s << " - ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprSubRef& x) {
+    visit_binary_op(x->a, " - ", x->b);
   }
-  virtual void visit_expr_(ExprMulRef x) override final {
-    s << "(";
-    visit(x->a);
-    s << " * ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprMulRef& x) {
+    visit_binary_op(x->a, " * ", x->b);
   }
-  virtual void visit_expr_(ExprDivRef x) override final {
-    s << "(";
-    visit(x->a);
-    s << " / ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprDivRef& x) {
+    visit_binary_op(x->a, " / ", x->b);
   }
-  virtual void visit_expr_(ExprModRef x) override final {
-    s << "(";
-    visit(x->a);
-    s << " % ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprModRef& x) {
+    visit_binary_op(x->a, " % ", x->b);
   }
-  virtual void visit_expr_(ExprLtRef x) override final {
-    s << "(";
-    visit( x->a);
-    s << " < ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprLtRef& x) {
+    visit_binary_op(x->a, " < ", x->b);
   }
-  virtual void visit_expr_(ExprEqRef x) override final {
-    s << "(";
-    visit(x->a);
-    s << " == ";
-    visit(x->b);
-    s << ")";
+  void visit_expr_(const ExprEqRef& x) {
+    visit_binary_op(x->a, " == ", x->b);
   }
-  virtual void visit_expr_(ExprNotRef x) override final {
+  void visit_expr_(const ExprNotRef& x) {
     s << "!";
-    visit(x->a);
-    s << "";
+    schedule_visit_(x->a);
   }
-  virtual void visit_expr_(ExprTypeCastRef x) override final {
+  void visit_expr_(const ExprTypeCastRef& x) {
     s << "(";
-    visit(x->src);
-    s << ":";
-    visit(x->ty);
-    s << ")";
+    schedule_visit_(x->src);
+    later(":");
+    schedule_visit_(x->ty);
+    later(")");
   }
-  virtual void visit_expr_(ExprSelectRef x) override final {
+  void visit_expr_(const ExprSelectRef& x) {
     s << "(";
-    visit(x->cond);
-    s << "?";
-    visit(x->a);
-    s << ":";
-    visit(x->b);
-    s << ")";
+    schedule_visit_(x->cond);
+    later("?");
+    schedule_visit_(x->a);
+    later(":");
+    schedule_visit_(x->b);
+    later(")");
   }
 
 
-  virtual void visit_stmt_(StmtNopRef x) override final {
+  void visit_stmt_(const StmtNopRef& x) {
     s << "nop" << std::endl;
   }
-  virtual void visit_stmt_(StmtBlockRef x) override final {
+  void visit_stmt_(const StmtBlockRef& x) {
     s << "{" << std::endl;
     s.push_indent();
     for (const auto& stmt : x->stmts) {
-      visit(stmt);
+      schedule_visit_(stmt);
     }
-    s.pop_indent();
-    s << "}" << std::endl;
+    later([this]() {
+      s.pop_indent();
+      s << "}" << std::endl;
+    });
   }
-  virtual void visit_stmt_(StmtConditionalBranchRef x) override final {
+  void visit_stmt_(const StmtConditionalBranchRef& x) {
     s << "if ";
-    visit(x->cond);
-    s << " {" << std::endl;
-    s.push_indent();
-    visit(x->then_block);
-    s.pop_indent();
-    s << "} else {" << std::endl;
-    s.push_indent();
-    visit(x->else_block);
-    s.pop_indent();
-    s << "}" << std::endl;
-  }
-  virtual void visit_stmt_(StmtLoopRef x) override final {
+    schedule_visit_(x->cond);
+    later([this]() { s << " {" << std::endl; });
+    visit_indented_block(x->then_block);
+    later([this]() { s << "} else {" << std::endl; });
+    visit_indented_block(x->else_block);
+    later([this]() { s << "}" << std::endl; });
+  }
+  void visit_stmt_(const StmtLoopRef& x) {
     s << "loop@" << s.get_var_name_by_handle(x->handle) << " {" << std::endl;
-    s.push_indent();
-    visit(x->body_block);
-    s.pop_indent();
-    s << "} continue@" << s.get_var_name_by_handle(x->handle) << " {" << std::endl;
-    s.push_indent();
-    visit(x->continue_block);
-    s.pop_indent();
-    s << "}" << std::endl;
-  }
-  virtual void visit_stmt_(StmtConditionalLoopRef x) override final {
+    visit_indented_block(x->body_block);
+    later([this, x]() {
+      s << "} continue@" << s.get_var_name_by_handle(x->handle) << " {" << std::endl;
+    });
+    visit_indented_block(x->continue_block);
+    later([this]() { s << "}" << std::endl; });
+  }
+  void visit_stmt_(const StmtConditionalLoopRef& x) {
     s << "while@" << s.get_var_name_by_handle(x->handle) << " ";
-    visit(x->cond);
-    s << " {" << std::endl;
-    s.push_indent();
-    visit(x->body_block);
-    s.pop_indent();
-    s << "} continue@" << s.get_var_name_by_handle(x->handle) << " {" << std::endl;
-    s.push_indent();
-    visit(x->continue_block);
-    s.pop_indent();
-    s << "}" << std::endl;
-  }
-  virtual void visit_stmt_(StmtReturnRef x) override final {
+    schedule_visit_(x->cond);
+    later([this]() { s << " {" << std::endl; });
+    visit_indented_block(x->body_block);
+    later([this, x]() {
+      s << "} continue@" << s.get_var_name_by_handle(x->handle) << " {" << std::endl;
+    });
+    visit_indented_block(x->continue_block);
+    later([this]() { s << "}" << std::endl; });
+  }
+  void visit_stmt_(const StmtReturnRef& x) {
     s << "return" << std::endl;
   }
-  virtual void visit_stmt_(StmtLoopContinueRef x) override final {
+  void visit_stmt_(const StmtLoopContinueRef& x) {
     s << "continue@" << s.get_var_name_by_handle(x->handle) << std::endl;
   }
-  virtual void visit_stmt_(StmtLoopBackEdgeRef x) override final {
+  void visit_stmt_(const StmtLoopBackEdgeRef& x) {
     s << "back-edge@" << s.get_var_name_by_handle(x->handle) << std::endl;
   }
-  virtual void visit_stmt_(StmtLoopMergeRef x) override final {
+  void visit_stmt_(const StmtLoopMergeRef& x) {
     s << "break@" << s.get_var_name_by_handle(x->handle) << std::endl;
   }
-  virtual void visit_stmt_(StmtRangedLoopRef x) override final {
+  void visit_stmt_(const StmtRangedLoopRef& x) {
     s << "for ";
-    visit(x->itervar);
-    s << " {" << std::endl;
-    s.push_indent();
-    visit(x->body_block);
-    s.pop_indent();
-    s << "}" << std::endl;
+    schedule_visit_(x->itervar);
+    later([this]() { s << " {" << std::endl; });
+    visit_indented_block(x->body_block);
+    later([this]() { s << "}" << std::endl; });
   }
-  virtual void visit_stmt_(StmtStoreRef x) override final {
+  void visit_stmt_(const StmtStoreRef& x) {
     s << "Store(";
-    visit(x->dst_ptr);
-    s << ", ";
-    visit(x->value);
-    s << ")";
-    s << std::endl;
+    schedule_visit_(x->dst_ptr);
+    later(", ");
+    schedule_visit_(x->value);
+    later([this]() { s << ")" << std::endl; });
   }
 };
 
 std::string dbg_print(const NodeRef& node) {
+  CSPV_TRACE_SCOPE("dbg_print");
   Debug s;
   DebugPrintVisitor v(s);
   v.visit(node);
@@ -297,29 +295,41 @@ std::string dbg_print(const NodeRef& node) {
 }
 
 bool is_tail_stmt(const StmtRef& x) {
-  switch (x->op) {
-  case L_STMT_OP_BLOCK:
-    return is_tail_stmt(x->as<StmtBlock>().stmts.back());
-  case L_STMT_OP_CONDITIONAL_BRANCH:
-  {
-    const auto& stmt = x->as<StmtConditionalBranch>();
-    return is_tail_stmt(stmt.then_block) && is_tail_stmt(stmt.else_block);
-  }
-  case L_STMT_OP_RETURN:
-  case L_STMT_OP_LOOP_MERGE:
-  case L_STMT_OP_LOOP_CONTINUE:
-  case L_STMT_OP_LOOP_BACK_EDGE:
-    return true;
-  default:
-    return false;
+  // Every statement left on the stack must be a tail statement for `x` to be
+  // one.
+  std::vector<const Stmt*> stack { x.get() };
+  while (!stack.empty()) {
+    const Stmt* stmt = stack.back();
+    stack.pop_back();
+    switch (stmt->op) {
+    case L_STMT_OP_BLOCK:
+      stack.emplace_back(stmt->as<StmtBlock>().stmts.back().get());
+      break;
+    case L_STMT_OP_CONDITIONAL_BRANCH:
+    {
+      const auto& branch = stmt->as<StmtConditionalBranch>();
+      stack.emplace_back(branch.else_block.get());
+      stack.emplace_back(branch.then_block.get());
+      break;
+    }
+    case L_STMT_OP_RETURN:
+    case L_STMT_OP_LOOP_MERGE:
+    case L_STMT_OP_LOOP_CONTINUE:
+    case L_STMT_OP_LOOP_BACK_EDGE:
+      break;
+    default:
+      return false;
+    }
   }
+  return true;
 }
 StmtRef flatten_block(const StmtRef& x) {
   if (!x->is<StmtBlock>()) { return x; }
   auto block = x.as<StmtBlock>();
 
-  std::vector<StmtRef> stmts;
+  NodeList<StmtRef> stmts;
   stmts.reserve(block->stmts.size());
+  bool is_flat = true;
   for (const StmtRef& stmt : block->stmts) {
     if (stmt->is<StmtBlock>()) {
       const auto& stmts2 = stmt.as<StmtBlock>()->stmts;
@@ -327,8 +337,10 @@ StmtRef flatten_block(const StmtRef& x) {
       for (auto stmt : stmts2) {
         stmts.emplace_back(stmt);
       }
+      is_flat = false;
     } else if (stmt->is<StmtNop>()) {
       // Ignore nops.
+      is_flat = false;
       continue;
     } else {
       stmts.emplace_back(stmt);
@@ -339,6 +351,11 @@ StmtRef flatten_block(const StmtRef& x) {
     if (is_tail_stmt(stmts.back())) { break; }
   }
 
+  // Keep the block as-is if there is nothing to flatten, so that mutators can
+  // tell it's unchanged.
+  if (is_flat && stmts.size() == block->stmts.size() && stmts.size() > 1) {
+    return x;
+  }
   switch (stmts.size()) {
   case 0: return new StmtNop();
   case 1: return std::move(stmts[0]);
@@ -347,23 +364,23 @@ StmtRef flatten_block(const StmtRef& x) {
 }
 
 StmtRef& get_head_stmt(StmtRef& stmt) {
-  if (stmt->is<StmtBlock>()) {
-    auto& block = stmt->as<StmtBlock>();
+  StmtRef* out = &stmt;
+  while ((*out)->is<StmtBlock>()) {
+    auto& block = (*out)->as<StmtBlock>();
     assert(!block.stmts.empty());
-    return get_tail_stmt((StmtRef&)block.stmts.front());
-  } else {
-    return stmt;
+    out = (StmtRef*)&block.stmts.front();
   }
+  return *out;
 }
 
 StmtRef& get_tail_stmt(StmtRef& stmt) {
-  if (stmt->is<StmtBlock>()) {
-    auto& block = stmt->as<StmtBlock>();
+  StmtRef* out = &stmt;
+  while ((*out)->is<StmtBlock>()) {
+    auto& block = (*out)->as<StmtBlock>();
     assert(!block.stmts.empty());
-    return get_tail_stmt((StmtRef&)block.stmts.back());
-  } else {
-    return stmt;
+    out = (StmtRef*)&block.stmts.back();
   }
+  return *out;
 }
 
 std::vector<NodeRef> collect_children(const NodeRef& node) {
@@ -371,6 +388,19 @@ std::vector<NodeRef> collect_children(const NodeRef& node) {
   node->collect_children(&drain);
   return drain.nodes;
 }
+size_t count_nodes(const NodeRef& root) {
+  // Nodes like types are shared by many parents; count each only once.
+  std::set<const Node*> visited;
+  NodeDrain drain;
+  drain.push(root);
+  while (!drain.nodes.empty()) {
+    NodeRef node = std::move(drain.nodes.back());
+    drain.nodes.pop_back();
+    if (node == nullptr || !visited.emplace(node.get()).second) { continue; }
+    node->collect_children(&drain);
+  }
+  return visited.size();
+}
 
 bool match_pattern(const NodeRef& pattern, const NodeRef& target) {
   if (pattern->nova != target->nova) {